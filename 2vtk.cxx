@@ -0,0 +1,782 @@
+/*****************************************************************************
+ * Convert the binary output of DynEarthSol3D to VTK files.
+ *
+ * usage: 2vtk [-x -c -m -t -h] modelname [start [end]]
+ *
+ * This is a faster replacement of 2vtk.py. The output files are memory
+ * mapped, and the frames are converted in parallel (if compiled with
+ * OpenMP). Both 2D and 3D output, either in separate 'modelname.save.NNNNNN'
+ * files or in a single 'modelname.frames' container, are supported.
+ *
+ * By default, each frame is converted to a VTU file with raw binary data
+ * appended after the XML part. With '-x', a single XDMF file 'modelname.xmf'
+ * is written instead. The XDMF file only refers to the arrays in the output
+ * files by their offsets, no data is copied, so derived fields (e.g. the
+ * invariants of stress) are not available in this mode.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "constants.hpp"
+
+
+namespace {
+
+    const char usage[] =
+        "usage: 2vtk [-x -c -m -t -h] modelname [start [end]]\n"
+        "\n"
+        "options:\n"
+        "    -x          write a single XDMF file referring to the output files\n"
+        "                (default: one VTU file per frame)\n"
+        "    -c          save files in current directory\n"
+        "    -m          save marker data (VTU mode only)\n"
+        "    -t          save all tensor components (default: no component)\n"
+        "    -h,--help   show this help\n";
+
+    const std::size_t headerlen = 4096;
+    const char container_str[] = "# DynEarthSol container revision=1\n";
+
+    struct Options {
+        bool xdmf;
+        bool in_cwd;
+        bool markers;
+        bool tensor_components;
+        std::string modelname;
+        int start, end;
+    };
+
+
+    struct FrameInfo {
+        int frame;
+        double time;
+        int nnode, nelem;
+    };
+
+
+    class MappedFile
+    {
+    public:
+        const char *data;
+        std::size_t size;
+
+        MappedFile(const std::string &filename)
+        {
+            int fd = open(filename.c_str(), O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                std::cerr << "Error: cannot open file: " << filename << '\n';
+                std::exit(2);
+            }
+            size = st.st_size;
+            void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (p == MAP_FAILED) {
+                std::cerr << "Error: cannot map file: " << filename << '\n';
+                std::exit(2);
+            }
+            data = static_cast<const char*>(p);
+        }
+
+        ~MappedFile()
+        {
+            munmap(const_cast<char*>(data), size);
+        }
+
+    private:
+        // disable copy
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+    };
+
+
+    /* The arrays of a frame, located by parsing the header of the frame. */
+    struct Frame {
+        const FrameInfo *info;
+        const char *base;  // start of the mapped file
+        std::string filename;
+        int ndims;
+        std::map<std::string, std::size_t> offset;
+
+        bool has(const char *name) const {return offset.count(name);}
+
+        template <typename T>
+        const T* array(const char *name) const {
+            return reinterpret_cast<const T*>(base + offset.find(name)->second);
+        }
+    };
+
+
+    void parse_header(const char *buffer, const std::string &filename,
+                      int &ndims, std::string &group, long &prev_pos,
+                      std::map<std::string, std::size_t> &offset)
+    {
+        std::string header(buffer, strnlen(buffer, headerlen));
+
+        std::size_t eol = header.find('\n');
+        std::string first = header.substr(0, eol);
+        int revision;
+        if (std::sscanf(first.c_str(), "# DynEarthSol ndims=%d revision=%d", &ndims, &revision) != 2 ||
+            (ndims != 2 && ndims != 3)) {
+            std::cerr << "Error: " << filename << " is not a valid DynEarthSol output file\n";
+            std::exit(1);
+        }
+
+        // The header of a group in the container has more to say
+        group.clear();
+        prev_pos = -1;
+        std::size_t g = first.find(" group=");
+        if (g != std::string::npos) {
+            char name[256];
+            if (std::sscanf(first.c_str() + g, " group=%255s prev=%ld", name, &prev_pos) != 2) {
+                std::cerr << "Error: error parsing group header in " << filename << '\n';
+                std::exit(1);
+            }
+            group = name;
+        }
+
+        offset.clear();
+        while (eol != std::string::npos && eol + 1 < header.size()) {
+            std::size_t start = eol + 1;
+            eol = header.find('\n', start);
+            std::string line = header.substr(start, eol - start);
+            std::size_t tab = line.find('\t');
+            if (tab == std::string::npos) break;  // end of record
+            offset[line.substr(0, tab)] = std::strtoul(line.c_str() + tab + 1, NULL, 10);
+        }
+    }
+
+
+    void read_info(const std::string &modelname, std::vector<FrameInfo> &frames)
+    {
+        std::string filename(modelname + ".info");
+        std::FILE *f = std::fopen(filename.c_str(), "r");
+        if (f == NULL) {
+            std::cerr << "Error: cannot open file: " << filename << '\n';
+            std::exit(2);
+        }
+
+        char line[256];
+        while (std::fgets(line, sizeof(line), f) != NULL) {
+            if (line[0] == '#') continue;  // comment
+            FrameInfo fi;
+            if (std::sscanf(line, "%d %*d %lf %*f %*f %d %d",
+                            &fi.frame, &fi.time, &fi.nnode, &fi.nelem) != 4) {
+                std::cerr << "Error: error parsing " << filename << '\n'
+                          << " Line is:" << line << '\n';
+                std::exit(1);
+            }
+            frames.push_back(fi);
+        }
+        std::fclose(f);
+    }
+
+
+    std::string output_prefix(const Options &opt)
+    {
+        if (! opt.in_cwd) return opt.modelname;
+        std::size_t slash = opt.modelname.rfind('/');
+        if (slash == std::string::npos) return opt.modelname;
+        return opt.modelname.substr(slash + 1);
+    }
+
+
+    //
+    // VTU with appended raw data
+    //
+
+    struct DataArray {
+        std::string name;
+        const char *type;
+        int ncomp;
+        const void *data;
+        std::size_t nbytes;
+    };
+
+
+    class AppendedVTKFile
+    {
+        /* Collecting the arrays first, since the XML part must know the
+         * offsets of all arrays in the appended section. */
+    public:
+        std::vector<DataArray> point_data, cell_data, points, cells;
+
+        // owned buffers of the derived arrays
+        std::vector< std::vector<double> > dbuf;
+        std::vector< std::vector<int> > ibuf;
+        std::vector< std::vector<unsigned char> > cbuf;
+
+        void add(std::vector<DataArray> &section, const std::string &name, const char *type,
+                 int ncomp, const void *data, std::size_t nbytes)
+        {
+            DataArray a = {name, type, ncomp, data, nbytes};
+            section.push_back(a);
+        }
+
+        void add(std::vector<DataArray> &section, const std::string &name, int ncomp,
+                 const double *data, std::size_t n)
+        {
+            add(section, name, "Float64", ncomp, data, n * sizeof(double));
+        }
+
+        void add(std::vector<DataArray> &section, const std::string &name, int ncomp,
+                 const int *data, std::size_t n)
+        {
+            add(section, name, "Int32", ncomp, data, n * sizeof(int));
+        }
+
+        double* new_double(std::size_t n)
+        {
+            dbuf.push_back(std::vector<double>(n));
+            return dbuf.back().data();
+        }
+
+        int* new_int(std::size_t n)
+        {
+            ibuf.push_back(std::vector<int>(n));
+            return ibuf.back().data();
+        }
+
+        unsigned char* new_uchar(std::size_t n)
+        {
+            cbuf.push_back(std::vector<unsigned char>(n));
+            return cbuf.back().data();
+        }
+
+        void write(const std::string &filename, const char *type, const char *piece_attr)
+        {
+            std::FILE *f = std::fopen(filename.c_str(), "wb");
+            if (f == NULL) {
+                std::cerr << "Error: cannot open file: " << filename << '\n';
+                std::exit(2);
+            }
+
+            std::fprintf(f, "<?xml version=\"1.0\"?>\n"
+                         "<VTKFile type=\"%s\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\">\n"
+                         "<%s>\n"
+                         "<Piece %s>\n", type, type, piece_attr);
+
+            std::size_t offset = 0;
+            write_section(f, "PointData", point_data, offset);
+            write_section(f, "CellData", cell_data, offset);
+            write_section(f, "Points", points, offset);
+            write_section(f, "Cells", cells, offset);
+
+            std::fprintf(f, "</Piece>\n"
+                         "</%s>\n"
+                         "<AppendedData encoding=\"raw\">\n_", type);
+            write_data(f, point_data);
+            write_data(f, cell_data);
+            write_data(f, points);
+            write_data(f, cells);
+            std::fprintf(f, "\n</AppendedData>\n"
+                         "</VTKFile>\n");
+
+            if (std::ferror(f)) {
+                std::cerr << "Error: cannot write file: " << filename << '\n';
+                std::exit(2);
+            }
+            std::fclose(f);
+        }
+
+    private:
+        void write_section(std::FILE *f, const char *section,
+                           const std::vector<DataArray> &arrays, std::size_t &offset)
+        {
+            if (arrays.empty()) return;
+            std::fprintf(f, "  <%s>\n", section);
+            for (std::size_t i=0; i<arrays.size(); ++i) {
+                const DataArray &a = arrays[i];
+                std::fprintf(f, "<DataArray type=\"%s\" Name=\"%s\" NumberOfComponents=\"%d\" "
+                             "format=\"appended\" offset=\"%zu\"/>\n",
+                             a.type, a.name.c_str(), a.ncomp, offset);
+                offset += sizeof(unsigned long long) + a.nbytes;
+            }
+            std::fprintf(f, "  </%s>\n", section);
+        }
+
+        void write_data(std::FILE *f, const std::vector<DataArray> &arrays)
+        {
+            for (std::size_t i=0; i<arrays.size(); ++i) {
+                unsigned long long n = arrays[i].nbytes;
+                std::fwrite(&n, sizeof(n), 1, f);
+                std::fwrite(arrays[i].data, 1, arrays[i].nbytes, f);
+            }
+        }
+    };
+
+
+    const double* vector3(AppendedVTKFile &vtk, const Frame &fr, const char *name, int n)
+    {
+        /* VTK requires vector field (velocity, coordinate) has 3 components. */
+        const double *a = fr.array<double>(name);
+        if (fr.ndims == 3) return a;
+
+        double *tmp = vtk.new_double(3 * n);
+        for (int i=0; i<n; ++i) {
+            tmp[3*i] = a[2*i];
+            tmp[3*i+1] = a[2*i+1];
+            tmp[3*i+2] = 0;
+        }
+        return tmp;
+    }
+
+
+    double first_invariant(const double *t, int ndims)
+    {
+        double s = 0;
+        for (int d=0; d<ndims; ++d) s += t[d];
+        return s / ndims;
+    }
+
+
+    double second_invariant(const double *t, int ndims)
+    {
+        /* The second invariant of the deviatoric part of a symmetric tensor t,
+         * where t[0:ndims] are the diagonal components;
+         * and t[ndims:] are the off-diagonal components. */
+        if (ndims == 2)
+            return std::sqrt(0.25 * (t[0] - t[1]) * (t[0] - t[1]) + t[2] * t[2]);
+
+        double a = (t[0] + t[1] + t[2]) / 3;
+        return std::sqrt( 0.5 * ((t[0] - a) * (t[0] - a) + (t[1] - a) * (t[1] - a) +
+                                 (t[2] - a) * (t[2] - a)) +
+                          t[3] * t[3] + t[4] * t[4] + t[5] * t[5]);
+    }
+
+
+    void add_tensor(AppendedVTKFile &vtk, const Frame &fr, const Options &opt,
+                    const char *name, const char *label, double *I, double *II)
+    {
+        const char *xyz2[] = {"XX", "ZZ", "XZ"};
+        const char *xyz3[] = {"XX", "YY", "ZZ", "XY", "XZ", "YZ"};
+        const char **component_names = (fr.ndims == 2) ? xyz2 : xyz3;
+
+        const int nelem = fr.info->nelem;
+        const int nstr = fr.ndims * (fr.ndims + 1) / 2;
+        const double *t = fr.array<double>(name);
+
+        for (int e=0; e<nelem; ++e) {
+            if (I) I[e] = first_invariant(t + e*nstr, fr.ndims);
+            II[e] = second_invariant(t + e*nstr, fr.ndims);
+        }
+
+        if (! opt.tensor_components) return;
+
+        for (int d=0; d<nstr; ++d) {
+            double *c = vtk.new_double(nelem);
+            for (int e=0; e<nelem; ++e) {
+                c[e] = t[e*nstr + d];
+                // the diagonal components of stress are shown as deviatoric
+                if (I && d < fr.ndims) c[e] -= I[e];
+            }
+            std::string cname = std::string(label) + " " + component_names[d];
+            if (I && d < fr.ndims) cname += " dev.";
+            vtk.add(vtk.cell_data, cname, 1, c, nelem);
+        }
+    }
+
+
+    void write_vtu(const Frame &fr, const Options &opt)
+    {
+        const int nnode = fr.info->nnode;
+        const int nelem = fr.info->nelem;
+        AppendedVTKFile vtk;
+
+        //
+        // node-based field
+        //
+        // averaged velocity is more stable and is preferred
+        const char *vel = fr.has("velocity averaged") ? "velocity averaged" : "velocity";
+        if (fr.has(vel))
+            vtk.add(vtk.point_data, "velocity", 3, vector3(vtk, fr, vel, nnode), 3*nnode);
+        if (fr.has("force"))
+            vtk.add(vtk.point_data, "force", 3, vector3(vtk, fr, "force", nnode), 3*nnode);
+        if (fr.has("temperature"))
+            vtk.add(vtk.point_data, "temperature", 1, fr.array<double>("temperature"), nnode);
+
+        //
+        // element-based field
+        //
+        const char *scalars[] = {"mesh quality", "plastic strain", "plastic strain-rate"};
+        for (int i=0; i<3; ++i) {
+            if (fr.has(scalars[i]))
+                vtk.add(vtk.cell_data, scalars[i], 1, fr.array<double>(scalars[i]), nelem);
+        }
+
+        double *srII = NULL;
+        if (fr.has("strain-rate")) {
+            srII = vtk.new_double(nelem);
+            double *tmp = vtk.new_double(nelem);
+            add_tensor(vtk, fr, opt, "strain-rate", "strain-rate", NULL, srII);
+            for (int e=0; e<nelem; ++e)
+                tmp[e] = std::log10(srII[e] + 1e-45);
+            vtk.add(vtk.cell_data, "strain-rate II log10", 1, tmp, nelem);
+        }
+
+        if (fr.has("strain")) {
+            double *sI = vtk.new_double(nelem);
+            double *sII = vtk.new_double(nelem);
+            // strain is not shown as deviatoric, computing I separately
+            add_tensor(vtk, fr, opt, "strain", "strain", NULL, sII);
+            const double *s = fr.array<double>("strain");
+            const int nstr = fr.ndims * (fr.ndims + 1) / 2;
+            for (int e=0; e<nelem; ++e)
+                sI[e] = first_invariant(s + e*nstr, fr.ndims);
+            vtk.add(vtk.cell_data, "strain I", 1, sI, nelem);
+            vtk.add(vtk.cell_data, "strain II", 1, sII, nelem);
+        }
+
+        double *tII = NULL;
+        if (fr.has("stress")) {
+            // averaged stress is more stable and is preferred
+            const char *stress = fr.has("stress averaged") ? "stress averaged" : "stress";
+            double *tI = vtk.new_double(nelem);
+            tII = vtk.new_double(nelem);
+            add_tensor(vtk, fr, opt, stress, "stress", tI, tII);
+            vtk.add(vtk.cell_data, "stress I", 1, tI, nelem);
+            vtk.add(vtk.cell_data, "stress II", 1, tII, nelem);
+        }
+
+        const char *others[] = {"density", "material", "viscosity"};
+        for (int i=0; i<3; ++i) {
+            if (fr.has(others[i]))
+                vtk.add(vtk.cell_data, others[i], 1, fr.array<double>(others[i]), nelem);
+        }
+
+        if (srII && tII) {
+            double *effvisc = vtk.new_double(nelem);
+            for (int e=0; e<nelem; ++e)
+                effvisc[e] = tII[e] / (srII[e] + 1e-45);
+            vtk.add(vtk.cell_data, "effective viscosity", 1, effvisc, nelem);
+        }
+
+        //
+        // node coordinate
+        //
+        vtk.add(vtk.points, "coordinate", 3, vector3(vtk, fr, "coordinate", nnode), 3*nnode);
+
+        //
+        // element connectivity & types
+        //
+        const int nodes_per_elem = fr.ndims + 1;
+        vtk.add(vtk.cells, "connectivity", 1, fr.array<int>("connectivity"), nodes_per_elem*nelem);
+        int *offsets = vtk.new_int(nelem);
+        for (int e=0; e<nelem; ++e)
+            offsets[e] = nodes_per_elem * (e + 1);
+        vtk.add(vtk.cells, "offsets", 1, offsets, nelem);
+        // VTK_TRIANGLE == 5, VTK_TETRA == 10
+        unsigned char *types = vtk.new_uchar(nelem);
+        std::memset(types, (fr.ndims == 2) ? 5 : 10, nelem);
+        vtk.add(vtk.cells, "types", "UInt8", 1, types, nelem);
+
+        char filename[256], piece[64];
+        std::snprintf(filename, 255, "%s.%06d.vtu", output_prefix(opt).c_str(), fr.info->frame);
+        std::snprintf(piece, 63, "NumberOfPoints=\"%d\" NumberOfCells=\"%d\"", nnode, nelem);
+        vtk.write(filename, "UnstructuredGrid", piece);
+    }
+
+
+    void write_vtp(const Frame &fr, const Options &opt)
+    {
+        if (! fr.has("markerset size")) return;
+
+        const int nmarkers = *fr.array<int>("markerset size");
+        AppendedVTKFile vtk;
+
+        const char *names[] = {"markerset.mattype", "markerset.elem", "markerset.id"};
+        for (int i=0; i<3; ++i)
+            vtk.add(vtk.point_data, names[i], 1, fr.array<int>(names[i]), nmarkers);
+        vtk.add(vtk.points, "markerset.coord", 3,
+                vector3(vtk, fr, "markerset.coord", nmarkers), 3*nmarkers);
+
+        char filename[256], piece[64];
+        std::snprintf(filename, 255, "%s.%06d.vtp", output_prefix(opt).c_str(), fr.info->frame);
+        std::snprintf(piece, 63, "NumberOfPoints=\"%d\"", nmarkers);
+        vtk.write(filename, "PolyData", piece);
+    }
+
+
+    //
+    // XDMF referring to the arrays in the output files
+    //
+
+    void xdmf_dataitem(std::FILE *f, const Frame &fr, const std::string &ref,
+                       const char *name, int n, int ncomp, bool is_int)
+    {
+        std::fprintf(f, "        <DataItem Dimensions=\"%d %d\" NumberType=\"%s\" Precision=\"%d\" "
+                     "Format=\"Binary\" Endian=\"Little\" Seek=\"%zu\">%s</DataItem>\n",
+                     n, ncomp, is_int ? "Int" : "Float", is_int ? 4 : 8,
+                     fr.offset.find(name)->second, ref.c_str());
+    }
+
+
+    void xdmf_attribute(std::FILE *f, const Frame &fr, const std::string &ref,
+                        const char *name, const char *label, bool on_node, int ncomp)
+    {
+        if (! fr.has(name)) return;
+
+        const char *type = "Matrix";
+        if (ncomp == 1) type = "Scalar";
+        else if (ncomp == 3 && on_node) type = "Vector";
+
+        std::fprintf(f, "      <Attribute Name=\"%s\" AttributeType=\"%s\" Center=\"%s\">\n",
+                     label, type, on_node ? "Node" : "Cell");
+        xdmf_dataitem(f, fr, ref, name, on_node ? fr.info->nnode : fr.info->nelem, ncomp, false);
+        std::fprintf(f, "      </Attribute>\n");
+    }
+
+
+    void write_xdmf_grid(std::FILE *f, const Frame &fr, const Options &opt)
+    {
+        /* Path of the output file relative to the xdmf file */
+        std::string ref = fr.filename;
+        if (! opt.in_cwd) {
+            std::size_t slash = ref.rfind('/');
+            if (slash != std::string::npos) ref = ref.substr(slash + 1);
+        }
+
+        const int ndims = fr.ndims;
+        const int nstr = ndims * (ndims + 1) / 2;
+
+        std::fprintf(f, "    <Grid Name=\"frame %06d\" GridType=\"Uniform\">\n"
+                     "      <Time Value=\"%.9g\"/>\n", fr.info->frame, fr.info->time / YEAR2SEC);
+
+        std::fprintf(f, "      <Topology TopologyType=\"%s\" NumberOfElements=\"%d\">\n",
+                     (ndims == 2) ? "Triangle" : "Tetrahedron", fr.info->nelem);
+        xdmf_dataitem(f, fr, ref, "connectivity", fr.info->nelem, ndims + 1, true);
+        std::fprintf(f, "      </Topology>\n");
+
+        std::fprintf(f, "      <Geometry GeometryType=\"%s\">\n", (ndims == 2) ? "XY" : "XYZ");
+        xdmf_dataitem(f, fr, ref, "coordinate", fr.info->nnode, ndims, false);
+        std::fprintf(f, "      </Geometry>\n");
+
+        const char *vel = fr.has("velocity averaged") ? "velocity averaged" : "velocity";
+        xdmf_attribute(f, fr, ref, vel, "velocity", true, ndims);
+        xdmf_attribute(f, fr, ref, "force", "force", true, ndims);
+        xdmf_attribute(f, fr, ref, "temperature", "temperature", true, 1);
+
+        const char *scalars[] = {"mesh quality", "plastic strain", "plastic strain-rate",
+                                 "density", "material", "viscosity"};
+        for (int i=0; i<6; ++i)
+            xdmf_attribute(f, fr, ref, scalars[i], scalars[i], false, 1);
+
+        // tensors are in the order of XX, (YY,) ZZ, then off-diagonal components
+        xdmf_attribute(f, fr, ref, "strain-rate", "strain-rate", false, nstr);
+        xdmf_attribute(f, fr, ref, "strain", "strain", false, nstr);
+        const char *stress = fr.has("stress averaged") ? "stress averaged" : "stress";
+        xdmf_attribute(f, fr, ref, stress, "stress", false, nstr);
+
+        std::fprintf(f, "    </Grid>\n");
+    }
+
+
+    //
+    // locating the frames
+    //
+
+    class Frames
+    {
+        /* Either a single container, or one file per frame */
+    public:
+        Frames(const Options &opt) : modelname(opt.modelname), container(NULL)
+        {
+            read_info(modelname, info);
+
+            std::string filename(modelname + ".frames");
+            std::FILE *f = std::fopen(filename.c_str(), "r");
+            if (f == NULL) return;
+
+            char buffer[sizeof(container_str)] = {0};
+            std::size_t n = std::fread(buffer, 1, std::strlen(container_str), f);
+            std::fclose(f);
+            if (n != std::strlen(container_str) ||
+                std::strncmp(buffer, container_str, n) != 0) return;
+
+            container = new MappedFile(filename);
+            container_name = filename;
+            index_container();
+        }
+
+        ~Frames()
+        {
+            delete container;
+        }
+
+        const std::vector<FrameInfo>& frames() const {return info;}
+
+        void locate(const FrameInfo &fi, Frame &fr, MappedFile *&mapped) const
+        {
+            /* Locating the arrays of a frame, the file of the frame is
+             * mapped and returned in 'mapped', unless in a container. */
+            fr.info = &fi;
+
+            std::size_t pos = 0;
+            char name[64];
+            if (container) {
+                std::snprintf(name, 63, "save.%06d", fi.frame);
+                std::map<std::string, long>::const_iterator it = group_pos.find(name);
+                if (it == group_pos.end()) {
+                    std::cerr << "Error: no group named " << name << " in " << container_name << '\n';
+                    std::exit(2);
+                }
+                pos = it->second;
+                fr.filename = container_name;
+                fr.base = container->data;
+                mapped = NULL;
+            }
+            else {
+                std::snprintf(name, 63, ".save.%06d", fi.frame);
+                fr.filename = modelname + name;
+                mapped = new MappedFile(fr.filename);
+                fr.base = mapped->data;
+                if (mapped->size < headerlen) {
+                    std::cerr << "Error: " << fr.filename << " is not a valid DynEarthSol output file\n";
+                    std::exit(1);
+                }
+            }
+
+            std::string group;
+            long prev_pos;
+            parse_header(fr.base + pos, fr.filename, fr.ndims, group, prev_pos, fr.offset);
+        }
+
+    private:
+        const std::string &modelname;
+        std::vector<FrameInfo> info;
+        MappedFile *container;
+        std::string container_name;
+        std::map<std::string, long> group_pos;
+
+        void index_container()
+        {
+            /* Walking backward from the last committed group. If a group is
+             * written more than once, the latest one is used. */
+            long last, end;
+            if (std::sscanf(container->data + std::strlen(container_str),
+                            "last=%ld\nend=%ld", &last, &end) != 2) {
+                std::cerr << "Error: " << container_name << " is not a valid container file\n";
+                std::exit(2);
+            }
+
+            long pos = last;
+            while (pos >= 0 && pos + headerlen <= container->size) {
+                int ndims;
+                std::string group;
+                long prev_pos;
+                std::map<std::string, std::size_t> offset;
+                parse_header(container->data + pos, container_name, ndims, group, prev_pos, offset);
+                if (! group_pos.count(group)) group_pos[group] = pos;
+                pos = prev_pos;
+            }
+        }
+    };
+
+
+    void parse_arguments(int argc, const char *argv[], Options &opt)
+    {
+        opt.xdmf = opt.in_cwd = opt.markers = opt.tensor_components = false;
+        opt.start = 0;
+        opt.end = -1;
+
+        int npos = 0;
+        for (int i=1; i<argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "-h" || arg == "--help") {
+                std::cout << usage;
+                std::exit(0);
+            }
+            else if (arg == "-x") opt.xdmf = true;
+            else if (arg == "-c") opt.in_cwd = true;
+            else if (arg == "-m") opt.markers = true;
+            else if (arg == "-t") opt.tensor_components = true;
+            else if (arg[0] == '-') {
+                std::cerr << "Error: unknown option: " << arg << '\n' << usage;
+                std::exit(1);
+            }
+            else if (npos == 0) {opt.modelname = arg; ++npos;}
+            else if (npos == 1) {opt.start = std::atoi(argv[i]); ++npos;}
+            else if (npos == 2) {opt.end = std::atoi(argv[i]); ++npos;}
+            else {
+                std::cerr << usage;
+                std::exit(1);
+            }
+        }
+
+        if (npos == 0) {
+            std::cerr << usage;
+            std::exit(1);
+        }
+    }
+
+}
+
+
+int main(int argc, const char *argv[])
+{
+    Options opt;
+    parse_arguments(argc, argv, opt);
+
+    Frames frames(opt);
+    const std::vector<FrameInfo> &info = frames.frames();
+    const int nframes = info.size();
+    const int start = std::min(std::max(opt.start, 0), nframes);
+    const int end = (opt.end < 0) ? nframes : std::min(opt.end, nframes);
+
+    if (opt.xdmf) {
+        std::string filename(output_prefix(opt) + ".xmf");
+        std::FILE *f = std::fopen(filename.c_str(), "w");
+        if (f == NULL) {
+            std::cerr << "Error: cannot open file: " << filename << '\n';
+            std::exit(2);
+        }
+        std::fprintf(f, "<?xml version=\"1.0\"?>\n"
+                     "<Xdmf Version=\"2.0\">\n"
+                     "<Domain>\n"
+                     "  <Grid Name=\"%s\" GridType=\"Collection\" CollectionType=\"Temporal\">\n",
+                     output_prefix(opt).c_str());
+        for (int i=start; i<end; ++i) {
+            Frame fr;
+            MappedFile *mapped;
+            frames.locate(info[i], fr, mapped);
+            write_xdmf_grid(f, fr, opt);
+            delete mapped;
+        }
+        std::fprintf(f, "  </Grid>\n"
+                     "</Domain>\n"
+                     "</Xdmf>\n");
+        std::fclose(f);
+        return 0;
+    }
+
+    // frames are independent of each other
+    #pragma omp parallel for default(none)      \
+        shared(frames, info, opt, start, end)   \
+        schedule(dynamic)
+    for (int i=start; i<end; ++i) {
+        Frame fr;
+        MappedFile *mapped;
+        frames.locate(info[i], fr, mapped);
+
+        write_vtu(fr, opt);
+        if (opt.markers)
+            write_vtp(fr, opt);
+
+        delete mapped;
+    }
+
+    std::cout << "Converted " << end - start << " frames.\n";
+    return 0;
+}
@@ -4,6 +4,9 @@
 
 usage: 2vtk.py [-a -c -t -h] modelname [start [end]]
 
+The output can be either separate 'modelname.save.NNNNNN' files or a single
+'modelname.frames' container (sim.has_container_output = yes).
+
 options:
     -a          save data in ASCII format (default: binary)
     -c          save files in current directory
@@ -39,27 +42,66 @@ class Dynearthsol:
     def __init__(self, modelname):
         self.modelname = modelname
         self.read_info()
+        self.read_container_index()
         self.read_header(self.frames[0])
 
 
     def read_info(self):
-        tmp = np.fromfile(self.modelname + '.info', dtype=float, sep=' ')
-        tmp.shape = (-1, 8)
+        # lines starting with '#' are comments
+        tmp = np.loadtxt(self.modelname + '.info', dtype=float, ndmin=2)
         self.frames = list(tmp[:,0].astype(int))
         self.nnode_list = tmp[:,5].astype(int)
         self.nelem_list = tmp[:,6].astype(int)
         return
 
 
+    def read_container_index(self):
+        '''Locate the header of every group if the frames are in a container'''
+        self.container = None
+        fname = self.modelname + '.frames'
+        if not os.path.exists(fname):
+            return
+
+        headerlen = 4096
+        self.group_pos = {}
+        with open(fname, 'rb') as f:
+            superblock = f.read(headerlen).decode('ascii').splitlines()
+            if superblock[0] != '# DynEarthSol container revision=1':
+                print('Error:', fname, 'is not a valid DynEarthSol container file!')
+                sys.exit(1)
+
+            # walking backward from the last committed group
+            pos = int(superblock[1].split('=')[1])
+            while pos >= 0:
+                f.seek(pos)
+                first = f.readline().decode('ascii').split()
+                group = first[4].split('=')[1]
+                # if a group is written more than once, the latest one is used
+                self.group_pos.setdefault(group, pos)
+                pos = int(first[5].split('=')[1])
+
+        self.container = fname
+        return
+
+
     def get_fn(self, frame):
+        if self.container:
+            return self.container
         return '{0}.save.{1:0=6}'.format(self.modelname, frame)
 
 
+    def get_header_pos(self, frame):
+        if self.container:
+            return self.group_pos['save.{0:0=6}'.format(frame)]
+        return 0
+
+
     def read_header(self, frame):
         headerlen = 4096
         fname = self.get_fn(frame)
-        with open(fname) as f:
-            header = f.read(headerlen).splitlines()
+        with open(fname, 'rb') as f:
+            f.seek(self.get_header_pos(frame))
+            header = f.read(headerlen).decode('ascii').splitlines()
             #print(header)
 
         # parsing 1st line
@@ -186,9 +228,9 @@ def main(modelname, start, end):
             fvtu.write(b'  <PointData>\n')
 
             # averaged velocity is more stable and is preferred
-            try:
+            if 'velocity averaged' in des.field_pos:
                 convert_field(des, frame, 'velocity averaged', fvtu)
-            except KeyError:
+            else:
                 convert_field(des, frame, 'velocity', fvtu)
 
             convert_field(des, frame, 'force', fvtu)
@@ -215,42 +257,47 @@ def main(modelname, start, end):
             convert_field(des, frame, 'plastic strain', fvtu)
             convert_field(des, frame, 'plastic strain-rate', fvtu)
 
-            strain_rate = des.read_field(frame, 'strain-rate')
-            srII = second_invariant(strain_rate)
-            vtk_dataarray(fvtu, np.log10(srII+1e-45), 'strain-rate II log10')
-            if output_tensor_components:
-                for d in range(des.nstr):
-                    vtk_dataarray(fvtu, strain_rate[:,d], 'strain-rate ' + des.component_names[d])
-
-            strain = des.read_field(frame, 'strain')
-            sI = first_invariant(strain)
-            sII = second_invariant(strain)
-            vtk_dataarray(fvtu, sI, 'strain I')
-            vtk_dataarray(fvtu, sII, 'strain II')
-            if output_tensor_components:
-                for d in range(des.nstr):
-                    vtk_dataarray(fvtu, strain[:,d], 'strain ' + des.component_names[d])
-
-            # averaged stress is more stable and is preferred
-            try:
-                stress = des.read_field(frame, 'stress averaged')
-            except KeyError:
-                stress = des.read_field(frame, 'stress')
-            tI = first_invariant(stress)
-            tII = second_invariant(stress)
-            vtk_dataarray(fvtu, tI, 'stress I')
-            vtk_dataarray(fvtu, tII, 'stress II')
-            if output_tensor_components:
-                for d in range(des.ndims):
-                    vtk_dataarray(fvtu, stress[:,d] - tI, 'stress ' + des.component_names[d] + ' dev.')
-                for d in range(des.ndims, des.nstr):
-                    vtk_dataarray(fvtu, stress[:,d], 'stress ' + des.component_names[d])
+            # fields can be absent in a frame, see sim.output_field_intervals
+            if 'strain-rate' in des.field_pos:
+                strain_rate = des.read_field(frame, 'strain-rate')
+                srII = second_invariant(strain_rate)
+                vtk_dataarray(fvtu, np.log10(srII+1e-45), 'strain-rate II log10')
+                if output_tensor_components:
+                    for d in range(des.nstr):
+                        vtk_dataarray(fvtu, strain_rate[:,d], 'strain-rate ' + des.component_names[d])
+
+            if 'strain' in des.field_pos:
+                strain = des.read_field(frame, 'strain')
+                sI = first_invariant(strain)
+                sII = second_invariant(strain)
+                vtk_dataarray(fvtu, sI, 'strain I')
+                vtk_dataarray(fvtu, sII, 'strain II')
+                if output_tensor_components:
+                    for d in range(des.nstr):
+                        vtk_dataarray(fvtu, strain[:,d], 'strain ' + des.component_names[d])
+
+            if 'stress' in des.field_pos:
+                # averaged stress is more stable and is preferred
+                try:
+                    stress = des.read_field(frame, 'stress averaged')
+                except KeyError:
+                    stress = des.read_field(frame, 'stress')
+                tI = first_invariant(stress)
+                tII = second_invariant(stress)
+                vtk_dataarray(fvtu, tI, 'stress I')
+                vtk_dataarray(fvtu, tII, 'stress II')
+                if output_tensor_components:
+                    for d in range(des.ndims):
+                        vtk_dataarray(fvtu, stress[:,d] - tI, 'stress ' + des.component_names[d] + ' dev.')
+                    for d in range(des.ndims, des.nstr):
+                        vtk_dataarray(fvtu, stress[:,d], 'stress ' + des.component_names[d])
 
             convert_field(des, frame, 'density', fvtu)
             convert_field(des, frame, 'material', fvtu)
             convert_field(des, frame, 'viscosity', fvtu)
-            effvisc = tII / (srII + 1e-45)
-            vtk_dataarray(fvtu, effvisc, 'effective viscosity')
+            if 'strain-rate' in des.field_pos and 'stress' in des.field_pos:
+                effvisc = tII / (srII + 1e-45)
+                vtk_dataarray(fvtu, effvisc, 'effective viscosity')
 
             # element number for debugging
             vtk_dataarray(fvtu, np.arange(nelem, dtype=np.int32), 'elem number')
@@ -291,7 +338,7 @@ def main(modelname, start, end):
         #
         # Converting marker
         #
-        if output_markers:
+        if output_markers and 'markerset size' in des.field_pos:
             filename = '{0}.{1}.vtp'.format(output_prefix, suffix)
             fvtp = open(filename, 'wb')
 
@@ -340,6 +387,9 @@ def main(modelname, start, end):
 
 
 def convert_field(des, frame, name, fvtu):
+    if name not in des.field_pos:
+        # this field is not written in this frame
+        return
     field = des.read_field(frame, name)
     if name in ('coordinate', 'velocity', 'velocity averaged', 'force'):
         if des.ndims == 2:
@@ -0,0 +1,113 @@
+#ifndef DYNEARTHSOL3D_ALIGNED_ALLOC_HPP
+#define DYNEARTHSOL3D_ALIGNED_ALLOC_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+/* Cache-line aligned allocation with parallel first-touch initialization.
+ *
+ * The OS places a memory page on the NUMA node of the thread that first
+ * writes to it. The arrays are initialized by a static-scheduled parallel
+ * loop, which gives each thread the same contiguous block of rows as the
+ * element and node loops, see create_elem_groups() and loop_all_elem().
+ * Small arrays are initialized serially.
+ */
+
+namespace aligned {
+
+    const std::size_t alignment = 64;  // cache line, also enough for AVX-512
+
+    // arrays smaller than this (in bytes) are initialized serially
+    const std::size_t min_parallel_bytes = 1 << 16;
+
+
+    // uninitialized memory of n objects of T, freed by aligned::free()
+    template <typename T>
+    T* allocate(std::size_t n)
+    {
+        void *p = NULL;
+        if (posix_memalign(&p, alignment, (n ? n : 1) * sizeof(T)) != 0)
+            throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+
+    inline void free(void *p)
+    {
+        std::free(p);
+    }
+
+
+    template <typename T>
+    void fill(T *a, std::size_t n, const T& val)
+    {
+        long size = n;
+        #pragma omp parallel for default(none) shared(a, val, size) schedule(static) \
+            if (n * sizeof(T) >= min_parallel_bytes)
+        for (long i=0; i<size; ++i)
+            a[i] = val;
+    }
+
+
+    template <typename T>
+    void copy(T *dst, const T *src, std::size_t n)
+    {
+        long size = n;
+        #pragma omp parallel for default(none) shared(dst, src, size) schedule(static) \
+            if (n * sizeof(T) >= min_parallel_bytes)
+        for (long i=0; i<size; ++i)
+            dst[i] = src[i];
+    }
+
+
+    // STL allocator, for std::vector of plain-old-data
+    template <typename T>
+    class allocator
+    {
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        template <typename U>
+        struct rebind { typedef allocator<U> other; };
+
+        allocator() {}
+        template <typename U>
+        allocator(const allocator<U>&) {}
+
+        pointer allocate(size_type n, const void* = 0)
+        {
+            // first touch in parallel, the vector then initializes the
+            // elements serially, but the pages are already placed
+            pointer p = aligned::allocate<T>(n);
+            aligned::fill(p, n, T());
+            return p;
+        }
+
+        void deallocate(pointer p, size_type) { aligned::free(p); }
+
+        size_type max_size() const { return std::size_t(-1) / sizeof(T); }
+
+        void construct(pointer p, const T& val) { new (p) T(val); }
+        void destroy(pointer p) { p->~T(); }
+
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+    };
+
+    template <typename T, typename U>
+    bool operator==(const allocator<T>&, const allocator<U>&) { return true; }
+
+    template <typename T, typename U>
+    bool operator!=(const allocator<T>&, const allocator<U>&) { return false; }
+
+}
+
+#endif
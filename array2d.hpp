@@ -3,39 +3,88 @@
 
 #include <algorithm>
 #include <cstring>  // for memcpy
+#include <utility>  // for std::swap
 
+#include "aligned-alloc.hpp"
+
+
+/* The memory allocated by Array2D is cache-line aligned and initialized in
+ * parallel (first touch), see aligned-alloc.hpp. An array adopted from
+ * elsewhere, i.e. by Array2D(T*, int) or reset(), must be allocated by
+ * new [], and is freed by delete [].
+ *
+ * Like std::vector, the capacity (in rows) can exceed the size. resize()
+ * reuses the buffer when the new size fits in it, so that the fields can be
+ * resized in place after remeshing without a free/alloc cycle. */
 
 template <typename T, int N>
 class Array2D {
 
     T* a_;
     int n_;
+    int cap_;
+    bool aligned_;  // a_ is from aligned::allocate(), not new []
+
+    void free_() {
+        if (aligned_) aligned::free(a_);
+        else delete [] a_;
+    }
+
+    // a new buffer of cap rows, keeping the first n_ rows
+    void reallocate_(int cap) {
+        T* a = aligned::allocate<T>(N*cap);
+        const int n = std::min(n_, cap);
+        aligned::copy(a, a_, N*n);
+        aligned::fill(a + N*n, N*(cap - n), T());
+        free_();
+        a_ = a;
+        n_ = n;
+        cap_ = cap;
+        aligned_ = true;
+    }
 
 public:
     //
     // constructors & destructor
     //
-    Array2D() {a_ = NULL; n_ = 0;}
-    Array2D(T* a, int n) {a_ = a; n_ = n;}
+    Array2D() {a_ = NULL; n_ = cap_ = 0; aligned_ = false;}
+    Array2D(T* a, int n) {a_ = a; n_ = cap_ = n; aligned_ = false;}
     Array2D(const Array2D& src) {
-        n_ = src.size();
-        a_ = new T[src.num_elements()];
-        std::memcpy(a_, src.data(), sizeof(T)*src.num_elements());
+        n_ = cap_ = src.size();
+        a_ = aligned::allocate<T>(src.num_elements());
+        aligned_ = true;
+        aligned::copy(a_, src.data(), src.num_elements());
     }
 
     Array2D(int size, const T& val) {
-        a_ = new T[N*size];
-        n_ = size;
-        std::fill_n(a_, N*n_, val);
+        a_ = aligned::allocate<T>(N*size);
+        n_ = cap_ = size;
+        aligned_ = true;
+        aligned::fill(a_, N*n_, val);
     }
 
     explicit
     Array2D(int size) {
-        a_ = new T[N*size];
-        n_ = size;
+        a_ = aligned::allocate<T>(N*size);
+        n_ = cap_ = size;
+        aligned_ = true;
+        aligned::fill(a_, N*n_, T());
+    }
+
+    Array2D(Array2D&& src) {
+        a_ = src.a_;
+        n_ = src.n_;
+        cap_ = src.cap_;
+        aligned_ = src.aligned_;
+        src.nullify();
     }
 
-    ~Array2D() {delete [] a_;}
+    ~Array2D() {free_();}
+
+    Array2D& operator=(Array2D&& rhs) {
+        if (this != &rhs) steal_ref(rhs);
+        return *this;
+    }
 
     //
     // methods
@@ -44,25 +93,55 @@ public:
     const T* data() const {return a_;}
     std::size_t size() const {return n_;}
     int num_elements() const {return N*n_;}
+    std::size_t capacity() const {return cap_;}
+
+    // Change the number of rows, keeping the content of the remaining rows.
+    // New rows are value-initialized. The buffer is reused if it is large
+    // enough and not more than twice the new size, otherwise it is
+    // reallocated, with some extra room when growing.
+    void resize(int n) {
+        if (n > cap_)
+            reallocate_(n + n / 16);
+        else if (n < cap_ / 2)
+            reallocate_(n);
+        else if (n > n_)
+            aligned::fill(a_ + N*n_, N*(n - n_), T());
+        n_ = n;
+    }
+
+    void reserve(int cap) {
+        if (cap > cap_) reallocate_(cap);
+    }
+
+    void swap(Array2D& other) {
+        std::swap(a_, other.a_);
+        std::swap(n_, other.n_);
+        std::swap(cap_, other.cap_);
+        std::swap(aligned_, other.aligned_);
+    }
 
     // steal the pointer from other, leave a NULL to other
     void steal_ref(Array2D& other) {
-        delete [] a_;
+        free_();
         a_ = other.a_;
         n_ = other.n_;
-        other.a_ = NULL;
-        other.n_ = 0;
+        cap_ = other.cap_;
+        aligned_ = other.aligned_;
+        other.nullify();
     }
 
+    // a must be allocated by new []
     void reset(T* a, int n) {
-        delete [] a_;
+        free_();
         a_ = a;
-        n_ = n;
+        n_ = cap_ = n;
+        aligned_ = false;
     }
 
     void nullify() {
         a_ = NULL;
-        n_ = 0;
+        n_ = cap_ = 0;
+        aligned_ = false;
     }
 
     //
@@ -84,7 +163,7 @@ public:
     typedef T element;
 
 private:
-    // disable assignment operator
+    // disable copy assignment, use move assignment or swap() instead
     Array2D<T,N>& operator=(const Array2D<T,N>& rhs);
 };
 
@@ -2,7 +2,9 @@
 
 #include "constants.hpp"
 #include "parameters.hpp"
+#include "decomposition.hpp"
 #include "matprops.hpp"
+#include "team.hpp"
 
 #include "bc.hpp"
 
@@ -86,11 +88,20 @@ void apply_vbcs(const Param &param, const Variables &var, array_t &vel)
     // 4: normal component free, shear component (not z) fixed, only in 3D
     // 5: normal component fixed at 0, shear component (not z) fixed, only in 3D
 
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(param, var, vel)
+        {
+            TeamScope team;
+            apply_vbcs(param, var, vel);
+        }
+        return;
+    }
+
     const BC &bc = param.bc;
 
     // diverging x-boundary
-    #pragma omp parallel for default(none) \
-        shared(bc, var, vel)
+    #pragma omp for nowait
     for (int i=0; i<var.nnode; ++i) {
 
         // fast path: skip nodes not on boundary
@@ -389,6 +400,10 @@ namespace {
     {
         /* Diffusing surface topography to simulate the effect of erosion and
          * sedimentation.
+         *
+         * Called by all threads of the team: the top surface is done by a
+         * single thread, but the contributions of the other processes to the
+         * shared nodes are summed by the whole team.
          */
 
         const int top_bdry = bdry_order.find(BOUNDZ1)->second;
@@ -396,117 +411,129 @@ namespace {
 
         const int_vec& top_nodes = var.bnodes[top_bdry];
         const std::size_t ntop = top_nodes.size();
-        double_vec total_dx(var.nnode, 0);
-        double_vec total_slope(var.nnode, 0);
 
-        // loops over all top facets
-        for (std::size_t i=0; i<top.size(); ++i) {
-            // this facet belongs to element e
-            int e = top[i].first;
-            // this facet is the f-th facet of e
-            int f = top[i].second;
+        // shared by the threads of the team
+        static double_vec total_dx, total_slope;
 
-            const int *conn = (*var.connectivity)[e];
-            int n0 = (*var.connectivity)[e][NODE_OF_FACET[f][0]];
-            int n1 = (*var.connectivity)[e][NODE_OF_FACET[f][1]];
+        #pragma omp single
+        {
+            total_dx.assign(var.nnode, 0);
+            total_slope.assign(var.nnode, 0);
 
-#ifdef THREED
-            int n2 = (*var.connectivity)[e][NODE_OF_FACET[f][2]];
+            // loops over all top facets
+            for (std::size_t i=0; i<top.size(); ++i) {
+                // this facet belongs to element e
+                int e = top[i].first;
+                // this facet is the f-th facet of e
+                int f = top[i].second;
 
-            double projected_area;
-            {
-                // normal vector of this facet
-                double normal[NDIMS];
-
-                // two vectors n0-n1 and n0-n2
-                // n is the cross product of these two vectors
-                // the length of n is 2 * triangle area
-                double x01, y01, z01, x02, y02, z02;
-                x01 = coord[n1][0] - coord[n0][0];
-                y01 = coord[n1][1] - coord[n0][1];
-                z01 = coord[n1][2] - coord[n0][2];
-                x02 = coord[n2][0] - coord[n0][0];
-                y02 = coord[n2][1] - coord[n0][1];
-                z02 = coord[n2][2] - coord[n0][2];
-
-                normal[0] = y01*z02 - z01*y02;
-                normal[1] = z01*x02 - x01*z02;
-                normal[2] = x01*y02 - y01*x02;
-
-                /* the area of this facet is:
-                 *   0.5 * std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2])
-                 *
-                 * theta is the angle between this facet and horizontal
-                 *   tan_theta = std::sqrt(normal[0]*normal[0] + normal[1]*normal[1]) / normal[2]
-                 *   cos_theta = normal[2] / (2 * area)
-                 *
-                 * the area projected on the horizontal plane is:
-                 *   projected_area = area * cos_theta = 0.5 * normal[2]
-                 */
-                projected_area = 0.5 * normal[2];
-            }
+                const int *conn = (*var.connectivity)[e];
+                int n0 = (*var.connectivity)[e][NODE_OF_FACET[f][0]];
+                int n1 = (*var.connectivity)[e][NODE_OF_FACET[f][1]];
 
-            total_dx[n0] += projected_area;
-            total_dx[n1] += projected_area;
-            total_dx[n2] += projected_area;
-
-            double shp2dx[NODES_PER_FACET], shp2dy[NODES_PER_FACET];
-            double iv = 1 / (2 * projected_area);
-            shp2dx[0] = iv * (coord[n1][1] - coord[n2][1]);
-            shp2dx[1] = iv * (coord[n2][1] - coord[n0][1]);
-            shp2dx[2] = iv * (coord[n0][1] - coord[n1][1]);
-            shp2dy[0] = iv * (coord[n2][0] - coord[n1][0]);
-            shp2dy[1] = iv * (coord[n0][0] - coord[n2][0]);
-            shp2dy[2] = iv * (coord[n1][0] - coord[n0][0]);
-
-            double D[NODES_PER_FACET][NODES_PER_FACET];
-            for (int j=0; j<NODES_PER_FACET; j++) {
-                for (int k=0; k<NODES_PER_FACET; k++) {
-                    D[j][k] = (shp2dx[j] * shp2dx[k] +
-                               shp2dy[j] * shp2dy[k]);
+#ifdef THREED
+                int n2 = (*var.connectivity)[e][NODE_OF_FACET[f][2]];
+
+                double projected_area;
+                {
+                    // normal vector of this facet
+                    double normal[NDIMS];
+
+                    // two vectors n0-n1 and n0-n2
+                    // n is the cross product of these two vectors
+                    // the length of n is 2 * triangle area
+                    double x01, y01, z01, x02, y02, z02;
+                    x01 = coord[n1][0] - coord[n0][0];
+                    y01 = coord[n1][1] - coord[n0][1];
+                    z01 = coord[n1][2] - coord[n0][2];
+                    x02 = coord[n2][0] - coord[n0][0];
+                    y02 = coord[n2][1] - coord[n0][1];
+                    z02 = coord[n2][2] - coord[n0][2];
+
+                    normal[0] = y01*z02 - z01*y02;
+                    normal[1] = z01*x02 - x01*z02;
+                    normal[2] = x01*y02 - y01*x02;
+
+                    /* the area of this facet is:
+                     *   0.5 * std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2])
+                     *
+                     * theta is the angle between this facet and horizontal
+                     *   tan_theta = std::sqrt(normal[0]*normal[0] + normal[1]*normal[1]) / normal[2]
+                     *   cos_theta = normal[2] / (2 * area)
+                     *
+                     * the area projected on the horizontal plane is:
+                     *   projected_area = area * cos_theta = 0.5 * normal[2]
+                     */
+                    projected_area = 0.5 * normal[2];
                 }
-            }
 
-            const int n[NODES_PER_FACET] = {n0, n1, n2};
-            for (int j=0; j<NODES_PER_FACET; j++) {
-                double slope = 0;
-                for (int k=0; k<NODES_PER_FACET; k++)
-                    slope += D[j][k] * coord[n[k]][2];
+                total_dx[n0] += projected_area;
+                total_dx[n1] += projected_area;
+                total_dx[n2] += projected_area;
+
+                double shp2dx[NODES_PER_FACET], shp2dy[NODES_PER_FACET];
+                double iv = 1 / (2 * projected_area);
+                shp2dx[0] = iv * (coord[n1][1] - coord[n2][1]);
+                shp2dx[1] = iv * (coord[n2][1] - coord[n0][1]);
+                shp2dx[2] = iv * (coord[n0][1] - coord[n1][1]);
+                shp2dy[0] = iv * (coord[n2][0] - coord[n1][0]);
+                shp2dy[1] = iv * (coord[n0][0] - coord[n2][0]);
+                shp2dy[2] = iv * (coord[n1][0] - coord[n0][0]);
+
+                double D[NODES_PER_FACET][NODES_PER_FACET];
+                for (int j=0; j<NODES_PER_FACET; j++) {
+                    for (int k=0; k<NODES_PER_FACET; k++) {
+                        D[j][k] = (shp2dx[j] * shp2dx[k] +
+                                   shp2dy[j] * shp2dy[k]);
+                    }
+                }
 
-                total_slope[n[j]] += slope * projected_area;
-            }
+                const int n[NODES_PER_FACET] = {n0, n1, n2};
+                for (int j=0; j<NODES_PER_FACET; j++) {
+                    double slope = 0;
+                    for (int k=0; k<NODES_PER_FACET; k++)
+                        slope += D[j][k] * coord[n[k]][2];
+
+                    total_slope[n[j]] += slope * projected_area;
+                }
 
-            // std::cout << i << ' ' << n0 << ' ' << n1 << ' ' << n2 << "  "
-            //           << projected_area << "  " << slope << '\n';
+                // std::cout << i << ' ' << n0 << ' ' << n1 << ' ' << n2 << "  "
+                //           << projected_area << "  " << slope << '\n';
 #else
-            /* The 1D diffusion operation is implemented ad hoc, not using FEM
-             * formulation (e.g. computing shape function derivation on the edges).
-             */
+                /* The 1D diffusion operation is implemented ad hoc, not using FEM
+                 * formulation (e.g. computing shape function derivation on the edges).
+                 */
 
-            double dx = std::fabs(coord[n1][0] - coord[n0][0]);
-            total_dx[n0] += dx;
-            total_dx[n1] += dx;
+                double dx = std::fabs(coord[n1][0] - coord[n0][0]);
+                total_dx[n0] += dx;
+                total_dx[n1] += dx;
 
-            double slope = (coord[n1][1] - coord[n0][1]) / dx;
-            total_slope[n0] -= slope;
-            total_slope[n1] += slope;
+                double slope = (coord[n1][1] - coord[n0][1]) / dx;
+                total_slope[n0] -= slope;
+                total_slope[n1] += slope;
 
-            // std::cout << i << ' ' << n0 << ' ' << n1 << "  " << dx << "  " << slope << '\n';
+                // std::cout << i << ' ' << n0 << ' ' << n1 << "  " << dx << "  " << slope << '\n';
 #endif
+            }
         }
 
-        double max_dh = 0;
-        for (std::size_t i=0; i<ntop; ++i) {
-            // we don't treat edge nodes specially, i.e. reflecting bc is used for erosion.
-            int n = top_nodes[i];
-            double dh = surface_diffusivity * var.dt * total_slope[n] / total_dx[n];
-            coord[n][NDIMS-1] -= dh;
-            max_dh = std::max(max_dh, std::fabs(dh));
-            // std::cout << n << "  dh:  " << dh << '\n';
-        }
+        sum_shared_nodes(var, total_dx, total_slope);
+
+        #pragma omp single
+        {
+            double max_dh = 0;
+            for (std::size_t i=0; i<ntop; ++i) {
+                // we don't treat edge nodes specially, i.e. reflecting bc is used for erosion.
+                int n = top_nodes[i];
+                double dh = surface_diffusivity * var.dt * total_slope[n] / total_dx[n];
+                coord[n][NDIMS-1] -= dh;
+                max_dh = std::max(max_dh, std::fabs(dh));
+                // std::cout << n << "  dh:  " << dh << '\n';
+            }
 
-        // std::cout << "max erosion / sedimentation rate (cm/yr):  "
-        //           << max_dh / var.dt * 100 * YEAR2SEC << '\n';
+            // std::cout << "max erosion / sedimentation rate (cm/yr):  "
+            //           << max_dh / var.dt * 100 * YEAR2SEC << '\n';
+        }
     }
 
 
@@ -540,6 +567,16 @@ namespace {
 
 void surface_processes(const Param& param, const Variables& var, array_t& coord)
 {
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(param, var, coord)
+        {
+            TeamScope team;
+            surface_processes(param, var, coord);
+        }
+        return;
+    }
+
     switch (param.control.surface_process_option) {
     case 0:
         // no surface process
@@ -548,11 +585,15 @@ void surface_processes(const Param& param, const Variables& var, array_t& coord)
         simple_diffusion(var, coord, param.control.surface_diffusivity);
         break;
     case 101:
+        #pragma omp single
         custom_surface_processes(var, coord);
         break;
     default:
-        std::cout << "Error: unknown surface process option: " << param.control.surface_process_option << '\n';
-        std::exit(1);
+        #pragma omp single
+        {
+            std::cout << "Error: unknown surface process option: " << param.control.surface_process_option << '\n';
+            std::exit(1);
+        }
     }
 }
 
@@ -0,0 +1,467 @@
+/* Micro-benchmark of the computational kernels of DynEarthSol3D.
+ *
+ * The kernels are timed in isolation on a synthetic box mesh of roughly
+ * uniform resolution, for several mesh sizes and thread counts. The results
+ * are written to a CSV file, one line per (kernel, mesh, threads) with:
+ *
+ *   kernel,variant,ndims,nelem,nnode,nmarker,nthreads,repeats,
+ *   seconds,elem_per_sec,gbytes_per_sec
+ *
+ * "seconds" is the average wall time of one call. The bandwidth is computed
+ * from an estimate of the compulsory memory traffic of the kernel (each
+ * array touched once), so it is a lower bound of the actual traffic.
+ *
+ * The model parameters (domain size, material properties, BC, IC) are
+ * taken from the config file. mesh.meshing_option and mesh.resolution are
+ * overridden.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include "constants.hpp"
+#include "parameters.hpp"
+#include "bc.hpp"
+#include "brc-interpolation.hpp"
+#include "fields.hpp"
+#include "geometry.hpp"
+#include "ic.hpp"
+#include "input.hpp"
+#include "markerset.hpp"
+#include "matprops.hpp"
+#include "memory.hpp"
+#include "mesh.hpp"
+#include "nn-interpolation.hpp"
+#include "rheology.hpp"
+#include "timers.hpp"
+
+
+namespace {
+
+    const char usage[] =
+        "Usage: bench2d|bench3d [options] config_file\n"
+        "\n"
+        "Options:\n"
+        "  -r res1,res2,...   mesh resolutions (in meters), default: mesh.resolution\n"
+        "  -t n1,n2,...       thread counts, default: 1,2,4,... up to the max. threads\n"
+        "  -n repeats         number of timed calls of each kernel, default: 10\n"
+        "  -k name1,name2,... run these kernels only, default: all\n"
+        "  -o filename        output CSV file, default: bench.csv\n"
+        "\n"
+        "Kernels: volume, shape_fn, mass, temperature, strain_rate, stress,\n"
+        "         force, dt, quality, nn_interp, brc_interp, markers\n";
+
+    struct Options {
+        std::vector<double> resolutions;
+        std::vector<int> nthreads;
+        int repeats;
+        std::vector<std::string> kernels;
+        std::string outfile;
+        std::string config;
+    };
+
+
+    enum Kernel {
+        k_volume, k_shape_fn, k_mass, k_temperature, k_strain_rate, k_stress,
+        k_force, k_dt, k_quality, k_nn_interp, k_brc_interp, k_markers,
+        nkernels
+    };
+
+    const char *kernel_names[nkernels] = {
+        "volume", "shape_fn", "mass", "temperature", "strain_rate", "stress",
+        "force", "dt", "quality", "nn_interp", "brc_interp", "markers"
+    };
+
+
+    struct Rheology {
+        const char *name;
+        int type;
+    };
+
+    const Rheology rheologies[] = {
+        {"elastic", MatProps::rh_elastic},
+        {"viscous", MatProps::rh_viscous},
+        {"maxwell", MatProps::rh_maxwell},
+        {"elasto-plastic", MatProps::rh_ep},
+        {"elasto-visco-plastic", MatProps::rh_evp},
+#ifndef THREED
+        {"elasto-plastic2d", MatProps::rh_ep2d},
+        {"elasto-visco-plastic2d", MatProps::rh_evp2d},
+#endif
+    };
+    const int nrheologies = sizeof(rheologies) / sizeof(rheologies[0]);
+
+
+    template <class T>
+    void split_list(const std::string &str, std::vector<T> &list)
+    {
+        std::istringstream ss(str);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            std::istringstream is(item);
+            T x;
+            if (! (is >> x)) {
+                std::cerr << "Error: cannot parse '" << str << "'\n" << usage;
+                std::exit(1);
+            }
+            list.push_back(x);
+        }
+    }
+
+
+    void parse_arguments(int argc, const char *argv[], Options &opt)
+    {
+        opt.repeats = 10;
+        opt.outfile = "bench.csv";
+
+        for (int i=1; i<argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "-h" || arg == "--help") {
+                std::cout << usage;
+                std::exit(0);
+            }
+            else if (arg[0] == '-' && i+1 == argc) {
+                std::cerr << "Error: missing value of option: " << arg << '\n' << usage;
+                std::exit(1);
+            }
+            else if (arg == "-r") split_list(argv[++i], opt.resolutions);
+            else if (arg == "-t") split_list(argv[++i], opt.nthreads);
+            else if (arg == "-n") opt.repeats = std::atoi(argv[++i]);
+            else if (arg == "-k") split_list(argv[++i], opt.kernels);
+            else if (arg == "-o") opt.outfile = argv[++i];
+            else if (arg[0] == '-') {
+                std::cerr << "Error: unknown option: " << arg << '\n' << usage;
+                std::exit(1);
+            }
+            else if (opt.config.empty()) opt.config = arg;
+            else {
+                std::cerr << usage;
+                std::exit(1);
+            }
+        }
+
+        if (opt.config.empty()) {
+            std::cerr << usage;
+            std::exit(1);
+        }
+
+        if (opt.repeats < 1) {
+            std::cerr << "Error: the number of repeats must be positive.\n";
+            std::exit(1);
+        }
+
+        for (std::size_t i=0; i<opt.kernels.size(); ++i) {
+            int k;
+            for (k=0; k<nkernels; ++k)
+                if (opt.kernels[i] == kernel_names[k]) break;
+            if (k == nkernels) {
+                std::cerr << "Error: unknown kernel: " << opt.kernels[i] << '\n' << usage;
+                std::exit(1);
+            }
+        }
+
+        if (opt.nthreads.empty()) {
+            int nmax = 1;
+#ifdef USE_OMP
+            nmax = omp_get_max_threads();
+#endif
+            for (int n=1; n<nmax; n*=2)
+                opt.nthreads.push_back(n);
+            opt.nthreads.push_back(nmax);
+        }
+    }
+
+
+    bool is_selected(const Options &opt, int kernel)
+    {
+        if (opt.kernels.empty()) return true;
+        for (std::size_t i=0; i<opt.kernels.size(); ++i)
+            if (opt.kernels[i] == kernel_names[kernel]) return true;
+        return false;
+    }
+
+
+    double bytes_moved(int kernel, const Variables &var)
+    {
+        /* Compulsory memory traffic of one call of the kernel. Nodal data
+         * gathered by an element are counted once per element, as the
+         * elements are not ordered for cache reuse in general.
+         */
+        const double i4 = sizeof(int);
+        const double f8 = sizeof(double);
+        const double lp = sizeof(lowp_t);
+        const double nelem = var.nelem;
+        const double nnode = var.nnode;
+        const double nmarker = var.markerset->get_nmarkers();
+
+        // connectivity and nodal coordinates of an element
+        const double elem_geom = NODES_PER_ELEM * (i4 + NDIMS * f8);
+        // shape function derivatives of an element, or the data to
+        // compute them on the fly
+        const double elem_shp = ShapeDeriv::elem_bytes;
+
+        switch (kernel) {
+        case k_volume:
+            return nelem * (elem_geom + f8);
+        case k_shape_fn:
+            return nelem * (elem_geom + f8 + elem_shp);
+        case k_mass:
+            // read-modify-write of volume_n, mass and tmass of each node
+            return nelem * (NODES_PER_ELEM * i4 + f8 + 2 * 3 * NODES_PER_ELEM * f8);
+        case k_temperature:
+            return nelem * (NODES_PER_ELEM * (i4 + 2 * f8) + elem_shp + f8)
+                + nnode * 3 * f8;
+        case k_strain_rate:
+            return nelem * (NODES_PER_ELEM * (i4 + NDIMS * f8) + elem_shp + NSTR * f8);
+        case k_stress:
+            // strain_rate, stress, strain, plstrain, delta_plstrain, edvoldt
+            // and nodal temperature
+            return nelem * ((5 * NSTR + 2) * f8 + 2 * lp + NODES_PER_ELEM * (i4 + f8));
+        case k_force:
+            return nelem * (elem_geom + elem_shp + (NSTR + 1) * f8
+                            + 2 * NODES_PER_ELEM * NDIMS * f8);
+        case k_dt:
+            return nelem * (elem_geom + f8);
+        case k_quality:
+            return nelem * (elem_geom + f8 + lp);
+        case k_nn_interp:
+            // centroids of the old and new meshes, elemental fields copied
+            return nelem * (2 * elem_geom + 2 * ((2 * NSTR + 1) * f8 + lp));
+        case k_brc_interp:
+            // locating the new nodes in the old mesh, then interpolating
+            // temperature and velocity
+            return nelem * elem_geom
+                + nnode * (NDIMS * f8 + i4 + NODES_PER_ELEM * (i4 + (NDIMS + 1) * f8)
+                           + (NDIMS + 1) * f8);
+        case k_markers:
+            // eta, elem and mattype, read and written, and the nodal
+            // coordinates of the containing element
+            return nmarker * (2 * (NODES_PER_ELEM * lp + 2 * i4) + elem_geom)
+                + nelem * elem_geom;
+        }
+        return 0;
+    }
+
+
+    void run_kernel(int kernel, const Param &param, Variables &var,
+                    const array_t &old_coord, const conn_t &old_connectivity)
+    {
+        switch (kernel) {
+        case k_volume:
+            compute_volume(*var.coord, *var.connectivity, *var.volume);
+            break;
+        case k_shape_fn:
+            compute_shape_fn(*var.coord, *var.connectivity, *var.volume, var.egroups,
+                             *var.shpd);
+            break;
+        case k_mass:
+            compute_mass(param, var.egroups, *var.connectivity, *var.volume, *var.mat,
+                         var.max_vbc_val, *var.volume_n, *var.mass, *var.tmass);
+            break;
+        case k_temperature:
+            update_temperature(param, var, *var.temperature, *var.ntmp);
+            break;
+        case k_strain_rate:
+            update_strain_rate(var, *var.strain_rate);
+            break;
+        case k_stress:
+            update_stress(var, *var.stress, *var.strain, *var.plstrain,
+                          *var.delta_plstrain, *var.strain_rate);
+            break;
+        case k_force:
+            update_force(param, var, *var.force);
+            break;
+        case k_dt:
+            compute_dt(param, var);
+            break;
+        case k_quality:
+            {
+                int worst_elem;
+                worst_elem_quality(*var.coord, *var.connectivity, *var.volume,
+                                   *var.elquality, worst_elem);
+            }
+            break;
+        case k_nn_interp:
+            nearest_neighbor_interpolation(var, old_coord, old_connectivity);
+            break;
+        case k_brc_interp:
+            barycentric_node_interpolation(var, old_coord, old_connectivity);
+            break;
+        case k_markers:
+            {
+                int ndeleted, nadded;
+                remap_markers(param, var, old_coord, old_connectivity, ndeleted, nadded);
+            }
+            break;
+        }
+    }
+
+
+    void set_nthreads(int n, const Param &param, Variables &var)
+    {
+        // the element groups are made for the number of threads
+#ifdef USE_OMP
+        omp_set_num_threads(n);
+#endif
+        create_elem_groups(param, var);
+    }
+
+
+    void time_kernel(int kernel, const char *variant,
+                     const Options &opt, const Param &param, Variables &var,
+                     const array_t &old_coord, const conn_t &old_connectivity,
+                     std::FILE *f)
+    {
+        int max_threads = 1;
+#ifdef USE_OMP
+        max_threads = omp_get_max_threads();
+#endif
+        for (std::size_t i=0; i<opt.nthreads.size(); ++i) {
+            const int nthreads = opt.nthreads[i];
+            set_nthreads(nthreads, param, var);
+
+            // warm up the cache and the thread pool
+            run_kernel(kernel, param, var, old_coord, old_connectivity);
+
+            const double t0 = PhaseTimers::wtime();
+            for (int r=0; r<opt.repeats; ++r)
+                run_kernel(kernel, param, var, old_coord, old_connectivity);
+            const double seconds = (PhaseTimers::wtime() - t0) / opt.repeats;
+
+            std::fprintf(f, "%s,%s,%d,%d,%d,%d,%d,%d,%.6e,%.6e,%.6e\n",
+                         kernel_names[kernel], variant, NDIMS,
+                         var.nelem, var.nnode, var.markerset->get_nmarkers(),
+                         nthreads, opt.repeats, seconds,
+                         var.nelem / seconds, bytes_moved(kernel, var) / seconds * 1e-9);
+            std::fflush(f);
+
+            std::cout << "  " << kernel_names[kernel];
+            if (variant[0]) std::cout << " (" << variant << ")";
+            std::cout << ", " << nthreads << " threads: " << seconds << " sec/call\n";
+        }
+        set_nthreads(max_threads, param, var);
+    }
+
+
+    void init(const Param& param, Variables& var)
+    {
+        // same as init() in dynearthsol.cxx
+        create_new_mesh(param, var);
+        create_boundary_flags(var);
+        create_boundary_nodes(var);
+        create_boundary_facets(var);
+        create_support(var);
+        create_elem_groups(param, var);
+        create_elemmarkers(param, var);
+        create_markers(param, var);
+
+        allocate_variables(param, var);
+
+        compute_volume(*var.coord, *var.connectivity, *var.volume);
+        *var.volume_old = *var.volume;
+        compute_mass(param, var.egroups, *var.connectivity, *var.volume, *var.mat,
+                     var.max_vbc_val, *var.volume_n, *var.mass, *var.tmass);
+        compute_shape_fn(*var.coord, *var.connectivity, *var.volume, var.egroups,
+                         *var.shpd);
+
+        apply_vbcs(param, var, *var.vel);
+        initial_temperature(param, var, *var.temperature);
+        initial_stress_state(param, var, *var.stress, *var.strain, var.compensation_pressure);
+        initial_weak_zone(param, var, *var.plstrain);
+
+        var.dt = compute_dt(param, var);
+        update_strain_rate(var, *var.strain_rate);
+    }
+
+
+    void bench_mesh(const Options &opt, const Param &param, std::FILE *f)
+    {
+        // The mesh is not freed afterward, like in dynearthsol.cxx
+        Variables &var = *new Variables();
+        var.time = 0;
+        var.steps = 0;
+        var.timers = new PhaseTimers();
+        var.memory = new MemoryUsage();
+        if (param.control.characteristic_speed == 0)
+            var.max_vbc_val = find_max_vbc(param.bc);
+        else
+            var.max_vbc_val = param.control.characteristic_speed;
+
+        init(param, var);
+        std::cout << "Mesh of resolution " << param.mesh.resolution << ": "
+                  << var.nelem << " elements, " << var.nnode << " nodes, "
+                  << var.markerset->get_nmarkers() << " markers\n";
+
+        // the interpolation kernels map the fields from an identical mesh
+        const array_t old_coord(*var.coord);
+        const conn_t old_connectivity(*var.connectivity);
+
+        for (int k=0; k<nkernels; ++k) {
+            if (! is_selected(opt, k)) continue;
+
+            if (k == k_stress) {
+                // the stress state is restored for each rheology
+                const tensor_t stress(*var.stress), strain(*var.strain);
+                const double_vec plstrain(*var.plstrain);
+                for (int i=0; i<nrheologies; ++i) {
+                    Param p(param);
+                    p.mat.rheol_type = rheologies[i].type;
+                    delete var.mat;
+                    var.mat = new MatProps(p, var);
+                    time_kernel(k, rheologies[i].name, opt, p, var,
+                                old_coord, old_connectivity, f);
+
+                    std::copy(stress.begin(), stress.end(), var.stress->begin());
+                    std::copy(strain.begin(), strain.end(), var.strain->begin());
+                    *var.plstrain = plstrain;
+                }
+            }
+            else
+                time_kernel(k, "", opt, param, var, old_coord, old_connectivity, f);
+
+            // MatProps keeps references to the field variables, which are
+            // reallocated by the interpolation
+            delete var.mat;
+            var.mat = new MatProps(param, var);
+        }
+    }
+
+}
+
+
+int main(int argc, const char *argv[])
+{
+    Options opt;
+    parse_arguments(argc, argv, opt);
+
+    Param param;
+    get_input_parameters(opt.config.c_str(), param);
+    param.mesh.meshing_option = 1;
+    if (opt.resolutions.empty())
+        opt.resolutions.push_back(param.mesh.resolution);
+
+    std::FILE *f = std::fopen(opt.outfile.c_str(), "w");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << opt.outfile << '\n';
+        std::exit(2);
+    }
+    std::fprintf(f, "kernel,variant,ndims,nelem,nnode,nmarker,nthreads,repeats,"
+                 "seconds,elem_per_sec,gbytes_per_sec\n");
+
+    for (std::size_t i=0; i<opt.resolutions.size(); ++i) {
+        param.mesh.resolution = opt.resolutions[i];
+        bench_mesh(opt, param, f);
+    }
+
+    std::fclose(f);
+    std::cout << "Results are written to " << opt.outfile << '\n';
+    return 0;
+}
@@ -0,0 +1,93 @@
+#!/usr/bin/env python
+# encoding: utf-8
+'''Compare the output fields of two runs of the same model.
+
+usage: compare-fields.py [options] modelname1 modelname2
+
+For each field in the output of both runs, the max. absolute difference,
+relative to the max. magnitude of the field in the first run, is printed.
+This is used to validate a build against a reference build, e.g. the
+single precision storage ("make lowprec=1") against full double. The mesh
+must be the same, i.e. no remeshing that differs between the runs.
+
+options:
+    -f frame    the frame to compare (default: the last frame of both runs)
+    --tol=x     the exit status is 1 if any relative difference is larger
+                than x (default: 1e-3)
+    -h,--help   show this help
+'''
+
+from __future__ import print_function, unicode_literals
+import sys, os
+import numpy as np
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+des2vtk = __import__('2vtk')
+
+
+def main(argv):
+    frame = None
+    tol = 1e-3
+    models = []
+
+    i = 1
+    while i < len(argv):
+        arg = argv[i]
+        if arg in ('-h', '--help'):
+            print(__doc__)
+            sys.exit(0)
+        elif arg.startswith('--tol='):
+            tol = float(arg[6:])
+        elif arg == '-f':
+            if i + 1 == len(argv):
+                print('Error: missing value of option', arg)
+                sys.exit(1)
+            frame = int(argv[i+1])
+            i += 1
+        elif arg.startswith('-'):
+            print('Error: unknown option', arg)
+            print(__doc__)
+            sys.exit(1)
+        else:
+            models.append(arg)
+        i += 1
+
+    if len(models) != 2:
+        print(__doc__)
+        sys.exit(1)
+
+    des = [des2vtk.Dynearthsol(m) for m in models]
+    if frame is None:
+        frame = min(d.frames[-1] for d in des)
+    for d in des:
+        if frame not in d.frames:
+            print('Error: frame %d not found in %s' % (frame, d.modelname))
+            sys.exit(1)
+        d.read_header(frame)
+
+    names = sorted(set(des[0].field_pos) & set(des[1].field_pos))
+    worst = 0.0
+    print('Frame %d\n%-24s %14s %14s' % (frame, 'field', 'max |a|', 'rel. diff'))
+    for name in names:
+        if name == 'connectivity': continue
+        try:
+            a = des[0].read_field(frame, name)
+            b = des[1].read_field(frame, name)
+        except NameError:
+            continue  # not a field, e.g. the markers
+        if a.shape != b.shape:
+            print('Error: the meshes differ in field', name)
+            sys.exit(1)
+        scale = np.abs(a).max() if a.size else 0.0
+        diff = np.abs(a - b).max() if a.size else 0.0
+        rel = diff / scale if scale > 0 else diff
+        worst = max(worst, rel)
+        print('%-24s %14.6e %14.6e' % (name, scale, rel))
+
+    if worst > tol:
+        print('Largest relative difference %e is above the tolerance %e' % (worst, tol))
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,315 @@
+#!/usr/bin/env python
+# encoding: utf-8
+'''Performance regression suite of DynEarthSol3D.
+
+usage: perf-suite.py [options] [config ...]
+
+Each config file (default: core-complex.cfg and diffusion.cfg in this
+directory) is run for a fixed number of time steps at several mesh
+resolutions and thread counts, in the directory 'perf-run'. The random
+seed (sim.random_seed) is fixed, so that the meshes are the same in every
+run. The per-phase timings (modelname.timing) and the remeshing events
+(modelname.remesh) of each run are collected and written to a JSON file,
+with the seed. If a baseline file,
+i.e. the JSON file of an earlier run, is given, the timings are compared
+against it and the exit status is 1 if any of them is slower than the
+tolerance.
+
+options:
+    -x exe          the executable (default: ../dynearthsol3d)
+    -r f1,f2,...    mesh resolutions, relative to mesh.resolution of
+                    the config file (default: 1)
+    -t n1,n2,...    numbers of OpenMP threads (default: 1)
+    -s steps        number of time steps of each run (default: 500)
+    -o file         output file of the results (default: perf-results.json)
+    -b file         baseline file to compare with
+    --tol=x         relative tolerance of the comparison (default: 0.1)
+    --min-time=x    timings shorter than x seconds in the baseline are not
+                    compared (default: 0.05)
+    -h,--help       show this help
+
+example:
+    # on the old build
+    perf-suite.py -r 1,0.5 -t 1,4 -o baseline.json
+    # on the new build
+    perf-suite.py -r 1,0.5 -t 1,4 -b baseline.json
+'''
+
+from __future__ import print_function, unicode_literals
+import sys, os
+import json, subprocess, time
+
+benchmark_dir = os.path.dirname(os.path.abspath(__file__))
+default_configs = ['core-complex.cfg', 'diffusion.cfg']
+modelname = 'perf'
+# a fixed seed, otherwise the mesh (sim.random_seed = 0: seeded by the
+# clock) differs from run to run and from the baseline
+random_seed = 1
+
+
+def main(argv):
+    exe = os.path.join(benchmark_dir, '..', 'dynearthsol3d')
+    factors = [1.0]
+    nthreads = [1]
+    steps = 500
+    outfile = 'perf-results.json'
+    baseline = None
+    tol = 0.1
+    min_time = 0.05
+    configs = []
+
+    i = 1
+    while i < len(argv):
+        arg = argv[i]
+        if arg in ('-h', '--help'):
+            print(__doc__)
+            sys.exit(0)
+        elif arg.startswith('--tol='):
+            tol = float(arg[6:])
+        elif arg.startswith('--min-time='):
+            min_time = float(arg[11:])
+        elif arg in ('-x', '-r', '-t', '-s', '-o', '-b'):
+            if i + 1 == len(argv):
+                print('Error: missing value of option', arg)
+                sys.exit(1)
+            val = argv[i+1]
+            i += 1
+            if arg == '-x': exe = val
+            elif arg == '-r': factors = [float(x) for x in val.split(',')]
+            elif arg == '-t': nthreads = [int(x) for x in val.split(',')]
+            elif arg == '-s': steps = int(val)
+            elif arg == '-o': outfile = val
+            elif arg == '-b': baseline = val
+        elif arg.startswith('-'):
+            print('Error: unknown option', arg)
+            print(__doc__)
+            sys.exit(1)
+        else:
+            configs.append(arg)
+        i += 1
+
+    if not configs:
+        configs = [os.path.join(benchmark_dir, c) for c in default_configs]
+    exe = os.path.abspath(exe)
+    if not os.path.isfile(exe):
+        print('Error: cannot find the executable', exe)
+        sys.exit(1)
+
+    results = {}
+    for cfg in configs:
+        for f in factors:
+            for n in nthreads:
+                name = '%s-r%g-t%d' % (os.path.splitext(os.path.basename(cfg))[0], f, n)
+                print('Running', name, '...')
+                results[name] = run_case(exe, cfg, f, n, steps, name)
+                print('  %d steps, %d elements, %.3f sec' %
+                      (results[name]['steps'], results[name]['nelem'],
+                       results[name]['wall']))
+
+    with open(outfile, 'w') as fout:
+        json.dump(results, fout, indent=1, sort_keys=True)
+    print('Results are written to', outfile)
+
+    if baseline:
+        with open(baseline) as fin:
+            base = json.load(fin)
+        nslow = compare(results, base, tol, min_time)
+        if nslow:
+            print('%d timings are slower than the baseline by more than %g%%.' %
+                  (nslow, tol*100))
+            sys.exit(1)
+        print('No performance regression.')
+    return
+
+
+def run_case(exe, cfg, factor, nthreads, steps, name):
+    '''Run one config file and collect its timings'''
+    with open(cfg) as fin:
+        lines = fin.read().splitlines()
+    resolution = float(get_value(lines, 'mesh', 'resolution'))
+
+    # the output is written only at the last step, so that the timing of
+    # the time loop is not dominated by the output. Averaged output would
+    # require the steps to be a multiple of quality_check_step_interval.
+    lines = set_values(lines, {
+        ('sim', 'modelname'): modelname,
+        ('sim', 'max_steps'): str(steps),
+        ('sim', 'max_time_in_yr'): '1e30',
+        ('sim', 'output_step_interval'): str(steps),
+        ('sim', 'output_time_interval_in_yr'): '1e30',
+        ('sim', 'output_averaged_fields'): '0',
+        ('sim', 'random_seed'): str(random_seed),
+        ('mesh', 'resolution'): '%g' % (resolution * factor),
+        })
+
+    rundir = os.path.join('perf-run', name)
+    if not os.path.isdir(rundir):
+        os.makedirs(rundir)
+    for ext in ('.info', '.timing', '.remesh'):
+        if os.path.exists(os.path.join(rundir, modelname + ext)):
+            os.remove(os.path.join(rundir, modelname + ext))
+    with open(os.path.join(rundir, 'perf.cfg'), 'w') as fout:
+        fout.write('\n'.join(lines) + '\n')
+
+    env = dict(os.environ)
+    env['OMP_NUM_THREADS'] = str(nthreads)
+    t0 = time.time()
+    with open(os.path.join(rundir, 'stdout.txt'), 'w') as log:
+        ret = subprocess.call([exe, 'perf.cfg'], cwd=rundir, env=env,
+                              stdout=log, stderr=subprocess.STDOUT)
+    wall = time.time() - t0
+    if ret != 0:
+        print('Error: %s failed, see %s' %
+              (name, os.path.join(rundir, 'stdout.txt')))
+        sys.exit(2)
+
+    r = {'resolution': resolution * factor,
+         'nthreads': nthreads,
+         'random_seed': random_seed,
+         'wall': wall}
+    r.update(read_info(os.path.join(rundir, modelname + '.info')))
+    r['phases'] = read_timing(os.path.join(rundir, modelname + '.timing'))
+    r['remesh'] = read_remesh(os.path.join(rundir, modelname + '.remesh'))
+    return r
+
+
+def get_value(lines, section, key):
+    sec = ''
+    for line in lines:
+        s = line.split('#')[0].strip()
+        if s.startswith('['):
+            sec = s.strip('[]').strip()
+        elif '=' in s and sec == section and s.split('=')[0].strip() == key:
+            return s.split('=', 1)[1].strip()
+    print('Error: cannot find %s.%s in the config file' % (section, key))
+    sys.exit(1)
+
+
+def set_values(lines, values):
+    '''Replace (or add) the values of "key = value" lines in each section'''
+    values = dict(values)
+    out = []
+    sec = ''
+
+    def append_missing(sec):
+        for (s, k) in sorted(values):
+            if s == sec:
+                out.append('%s = %s' % (k, values.pop((s, k))))
+
+    for line in lines:
+        s = line.split('#')[0].strip()
+        if s.startswith('['):
+            append_missing(sec)
+            sec = s.strip('[]').strip()
+        elif '=' in s:
+            k = s.split('=')[0].strip()
+            if (sec, k) in values:
+                line = '%s = %s' % (k, values.pop((sec, k)))
+        out.append(line)
+    append_missing(sec)
+
+    # sections not in the config file
+    for sec in sorted(set(s for (s, k) in values)):
+        out.append('[%s]' % sec)
+        append_missing(sec)
+    return out
+
+
+def read_columns(filename):
+    '''Read a tab-separated file, with the column names in the first line'''
+    names = []
+    rows = []
+    with open(filename) as fin:
+        for line in fin:
+            if line.startswith('#'):
+                if not names:
+                    names = line[1:].split()
+                continue
+            rows.append(line.split())
+    return names, rows
+
+
+def read_info(filename):
+    names, rows = read_columns(filename)
+    # frame, steps, time, dt, run time, nnode, nelem, nseg
+    first, last = rows[0], rows[-1]
+    steps = int(last[1]) - int(first[1])
+    loop_time = float(last[4]) - float(first[4])
+    return {'steps': steps,
+            'nnode': int(first[5]),
+            'nelem': int(first[6]),
+            'loop_time': loop_time,
+            'steps_per_sec': steps / loop_time if loop_time > 0 else 0}
+
+
+def read_timing(filename):
+    '''Sum of the time spent in each phase, over all frames'''
+    if not os.path.exists(filename):
+        print('Warning: %s is missing, was the code built with timers=0?' % filename)
+        return {}
+    names, rows = read_columns(filename)
+    phases = dict((name, 0.0) for name in names[2:])
+    for row in rows:
+        for name, val in zip(names[2:], row[2:]):
+            phases[name] += float(val)
+    return phases
+
+
+def read_remesh(filename):
+    '''Number of remeshing events and the sum of their cost breakdown'''
+    r = {'count': 0}
+    if not os.path.exists(filename):
+        return r
+    names, rows = read_columns(filename)
+    first = names.index('stellar')
+    for name in names[first:]:
+        r[name] = 0.0
+    for row in rows:
+        r['count'] += 1
+        for name, val in zip(names[first:], row[first:]):
+            r[name] += float(val)
+    return r
+
+
+def compare(results, base, tol, min_time):
+    '''Compare the timings, return the number of regressions'''
+    nslow = 0
+    print('\n%-32s %-20s %12s %12s %8s' % ('case', 'timing', 'baseline', 'current', 'change'))
+    for name in sorted(results):
+        if name not in base:
+            print('%-32s (not in baseline)' % name)
+            continue
+        r, b = results[name], base[name]
+        if b.get('random_seed') != r['random_seed']:
+            print('%-32s Warning: random seed changed, %s -> %s, the meshes differ' %
+                  (name, b.get('random_seed'), r['random_seed']))
+        if r['nelem'] != b['nelem']:
+            print('%-32s Warning: mesh size changed, %d -> %d elements' %
+                  (name, b['nelem'], r['nelem']))
+
+        timings = [('loop_time', b['loop_time'], r['loop_time'])]
+        for phase in sorted(b['phases']):
+            if phase in r['phases']:
+                timings.append((phase, b['phases'][phase], r['phases'][phase]))
+        if b['remesh']['count'] and b['remesh']['count'] == r['remesh']['count']:
+            timings.append(('remesh_total', b['remesh']['total'], r['remesh']['total']))
+        elif b['remesh']['count'] != r['remesh']['count']:
+            print('%-32s Warning: number of remeshing changed, %d -> %d' %
+                  (name, b['remesh']['count'], r['remesh']['count']))
+
+        for timing, t0, t1 in timings:
+            if t0 < min_time:
+                continue
+            change = (t1 - t0) / t0
+            flag = ''
+            if change > tol:
+                flag = '  SLOWER'
+                nslow += 1
+            print('%-32s %-20s %12.4e %12.4e %+7.1f%%%s' %
+                  (name, timing, t0, t1, change*100, flag))
+    print()
+    return nslow
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,134 @@
+#!/usr/bin/env python
+# encoding: utf-8
+'''Stored vs. on-the-fly shape function derivatives.
+
+usage: shapefn-crossover.py [options] stored_bench onthefly_bench [config]
+
+The two executables are 'bench3d' (or 'bench2d') built with
+"make shplayout=0 bench" and "make shplayout=3 bench", respectively (after
+"make clean", the objects do not depend on the flags). The kernels that
+read the derivatives, and compute_shape_fn() that stores them, are timed by
+both for several mesh resolutions and thread counts. For each mesh, the time
+per step of these kernels is compared, and the smallest mesh for which the
+on-the-fly derivatives are faster is reported for each thread count.
+
+options:
+    -r res1,res2,...    mesh resolutions in meters, from coarse to fine
+                        (default: 8e3,4e3,2e3,1e3)
+    -t n1,n2,...        numbers of OpenMP threads (default: 1)
+    -n repeats          number of timed calls of each kernel (default: 10)
+    -o file             output CSV file (default: shapefn-crossover.csv)
+    -h,--help           show this help
+
+The config file defaults to core-complex.cfg in this directory.
+
+example:
+    make clean && make shplayout=0 bench && mv bench3d bench3d-stored
+    make clean && make shplayout=3 bench && mv bench3d bench3d-onthefly
+    benchmarks/shapefn-crossover.py -r 4e3,2e3,1e3 -t 1,4 \\
+        ./bench3d-stored ./bench3d-onthefly
+'''
+
+from __future__ import print_function, unicode_literals
+import sys, os
+import subprocess
+
+benchmark_dir = os.path.dirname(os.path.abspath(__file__))
+default_config = os.path.join(benchmark_dir, 'core-complex.cfg')
+kernels = ['shape_fn', 'temperature', 'strain_rate', 'force']
+
+
+def main(argv):
+    resolutions = '8e3,4e3,2e3,1e3'
+    nthreads = '1'
+    repeats = '10'
+    outfile = 'shapefn-crossover.csv'
+    args = []
+
+    i = 1
+    while i < len(argv):
+        arg = argv[i]
+        if arg in ('-h', '--help'):
+            print(__doc__)
+            sys.exit(0)
+        elif arg in ('-r', '-t', '-n', '-o'):
+            if i + 1 == len(argv):
+                print('Error: missing value of option', arg)
+                sys.exit(1)
+            val = argv[i+1]
+            i += 1
+            if arg == '-r': resolutions = val
+            elif arg == '-t': nthreads = val
+            elif arg == '-n': repeats = val
+            elif arg == '-o': outfile = val
+        elif arg.startswith('-'):
+            print('Error: unknown option', arg)
+            print(__doc__)
+            sys.exit(1)
+        else:
+            args.append(arg)
+        i += 1
+
+    if len(args) not in (2, 3):
+        print(__doc__)
+        sys.exit(1)
+    config = args[2] if len(args) == 3 else default_config
+
+    timings = []
+    for exe, name in zip(args[:2], ('stored', 'onthefly')):
+        csvfile = 'shapefn-crossover-%s.csv' % name
+        cmd = [os.path.abspath(exe), '-r', resolutions, '-t', nthreads,
+               '-n', repeats, '-k', ','.join(kernels), '-o', csvfile, config]
+        print('Running', ' '.join(cmd))
+        sys.stdout.flush()
+        subprocess.check_call(cmd)
+        timings.append(read_bench(csvfile))
+
+    stored, onthefly = timings
+    cases = sorted(set(stored) & set(onthefly))
+    if not cases:
+        print('Error: no common mesh and thread count in the timings.')
+        sys.exit(2)
+
+    with open(outfile, 'w') as f:
+        f.write('nelem,nthreads,' +
+                ','.join('%s_stored,%s_onthefly' % (k, k) for k in kernels) +
+                ',total_stored,total_onthefly,speedup\n')
+        print('\n%10s %8s %14s %14s %8s' %
+              ('nelem', 'threads', 'stored (s)', 'on-the-fly (s)', 'speedup'))
+        for c in cases:
+            s = [stored[c].get(k, 0.0) for k in kernels]
+            o = [onthefly[c].get(k, 0.0) for k in kernels]
+            speedup = sum(s) / sum(o) if sum(o) > 0 else 0.0
+            f.write('%d,%d,' % c +
+                    ','.join('%.6e,%.6e' % (a, b) for a, b in zip(s, o)) +
+                    ',%.6e,%.6e,%.4f\n' % (sum(s), sum(o), speedup))
+            print('%10d %8d %14.4e %14.4e %8.3f' % (c[0], c[1], sum(s), sum(o), speedup))
+
+    print()
+    for n in sorted(set(c[1] for c in cases)):
+        faster = [c[0] for c in cases
+                  if c[1] == n and sum(onthefly[c].values()) < sum(stored[c].values())]
+        if faster:
+            print('%d threads: on-the-fly is faster from %d elements' % (n, min(faster)))
+        else:
+            print('%d threads: stored is faster for all meshes' % n)
+    print('Results written to', outfile)
+
+
+def read_bench(filename):
+    '''Returns {(nelem, nthreads): {kernel: seconds}}.'''
+    results = {}
+    with open(filename) as f:
+        header = f.readline().strip().split(',')
+        col = dict((name, i) for i, name in enumerate(header))
+        for line in f:
+            v = line.strip().split(',')
+            if len(v) != len(header): continue
+            key = (int(v[col['nelem']]), int(v[col['nthreads']]))
+            results.setdefault(key, {})[v[col['kernel']]] = float(v[col['seconds']])
+    return results
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <unistd.h> // for fsync()
 
 #include "constants.hpp"
 #include "parameters.hpp"
@@ -16,6 +18,23 @@
  *        TAB character. This line tells the name of the data and the
  *        starting position (in bytes) of the data in this file.
  * 2  The rests are binary data.
+ *
+ * The format of the container file, which holds all frames of a simulation:
+ * 1  The first 'headerlen' bytes are ASCII text, the superblock.
+ *   1.1  The 1st line is "# DynEarthSol container revision=%1".
+ *   1.2  The 2nd line is "last=%1", the position (in bytes) of the header
+ *        of the last committed group, or -1 if the container is empty.
+ *   1.3  The 3rd line is "end=%1", the position (in bytes) right after
+ *        the last committed group. New groups are appended from here.
+ * 2  The rests are groups appended one after another. Each group is the
+ *    binary data of its arrays, followed by a 'headerlen'-byte header in
+ *    the same format as above. The 1st line of the group header is the
+ *    revision string with " group=%1 prev=%2" appended, with %1 the group
+ *    name (e.g. "save.000012") and %2 the position of the header of the
+ *    previous group (or -1). The positions of the arrays are absolute.
+ * The superblock is updated only after a group is completely written and
+ * flushed to the disk, so a crash during writing leaves the container in
+ * its last committed state.
  ****************************************************************************/
 
 namespace {
@@ -27,13 +46,74 @@ namespace {
         "2"
 #endif
         " revision=3\n";
+
+    const char container_str[] = "# DynEarthSol container revision=1\n";
+
+
+    void read_superblock(std::FILE *f, const char *filename, long &last, long &end)
+    {
+        char *sb = new char[headerlen]();
+        std::fseek(f, 0, SEEK_SET);
+        std::size_t n = std::fread(sb, sizeof(char), headerlen, f);
+        if (n != headerlen ||
+            std::strncmp(sb, container_str, std::strlen(container_str)) != 0 ||
+            std::sscanf(sb + std::strlen(container_str), "last=%ld\nend=%ld", &last, &end) != 2) {
+            std::cerr << "Error: " << filename << " is not a valid container file\n";
+            std::exit(2);
+        }
+        delete [] sb;
+    }
+
+
+    void write_superblock(std::FILE *f, long last, long end)
+    {
+        /* The superblock is rewritten in place, all numbers have fixed width. */
+        char *sb = new char[headerlen]();
+        std::snprintf(sb, headerlen, "%slast=%020ld\nend=%020ld\n", container_str, last, end);
+        std::fseek(f, 0, SEEK_SET);
+        std::fwrite(sb, sizeof(char), headerlen, f);
+        std::fflush(f);
+        fsync(fileno(f));
+        delete [] sb;
+    }
+}
+
+
+bool is_container_file(const char *filename)
+{
+    std::FILE *f = std::fopen(filename, "r");
+    if (f == NULL) return false;
+
+    char buffer[sizeof(container_str)] = {0};
+    std::size_t n = std::fread(buffer, sizeof(char), std::strlen(container_str), f);
+    std::fclose(f);
+    return n == std::strlen(container_str) &&
+        std::strncmp(buffer, container_str, n) == 0;
+}
+
+
+void create_container_file(const char *filename)
+{
+    std::FILE *f = std::fopen(filename, "w");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << filename << '\n';
+        std::exit(2);
+    }
+    write_superblock(f, -1, headerlen);
+    std::fclose(f);
 }
 
 
 /* Not using C++ stream IO for bulk file io since it can be much slower than C stdio. */
 
-BinaryOutput::BinaryOutput(const char *filename)
+BinaryOutput::BinaryOutput(const char *filename, const char *group)
 {
+    in_container = (group != NULL);
+    if (in_container) {
+        open_container(filename, group);
+        return;
+    }
+
     f = std::fopen(filename, "w");
     if (f == NULL) {
         std::cerr << "Error: cannot open file: " << filename << '\n';
@@ -48,6 +128,32 @@ BinaryOutput::BinaryOutput(const char *filename)
 }
 
 
+void BinaryOutput::open_container(const char *filename, const char *group)
+{
+    /* Appending a new group to the end of the container */
+    if (! is_container_file(filename))
+        create_container_file(filename);
+
+    f = std::fopen(filename, "r+");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << filename << '\n';
+        std::exit(2);
+    }
+
+    long last;
+    read_superblock(f, filename, last, eof_pos);
+
+    // the revision line, without its newline, tagged with the group
+    header = new char[headerlen]();
+    std::snprintf(header, headerlen, "%.*s group=%s prev=%ld\n",
+                  static_cast<int>(std::strlen(revision_str)) - 1, revision_str,
+                  group, last);
+    hd_pos = header;
+
+    std::fseek(f, eof_pos, SEEK_SET);
+}
+
+
 BinaryOutput::~BinaryOutput()
 {
     close();
@@ -56,7 +162,18 @@ BinaryOutput::~BinaryOutput()
 
 void BinaryOutput::close()
 {
-    if (f) {
+    if (f && in_container) {
+        /* append header buffer after the data, then commit the group */
+        long header_pos = eof_pos;
+        std::fseek(f, header_pos, SEEK_SET);
+        std::fwrite(header, sizeof(char), headerlen, f);
+        std::fflush(f);
+        fsync(fileno(f));
+        write_superblock(f, header_pos, header_pos + headerlen);
+        std::fclose(f);
+        f = NULL;
+    }
+    else if (f) {
         /* write header buffer to the beginning of file */
         std::fseek(f, 0, SEEK_SET);
         std::fwrite(header, sizeof(char), headerlen, f);
@@ -90,11 +207,35 @@ void BinaryOutput::write_header(const char *name)
 
 
 template <typename T>
-void BinaryOutput::write_array(const std::vector<T>& A, const char *name)
+std::size_t BinaryOutput::write_data(const T *a, std::size_t n)
+{
+    std::size_t m = std::fwrite(a, sizeof(T), n, f);
+    eof_pos += m * sizeof(T);
+    return m;
+}
+
+
+// single precision fields are written as double, the file format is unchanged
+template <>
+std::size_t BinaryOutput::write_data(const float *a, std::size_t n)
+{
+    const std::size_t chunk = 4096;
+    double buffer[chunk];
+    std::size_t m = 0;
+    for (std::size_t i=0; i<n; i+=chunk) {
+        const std::size_t len = std::min(chunk, n - i);
+        std::copy(a + i, a + i + len, buffer);
+        m += write_data(buffer, len);
+    }
+    return m;
+}
+
+
+template <typename T, typename Alloc>
+void BinaryOutput::write_array(const std::vector<T,Alloc>& A, const char *name)
 {
     write_header(name);
-    std::size_t n = std::fwrite(A.data(), sizeof(T), A.size(), f);
-    eof_pos += n * sizeof(T);
+    write_data(A.data(), A.size());
 }
 
 
@@ -102,16 +243,15 @@ template <typename T, int N>
 void BinaryOutput::write_array(const Array2D<T,N>& A, const char *name)
 {
     write_header(name);
-    std::size_t n = std::fwrite(A.data(), sizeof(T), A.num_elements(), f);
-    eof_pos += n * sizeof(T);
+    write_data(A.data(), A.num_elements());
 }
 
 
 // explicit instantiation
 template
-void BinaryOutput::write_array<int>(const std::vector<int>& A, const char *name);
+void BinaryOutput::write_array<int>(const int_vec& A, const char *name);
 template
-void BinaryOutput::write_array<double>(const std::vector<double>& A, const char *name);
+void BinaryOutput::write_array<double>(const double_vec& A, const char *name);
 
 template
 void BinaryOutput::write_array<double,NDIMS>(const Array2D<double,NDIMS>& A, const char *name);
@@ -129,17 +269,40 @@ template
 void BinaryOutput::write_array<int,NDIMS>(const Array2D<int,NDIMS>& A, const char *name);
 template
 void BinaryOutput::write_array<int,1>(const Array2D<int,1>& A, const char *name);
+#ifdef USE_LOWPREC
+template
+void BinaryOutput::write_array<lowp_t>(const lowp_vec& A, const char *name);
+template
+void BinaryOutput::write_array<lowp_t,NODES_PER_ELEM>(const Array2D<lowp_t,NODES_PER_ELEM>& A, const char *name);
+#endif
 
 //////////////////////////////////////////////////////////////////////////////
 
-BinaryInput::BinaryInput(const char *filename)
+BinaryInput::BinaryInput(const char *filename, const char *group_name)
 {
     f = std::fopen(filename, "r");
     if (f == NULL) {
         std::cerr << "Error: cannot open file: " << filename << '\n';
         std::exit(2);
     }
-    read_header();
+
+    if (group_name == NULL) {
+        read_header();
+        return;
+    }
+
+    /* Walking backward from the last committed group. If a group is
+     * written more than once, the latest one is used. */
+    long last, end;
+    read_superblock(f, filename, last, end);
+    long pos = last;
+    while (pos >= 0) {
+        read_header(pos);
+        if (group == group_name) return;
+        pos = prev_pos;
+    }
+    std::cerr << "Error: no group named " << group_name << " in " << filename << '\n';
+    std::exit(2);
 }
 
 
@@ -149,10 +312,10 @@ BinaryInput::~BinaryInput()
 }
 
 
-void BinaryInput::read_header()
+void BinaryInput::read_header(long pos)
 {
     /* Read into header buffer */
-    std::fseek(f, 0, SEEK_SET);
+    std::fseek(f, pos, SEEK_SET);
     char *header = new char[headerlen]();
     std::size_t n = std::fread(header, sizeof(char), headerlen, f);
     if (n != headerlen) {
@@ -172,6 +335,21 @@ void BinaryInput::read_header()
         std::exit(1);
     }
 
+    // The header of a group in the container has more to say
+    group.clear();
+    prev_pos = -1;
+    const char *g = std::strstr(line, " group=");
+    if (g != NULL) {
+        char name[256];
+        if (std::sscanf(g, " group=%255s prev=%ld", name, &prev_pos) != 2) {
+            std::cerr << "Error: error parsing group header\n"
+                      << " Line is:" << line << '\n';
+            std::exit(1);
+        }
+        group = name;
+    }
+
+    offset.clear();
     line = std::strtok(NULL, "\n");
     while (line != NULL) {
         /* Each line is a string (might contain space), a tab, and an integer */
@@ -208,7 +386,32 @@ void BinaryInput::seek_to_array(const char *name)
 
 
 template <typename T>
-void BinaryInput::read_array(std::vector<T>& A, const char *name)
+std::size_t BinaryInput::read_data(T *a, std::size_t n)
+{
+    return std::fread(a, sizeof(T), n, f);
+}
+
+
+// single precision fields are stored as double in the file
+template <>
+std::size_t BinaryInput::read_data(float *a, std::size_t n)
+{
+    const std::size_t chunk = 4096;
+    double buffer[chunk];
+    std::size_t m = 0;
+    for (std::size_t i=0; i<n; i+=chunk) {
+        const std::size_t len = std::min(chunk, n - i);
+        const std::size_t k = read_data(buffer, len);
+        std::copy(buffer, buffer + k, a + i);
+        m += k;
+        if (k != len) break;
+    }
+    return m;
+}
+
+
+template <typename T, typename Alloc>
+void BinaryInput::read_array(std::vector<T,Alloc>& A, const char *name)
 {
     /* The caller must ensure A is of right size to hold the array */
 
@@ -219,7 +422,7 @@ void BinaryInput::read_array(std::vector<T>& A, const char *name)
     }
 
     seek_to_array(name);
-    int n = std::fread(A.data(), sizeof(T), size, f);
+    int n = read_data(A.data(), size);
 
     if (n != size) {
         std::cerr << "Error: cannot read array: " << name << '\n';
@@ -240,7 +443,7 @@ void BinaryInput::read_array(Array2D<T,N>& A, const char *name)
     }
 
     seek_to_array(name);
-    int n = std::fread(A.data(), sizeof(T), size*N, f);
+    int n = read_data(A.data(), size*N);
 
     if (n != N*size) {
         std::cerr << "Error: cannot read array: " << name << '\n';
@@ -251,9 +454,9 @@ void BinaryInput::read_array(Array2D<T,N>& A, const char *name)
 
 // explicit instantiation
 template
-void BinaryInput::read_array<double>(std::vector<double>& A, const char *name);
+void BinaryInput::read_array<double>(double_vec& A, const char *name);
 template
-void BinaryInput::read_array<int>(std::vector<int>& A, const char *name);
+void BinaryInput::read_array<int>(int_vec& A, const char *name);
 template
 void BinaryInput::read_array<double,NDIMS>(Array2D<double,NDIMS>& A, const char *name);
 template
@@ -270,4 +473,10 @@ template
 void BinaryInput::read_array<int,NODES_PER_ELEM>(Array2D<int,NODES_PER_ELEM>& A, const char *name);
 template
 void BinaryInput::read_array<int,1>(Array2D<int,1>& A, const char *name);
+#ifdef USE_LOWPREC
+template
+void BinaryInput::read_array<lowp_t>(lowp_vec& A, const char *name);
+template
+void BinaryInput::read_array<lowp_t,NODES_PER_ELEM>(Array2D<lowp_t,NODES_PER_ELEM>& A, const char *name);
+#endif
 
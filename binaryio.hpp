@@ -12,17 +12,22 @@ private:
     char *header;
     char *hd_pos;
     std::FILE* f;
+    bool in_container;
 
     void write_header(const char *name);
+    void open_container(const char *filename, const char *group);
+
+    template <typename T>
+    std::size_t write_data(const T *a, std::size_t n);
 
 public:
-    BinaryOutput(const char *filename);
+    BinaryOutput(const char *filename, const char *group=NULL);
     ~BinaryOutput();
 
     void close();
 
-    template <typename T>
-    void write_array(const std::vector<T>& A, const char *name);
+    template <typename T, typename Alloc>
+    void write_array(const std::vector<T,Alloc>& A, const char *name);
 
     template <typename T, int N>
     void write_array(const Array2D<T,N>& A, const char *name);
@@ -34,19 +39,28 @@ class BinaryInput
 private:
     std::FILE* f;
     std::map<std::string, std::size_t> offset;
+    std::string group;
+    long prev_pos;
 
-    void read_header();
+    void read_header(long pos=0);
     void seek_to_array(const char *name);
 
+    template <typename T>
+    std::size_t read_data(T *a, std::size_t n);
+
 public:
-    BinaryInput(const char *filename);
+    BinaryInput(const char *filename, const char *group=NULL);
     ~BinaryInput();
 
-    template <typename T>
-    void read_array(std::vector<T>& A, const char *name);
+    template <typename T, typename Alloc>
+    void read_array(std::vector<T,Alloc>& A, const char *name);
 
     template <typename T, int N>
     void read_array(Array2D<T,N>& A, const char *name);
 };
 
+
+bool is_container_file(const char *filename);
+void create_container_file(const char *filename);
+
 #endif
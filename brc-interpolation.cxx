@@ -7,6 +7,7 @@
 #include "parameters.hpp"
 
 #include "barycentric-fn.hpp"
+#include "memory.hpp"
 #include "utils.hpp"
 #include "brc-interpolation.hpp"
 
@@ -59,6 +60,11 @@ void prepare_interpolation(const Variables &var, const array_t &old_coord,
 
     Barycentric_transformation bary(old_coord, old_connectivity, *var.volume);
 
+    ScopedMemory mem(*var.memory, MemoryUsage::interpolation,
+                     barycentric_nbytes(old_connectivity.size()) +
+                     old_coord.size() * sizeof(double*) +
+                     kdtree_nbytes(old_coord.size()));
+
     // ANN requires double** as input
     double **points = new double*[old_coord.size()];
     for (std::size_t i=0; i<old_coord.size(); i++) {
@@ -199,17 +205,20 @@ void barycentric_node_interpolation(Variables &var, const array_t &old_coord,
 {
     int_vec el(var.nnode);
     brc_t brc(var.nnode);
+    ScopedMemory mem(*var.memory, MemoryUsage::interpolation, nbytes(el) + nbytes(brc));
     prepare_interpolation(var, old_coord, old_connectivity, brc, el);
 
-    double_vec *a = new double_vec(var.nnode);
-    interpolate_field(brc, el, old_connectivity, *var.temperature, *a);
-    delete var.temperature;
-    var.temperature = a;
+    {
+        double_vec a(var.nnode);
+        interpolate_field(brc, el, old_connectivity, *var.temperature, a);
+        var.temperature->swap(a);
+    }
 
-    array_t *b = new array_t(var.nnode);
-    interpolate_field(brc, el, old_connectivity, *var.vel, *b);
-    delete var.vel;
-    var.vel = b;
+    {
+        array_t b(var.nnode);
+        interpolate_field(brc, el, old_connectivity, *var.vel, b);
+        *var.vel = std::move(b);
+    }
 }
 
 
@@ -18,6 +18,14 @@ const int NODES_PER_ELEM = NDIMS + 1;
 // 2D -> 3;  3D -> 6
 const int NSTR = NDIMS * (NDIMS + 1) / 2;
 
+// storage type of the fields that tolerate single precision, see the
+// typedefs in parameters.hpp, "make lowprec=1"
+#ifdef USE_LOWPREC
+typedef float lowp_t;
+#else
+typedef double lowp_t;
+#endif
+
 // Flags for boundary
 typedef unsigned int uint;
 const uint BOUNDX0 = 1 << 0;  //  1, left
@@ -0,0 +1,921 @@
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include "constants.hpp"
+#include "parameters.hpp"
+#include "decomposition.hpp"
+
+#ifdef USE_MPI
+
+#include "fields.hpp"
+#include "geometry.hpp"
+#include "markerset.hpp"
+#include "matprops.hpp"
+#include "mesh.hpp"
+
+
+namespace {
+
+    // tags of the messages from/to the root process, and between neighbors
+    const int tag_root = 1;
+    const int tag_shared = 2;
+
+    template <typename T> MPI_Datatype mpi_type();
+    template <> MPI_Datatype mpi_type<double>() {return MPI_DOUBLE;}
+    template <> MPI_Datatype mpi_type<float>() {return MPI_FLOAT;}
+    template <> MPI_Datatype mpi_type<int>() {return MPI_INT;}
+    template <> MPI_Datatype mpi_type<uint>() {return MPI_UNSIGNED;}
+
+
+    template <typename T>
+    void send(const T *a, std::size_t n, int dest)
+    {
+        MPI_Send(const_cast<T*>(a), static_cast<int>(n), mpi_type<T>(),
+                 dest, tag_root, MPI_COMM_WORLD);
+    }
+
+
+    template <typename T>
+    void recv(T *a, std::size_t n, int source)
+    {
+        MPI_Recv(a, static_cast<int>(n), mpi_type<T>(),
+                 source, tag_root, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+
+
+    template <typename T, int N>
+    int ncomp(const Array2D<T,N>&) {return N;}
+
+    template <typename T, typename A>
+    int ncomp(const std::vector<T,A>&) {return 1;}
+
+
+    int comm_rank()
+    {
+        int r;
+        MPI_Comm_rank(MPI_COMM_WORLD, &r);
+        return r;
+    }
+
+
+    int comm_size()
+    {
+        int n;
+        MPI_Comm_size(MPI_COMM_WORLD, &n);
+        return n;
+    }
+
+
+    class CenterLess
+    {
+        const array_t &center;
+        const int d;
+    public:
+        CenterLess(const array_t &center, int d) : center(center), d(d) {}
+        bool operator()(int a, int b) const
+        {
+            // ties are broken by the element number, for a unique partition
+            return center[a][d] < center[b][d] || (center[a][d] == center[b][d] && a < b);
+        }
+    };
+
+
+    void bisect(int *first, int *last, int part0, int nparts,
+                const array_t &center, int_vec &owner)
+    {
+        /* Recursive coordinate bisection: the elements in [first, last) are
+         * split across the longest extent of their centers, in proportion to
+         * the numbers of partitions of the two halves. */
+        if (nparts == 1) {
+            for (int *p=first; p<last; ++p)
+                owner[*p] = part0;
+            return;
+        }
+
+        double lo[NDIMS], hi[NDIMS];
+        for (int d=0; d<NDIMS; ++d) {
+            lo[d] = hi[d] = center[*first][d];
+        }
+        for (int *p=first; p<last; ++p) {
+            for (int d=0; d<NDIMS; ++d) {
+                lo[d] = std::min(lo[d], center[*p][d]);
+                hi[d] = std::max(hi[d], center[*p][d]);
+            }
+        }
+        int dir = 0;
+        for (int d=1; d<NDIMS; ++d) {
+            if (hi[d] - lo[d] > hi[dir] - lo[dir]) dir = d;
+        }
+
+        const int n1 = nparts / 2;
+        int *mid = first + static_cast<long>(last - first) * n1 / nparts;
+        std::nth_element(first, mid, last, CenterLess(center, dir));
+
+        bisect(first, mid, part0, n1, center, owner);
+        bisect(mid, last, part0 + n1, nparts - n1, center, owner);
+    }
+
+
+    void sum_shared_in_team(const Variables &var, double *const arrays[], const int ncomp[], int narrays)
+    {
+        // In a team kernel (see team.hpp), the contributions of all threads
+        // are complete, and only the master thread calls MPI.
+        #pragma omp barrier
+        #pragma omp master
+        var.decomp->sum_shared(arrays, ncomp, narrays);
+        #pragma omp barrier
+    }
+
+} // anonymous namespace
+
+
+struct Decomposition::Part
+{
+    int nnode, nelem, last_marker_id;
+    conn_t connectivity;  // in the local node numbers
+
+    // the neighboring processes, the number of nodes shared with each,
+    // and the shared nodes, concatenated
+    int_vec nbr, nbr_count, nbr_list;
+
+    shapefn eta;
+    int_vec melem, mattype, id;
+};
+
+
+Decomposition::Decomposition(const Param &param) :
+    param(param), rank(comm_rank()), nranks(comm_size()),
+    global_(new Variables()), gathered_steps(-1)
+{}
+
+
+Decomposition::~Decomposition()
+{
+    release_global();
+    delete global_->segment;
+    delete global_->segflag;
+    delete global_;
+}
+
+
+Variables& Decomposition::global(const Variables &var)
+{
+    Variables &g = *global_;
+    g.time = var.time;
+    g.dt = var.dt;
+    g.steps = var.steps;
+    g.max_vbc_val = var.max_vbc_val;
+    g.compensation_pressure = var.compensation_pressure;
+    g.timers = var.timers;
+    g.memory = var.memory;
+    g.roofline = var.roofline;
+    return g;
+}
+
+
+void Decomposition::release_global()
+{
+    /* Deleting the global model, except the boundary segments, which are
+     * only stored on the root process and updated by remeshing. */
+    Variables &g = *global_;
+
+    delete g.coord;
+    delete g.connectivity;
+    delete g.regattr;
+    delete g.bcflag;
+    delete g.support;
+    delete g.elemmarkers;
+    delete g.volume;
+    delete g.volume_old;
+    delete g.volume_n;
+    delete g.mass;
+    delete g.tmass;
+    delete g.edvoldt;
+    delete g.temperature;
+    delete g.plstrain;
+    delete g.delta_plstrain;
+    delete g.ntmp;
+    delete g.elquality;
+    delete g.vel;
+    delete g.force;
+    delete g.strain_rate;
+    delete g.strain;
+    delete g.stress;
+    delete g.shpd;
+    delete g.mat;
+    delete g.markerset;
+
+    g.coord = NULL;
+    g.connectivity = NULL;
+    g.regattr = NULL;
+    g.bcflag = NULL;
+    g.support = g.elemmarkers = NULL;
+    g.volume = g.volume_old = g.volume_n = g.mass = g.tmass = NULL;
+    g.temperature = g.plstrain = g.ntmp = NULL;
+    g.edvoldt = g.delta_plstrain = g.elquality = NULL;
+    g.vel = g.force = NULL;
+    g.strain_rate = g.strain = g.stress = NULL;
+    g.shpd = NULL;
+    g.mat = NULL;
+    g.markerset = NULL;
+
+    for (int i=0; i<6; ++i) {
+        g.bnodes[i].clear();
+        g.bfacets[i].clear();
+    }
+    g.egroups.clear();
+}
+
+
+template <typename T>
+void Decomposition::scatter_rows(const T *g, T *local, std::size_t n, int ncomp,
+                                 const std::vector<int_vec> &gid) const
+{
+    if (! is_root()) {
+        recv(local, n * ncomp, 0);
+        return;
+    }
+
+    std::vector<T> buf;
+    for (int r=0; r<nranks; ++r) {
+        const int_vec &ids = gid[r];
+        T *p = local;
+        if (r != 0) {
+            buf.resize(ids.size() * ncomp);
+            p = buf.data();
+        }
+        for (std::size_t i=0; i<ids.size(); ++i)
+            std::copy(g + std::size_t(ids[i]) * ncomp, g + std::size_t(ids[i] + 1) * ncomp,
+                      p + i * ncomp);
+        if (r != 0)
+            send(p, buf.size(), r);
+    }
+}
+
+
+template <typename T>
+void Decomposition::gather_rows(const T *local, std::size_t n, int ncomp,
+                                const std::vector<int_vec> &gid, T *g) const
+{
+    if (! is_root()) {
+        send(local, n * ncomp, 0);
+        return;
+    }
+
+    std::vector<T> buf;
+    for (int r=0; r<nranks; ++r) {
+        const int_vec &ids = gid[r];
+        const T *p = local;
+        if (r != 0) {
+            buf.resize(ids.size() * ncomp);
+            recv(buf.data(), buf.size(), r);
+            p = buf.data();
+        }
+        for (std::size_t i=0; i<ids.size(); ++i)
+            std::copy(p + i * ncomp, p + (i + 1) * ncomp,
+                      g + std::size_t(ids[i]) * ncomp);
+    }
+}
+
+
+template <class A>
+void Decomposition::scatter_array(const A *g, A &a, const std::vector<int_vec> &gid) const
+{
+    // g is NULL except on the root process
+    scatter_rows(g ? g->data() : NULL, a.data(), a.size(), ncomp(a), gid);
+}
+
+
+template <class A>
+void Decomposition::gather_array(const A &a, A *g, const std::vector<int_vec> &gid) const
+{
+    // g is NULL except on the root process
+    gather_rows(a.data(), a.size(), ncomp(a), gid, g ? g->data() : NULL);
+}
+
+
+template <class A>
+void Decomposition::gather_array(A &a, const std::vector<int_vec> &gid, int nglobal) const
+{
+    if (! is_root()) {
+        gather_array(a, static_cast<A*>(NULL), gid);
+        return;
+    }
+
+    A g(nglobal);
+    gather_array(a, &g, gid);
+    a.swap(g);
+}
+
+// used by Output
+template void Decomposition::gather_array<array_t>(array_t&, const std::vector<int_vec>&, int) const;
+template void Decomposition::gather_array<tensor_t>(tensor_t&, const std::vector<int_vec>&, int) const;
+template void Decomposition::gather_array<double_vec>(double_vec&, const std::vector<int_vec>&, int) const;
+
+
+void Decomposition::partition(const Variables &g, int_vec &owner) const
+{
+    if (g.nelem < nranks) {
+        std::cerr << "Error: the mesh has fewer elements (" << g.nelem
+                  << ") than processes (" << nranks << ")\n";
+        std::exit(1);
+    }
+
+    array_t center(g.nelem);
+    for (int e=0; e<g.nelem; ++e) {
+        const int *conn = (*g.connectivity)[e];
+        for (int d=0; d<NDIMS; ++d) {
+            double sum = 0;
+            for (int i=0; i<NODES_PER_ELEM; ++i)
+                sum += (*g.coord)[conn[i]][d];
+            center[e][d] = sum / NODES_PER_ELEM;
+        }
+    }
+
+    int_vec elems(g.nelem);
+    for (int e=0; e<g.nelem; ++e)
+        elems[e] = e;
+    owner.resize(g.nelem);
+    bisect(elems.data(), elems.data() + g.nelem, 0, nranks, center, owner);
+}
+
+
+void Decomposition::send_parts(const Variables &g, const int_vec &owner, Variables &var)
+{
+    /* Sending each process its elements, their nodes (both in ascending
+     * global number, so the locality of the global mesh is kept), the nodes
+     * shared with other processes and the markers. */
+
+    elem_gid.assign(nranks, int_vec());
+    for (int e=0; e<g.nelem; ++e)
+        elem_gid[owner[e]].push_back(e);
+
+    // local element number
+    int_vec elocal(g.nelem);
+    for (int r=0; r<nranks; ++r)
+        for (std::size_t j=0; j<elem_gid[r].size(); ++j)
+            elocal[elem_gid[r][j]] = j;
+
+    // node marks, reused as the local node number of each process
+    int_vec nlocal(g.nnode, -1);
+
+    node_gid.assign(nranks, int_vec());
+    for (int r=0; r<nranks; ++r) {
+        int_vec &nodes = node_gid[r];
+        for (std::size_t j=0; j<elem_gid[r].size(); ++j) {
+            const int *conn = (*g.connectivity)[elem_gid[r][j]];
+            for (int i=0; i<NODES_PER_ELEM; ++i) {
+                if (nlocal[conn[i]] != r) {
+                    nlocal[conn[i]] = r;
+                    nodes.push_back(conn[i]);
+                }
+            }
+        }
+        std::sort(nodes.begin(), nodes.end());
+    }
+
+    // the processes of each node, in ascending rank
+    int_vec start(g.nnode + 1, 0);
+    for (int r=0; r<nranks; ++r)
+        for (std::size_t j=0; j<node_gid[r].size(); ++j)
+            ++start[node_gid[r][j] + 1];
+    std::partial_sum(start.begin(), start.end(), start.begin());
+    int_vec procs(start[g.nnode]);
+    {
+        int_vec pos(start.begin(), start.end() - 1);
+        for (int r=0; r<nranks; ++r)
+            for (std::size_t j=0; j<node_gid[r].size(); ++j)
+                procs[pos[node_gid[r][j]]++] = r;
+    }
+
+    const MarkerSet &ms = *g.markerset;
+    std::vector<int_vec> markers(nranks);
+    for (int m=0; m<ms.get_nmarkers(); ++m)
+        markers[owner[ms.get_elem(m)]].push_back(m);
+
+    // the part of the root process is the last, it is moved into var
+    for (int r=nranks-1; r>=0; --r) {
+        const int_vec &nodes = node_gid[r];
+        const int_vec &elems = elem_gid[r];
+        Part p;
+        p.nnode = nodes.size();
+        p.nelem = elems.size();
+        p.last_marker_id = ms.get_last_id();
+
+        for (int j=0; j<p.nnode; ++j)
+            nlocal[nodes[j]] = j;
+
+        p.connectivity.resize(p.nelem);
+        for (int j=0; j<p.nelem; ++j) {
+            const int *conn = (*g.connectivity)[elems[j]];
+            for (int i=0; i<NODES_PER_ELEM; ++i)
+                p.connectivity[j][i] = nlocal[conn[i]];
+        }
+
+        {
+            std::vector<int_vec> shared(nranks);
+            for (int j=0; j<p.nnode; ++j) {
+                const int n = nodes[j];
+                for (int k=start[n]; k<start[n+1]; ++k)
+                    if (procs[k] != r) shared[procs[k]].push_back(j);
+            }
+            for (int q=0; q<nranks; ++q) {
+                if (shared[q].empty()) continue;
+                p.nbr.push_back(q);
+                p.nbr_count.push_back(shared[q].size());
+                p.nbr_list.insert(p.nbr_list.end(), shared[q].begin(), shared[q].end());
+            }
+        }
+
+        const int_vec &mk = markers[r];
+        const int nm = mk.size();
+        p.eta.resize(nm);
+        p.melem.resize(nm);
+        p.mattype.resize(nm);
+        p.id.resize(nm);
+        for (int k=0; k<nm; ++k) {
+            const int m = mk[k];
+            std::copy(ms.get_eta(m), ms.get_eta(m) + NODES_PER_ELEM, p.eta[k]);
+            p.melem[k] = elocal[ms.get_elem(m)];
+            p.mattype[k] = ms.get_mattype(m);
+            p.id[k] = ms.get_id(m);
+        }
+
+        if (r == 0) {
+            install_part(var, p);
+        }
+        else {
+            int header[] = {p.nnode, p.nelem, p.last_marker_id, nm, int(p.nbr.size())};
+            send(header, 5, r);
+            send(p.connectivity.data(), p.connectivity.num_elements(), r);
+            send(p.nbr.data(), p.nbr.size(), r);
+            send(p.nbr_count.data(), p.nbr_count.size(), r);
+            send(p.nbr_list.data(), p.nbr_list.size(), r);
+            send(p.eta.data(), p.eta.num_elements(), r);
+            send(p.melem.data(), nm, r);
+            send(p.mattype.data(), nm, r);
+            send(p.id.data(), nm, r);
+        }
+    }
+}
+
+
+void Decomposition::receive_part(Variables &var)
+{
+    int header[5];
+    recv(header, 5, 0);
+
+    Part p;
+    p.nnode = header[0];
+    p.nelem = header[1];
+    p.last_marker_id = header[2];
+    const int nm = header[3];
+    const int nnbr = header[4];
+
+    p.connectivity.resize(p.nelem);
+    recv(p.connectivity.data(), p.connectivity.num_elements(), 0);
+    p.nbr.resize(nnbr);
+    p.nbr_count.resize(nnbr);
+    recv(p.nbr.data(), nnbr, 0);
+    recv(p.nbr_count.data(), nnbr, 0);
+    p.nbr_list.resize(std::accumulate(p.nbr_count.begin(), p.nbr_count.end(), 0));
+    recv(p.nbr_list.data(), p.nbr_list.size(), 0);
+
+    p.eta.resize(nm);
+    p.melem.resize(nm);
+    p.mattype.resize(nm);
+    p.id.resize(nm);
+    recv(p.eta.data(), p.eta.num_elements(), 0);
+    recv(p.melem.data(), nm, 0);
+    recv(p.mattype.data(), nm, 0);
+    recv(p.id.data(), nm, 0);
+
+    install_part(var, p);
+}
+
+
+void Decomposition::install_part(Variables &var, Part &p)
+{
+    /* The arrays of var are reused if allocated, since other objects (MatProps,
+     * ShapeDeriv) keep references to them. */
+    var.nnode = p.nnode;
+    var.nelem = p.nelem;
+
+    if (var.connectivity == NULL)
+        var.connectivity = new conn_t;
+    var.connectivity->swap(p.connectivity);
+
+    if (var.coord == NULL)
+        var.coord = new array_t(var.nnode);
+    else
+        var.coord->resize(var.nnode);
+
+    if (var.bcflag == NULL)
+        var.bcflag = new uint_vec(var.nnode);
+    else
+        var.bcflag->resize(var.nnode);
+
+    // the boundary segments are kept on the root process only
+    if (var.segment == NULL) {
+        var.segment = new segment_t;
+        var.segflag = new segflag_t;
+    }
+    var.nseg = 0;
+
+    if (var.elemmarkers == NULL)
+        var.elemmarkers = new int_vec2D(var.nelem, int_vec(param.mat.nmat, 0));
+    else
+        var.elemmarkers->assign(var.nelem, int_vec(param.mat.nmat, 0));
+
+    delete var.markerset;
+    var.markerset = new MarkerSet(param, p.eta, p.melem, p.mattype, p.id, p.last_marker_id);
+
+    nbr_rank.swap(p.nbr);
+    nbr_nodes.resize(nbr_rank.size());
+    for (std::size_t i=0, k=0; i<nbr_rank.size(); ++i) {
+        nbr_nodes[i].assign(p.nbr_list.begin() + k, p.nbr_list.begin() + k + p.nbr_count[i]);
+        k += p.nbr_count[i];
+    }
+    shared_nodes.swap(p.nbr_list);
+    std::sort(shared_nodes.begin(), shared_nodes.end());
+    shared_nodes.erase(std::unique(shared_nodes.begin(), shared_nodes.end()), shared_nodes.end());
+}
+
+
+void Decomposition::scatter(Variables &var)
+{
+    Variables &g = *global_;
+
+    if (is_root()) {
+        int_vec owner;
+        partition(g, owner);
+        send_parts(g, owner, var);
+    }
+    else
+        receive_part(var);
+
+    {
+        double scalars[] = {g.time, g.dt, g.compensation_pressure, double(g.steps)};
+        MPI_Bcast(scalars, 4, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        var.time = scalars[0];
+        var.dt = scalars[1];
+        var.compensation_pressure = scalars[2];
+        var.steps = static_cast<int>(scalars[3]);
+    }
+
+    scatter_array(g.coord, *var.coord, node_gid);
+    scatter_array(g.bcflag, *var.bcflag, node_gid);
+    {
+        const int nmat = param.mat.nmat;
+        int_vec gflat, flat(var.nelem * nmat);
+        if (is_root()) {
+            gflat.resize(g.nelem * nmat);
+            for (int e=0; e<g.nelem; ++e)
+                std::copy((*g.elemmarkers)[e].begin(), (*g.elemmarkers)[e].end(), &gflat[e * nmat]);
+        }
+        scatter_rows(gflat.data(), flat.data(), var.nelem, nmat, elem_gid);
+        for (int e=0; e<var.nelem; ++e)
+            std::copy(&flat[e * nmat], &flat[(e + 1) * nmat], (*var.elemmarkers)[e].begin());
+    }
+
+    for (int i=0; i<6; ++i) {
+        var.bnodes[i].clear();
+        var.bfacets[i].clear();
+    }
+    create_boundary_nodes(var);
+    create_boundary_facets(var);
+    delete var.support;
+    create_support(var);
+    create_elem_groups(param, var);
+
+    if (var.volume == NULL)
+        allocate_variables(param, var);
+    else {
+        // the fields that are not resized by reallocate_variables()
+        var.temperature->resize(var.nnode);
+        var.vel->resize(var.nnode);
+        var.plstrain->resize(var.nelem);
+        var.delta_plstrain->resize(var.nelem);
+        var.strain->resize(var.nelem);
+        var.stress->resize(var.nelem);
+        reallocate_variables(param, var);
+    }
+
+    scatter_array(g.temperature, *var.temperature, node_gid);
+    scatter_array(g.vel, *var.vel, node_gid);
+    scatter_array(g.force, *var.force, node_gid);
+    scatter_array(g.plstrain, *var.plstrain, elem_gid);
+    scatter_array(g.delta_plstrain, *var.delta_plstrain, elem_gid);
+    scatter_array(g.strain, *var.strain, elem_gid);
+    scatter_array(g.stress, *var.stress, elem_gid);
+    scatter_array(g.strain_rate, *var.strain_rate, elem_gid);
+    scatter_array(g.volume_old, *var.volume_old, elem_gid);
+    scatter_array(g.elquality, *var.elquality, elem_gid);
+
+    compute_volume(*var.coord, *var.connectivity, *var.volume);
+    compute_mass(param, var.egroups, *var.connectivity, *var.volume, *var.mat,
+                 var.max_vbc_val, *var.volume_n, *var.mass, *var.tmass);
+    sum_shared_nodes(var, *var.volume_n, *var.mass, *var.tmass);
+    compute_shape_fn(*var.coord, *var.connectivity, *var.volume, var.egroups,
+                     *var.shpd);
+
+    release_global();
+    gathered_steps = -1;
+
+    std::cout << "  Partitioned the mesh for " << nranks << " processes, the root process has "
+              << var.nnode << " nodes, " << var.nelem << " elements and "
+              << nbr_rank.size() << " neighbors.\n";
+}
+
+
+void Decomposition::gather(const Variables &var)
+{
+    Variables &g = global(var);
+    if (gathered_steps == var.steps) return;
+    gathered_steps = var.steps;
+
+    if (is_root()) {
+        release_global();
+        g.coord = new array_t(g.nnode);
+        g.connectivity = new conn_t(g.nelem);
+        g.bcflag = new uint_vec(g.nnode);
+        g.elemmarkers = new int_vec2D(g.nelem, int_vec(param.mat.nmat, 0));
+        g.nseg = g.segment->size();
+    }
+
+    gather_array(*var.coord, g.coord, node_gid);
+    gather_array(*var.bcflag, g.bcflag, node_gid);
+
+    // the connectivity, renumbered to the global nodes
+    if (! is_root())
+        send(var.connectivity->data(), var.connectivity->num_elements(), 0);
+    else {
+        conn_t buf;
+        for (int r=0; r<nranks; ++r) {
+            const conn_t *conn = var.connectivity;
+            if (r != 0) {
+                buf.resize(elem_gid[r].size());
+                recv(buf.data(), buf.num_elements(), r);
+                conn = &buf;
+            }
+            for (std::size_t j=0; j<elem_gid[r].size(); ++j)
+                for (int i=0; i<NODES_PER_ELEM; ++i)
+                    (*g.connectivity)[elem_gid[r][j]][i] = node_gid[r][(*conn)[j][i]];
+        }
+    }
+
+    {
+        const int nmat = param.mat.nmat;
+        int_vec gflat, flat(var.nelem * nmat);
+        for (int e=0; e<var.nelem; ++e)
+            std::copy((*var.elemmarkers)[e].begin(), (*var.elemmarkers)[e].end(), &flat[e * nmat]);
+        if (is_root())
+            gflat.resize(g.nelem * nmat);
+        gather_rows(flat.data(), var.nelem, nmat, elem_gid, gflat.data());
+        if (is_root())
+            for (int e=0; e<g.nelem; ++e)
+                std::copy(&gflat[e * nmat], &gflat[(e + 1) * nmat], (*g.elemmarkers)[e].begin());
+    }
+
+    // the markers, in the order of the processes
+    {
+        const MarkerSet &ms = *var.markerset;
+        int nm = ms.get_nmarkers();
+        int_vec counts(nranks);
+        MPI_Gather(&nm, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+        shapefn eta(nm);
+        int_vec melem(nm), mattype(nm), id(nm);
+        for (int m=0; m<nm; ++m) {
+            std::copy(ms.get_eta(m), ms.get_eta(m) + NODES_PER_ELEM, eta[m]);
+            melem[m] = ms.get_elem(m);
+            mattype[m] = ms.get_mattype(m);
+            id[m] = ms.get_id(m);
+        }
+
+        if (! is_root()) {
+            send(eta.data(), eta.num_elements(), 0);
+            send(melem.data(), nm, 0);
+            send(mattype.data(), nm, 0);
+            send(id.data(), nm, 0);
+        }
+        else {
+            const int total = std::accumulate(counts.begin(), counts.end(), 0);
+            shapefn geta(total);
+            int_vec gelem(total), gmattype(total), gid(total);
+            for (int r=0, k=0; r<nranks; k+=counts[r], ++r) {
+                const int n = counts[r];
+                if (r == 0) {
+                    std::copy(eta.data(), eta.data() + eta.num_elements(), geta[k]);
+                    std::copy(melem.begin(), melem.end(), &gelem[k]);
+                    std::copy(mattype.begin(), mattype.end(), &gmattype[k]);
+                    std::copy(id.begin(), id.end(), &gid[k]);
+                }
+                else {
+                    recv(geta[k], n * NODES_PER_ELEM, r);
+                    recv(&gelem[k], n, r);
+                    recv(&gmattype[k], n, r);
+                    recv(&gid[k], n, r);
+                }
+                for (int m=k; m<k+n; ++m)
+                    gelem[m] = elem_gid[r][gelem[m]];
+            }
+            g.markerset = new MarkerSet(param, geta, gelem, gmattype, gid, ms.get_last_id());
+        }
+    }
+
+    if (is_root()) {
+        create_boundary_nodes(g);
+        create_boundary_facets(g);
+        create_support(g);
+        create_elem_groups(param, g);
+        allocate_variables(param, g);
+    }
+
+    gather_array(*var.temperature, g.temperature, node_gid);
+    gather_array(*var.vel, g.vel, node_gid);
+    gather_array(*var.force, g.force, node_gid);
+    gather_array(*var.mass, g.mass, node_gid);
+    gather_array(*var.tmass, g.tmass, node_gid);
+    gather_array(*var.volume_n, g.volume_n, node_gid);
+    gather_array(*var.volume, g.volume, elem_gid);
+    gather_array(*var.volume_old, g.volume_old, elem_gid);
+    gather_array(*var.edvoldt, g.edvoldt, elem_gid);
+    gather_array(*var.elquality, g.elquality, elem_gid);
+    gather_array(*var.plstrain, g.plstrain, elem_gid);
+    gather_array(*var.delta_plstrain, g.delta_plstrain, elem_gid);
+    gather_array(*var.strain, g.strain, elem_gid);
+    gather_array(*var.stress, g.stress, elem_gid);
+    gather_array(*var.strain_rate, g.strain_rate, elem_gid);
+}
+
+
+void Decomposition::sum_shared(double *const a[], const int ncomp[], int narrays) const
+{
+    const int nnbr = nbr_rank.size();
+    if (nnbr == 0) return;
+
+    int width = 0;
+    for (int k=0; k<narrays; ++k)
+        width += ncomp[k];
+
+    std::size_t total = 0;
+    for (int i=0; i<nnbr; ++i)
+        total += nbr_nodes[i].size() * width;
+    send_buf.resize(total);
+    recv_buf.resize(total);
+    own_buf.resize(shared_nodes.size() * width);
+
+    for (int i=0, p=0; i<nnbr; ++i) {
+        const int_vec &nodes = nbr_nodes[i];
+        for (std::size_t j=0; j<nodes.size(); ++j)
+            for (int k=0; k<narrays; ++k)
+                for (int c=0; c<ncomp[k]; ++c)
+                    send_buf[p++] = a[k][std::size_t(nodes[j]) * ncomp[k] + c];
+    }
+
+    std::vector<MPI_Request> requests(2 * nnbr);
+    for (int i=0, offset=0; i<nnbr; ++i) {
+        const int n = nbr_nodes[i].size() * width;
+        MPI_Irecv(&recv_buf[offset], n, MPI_DOUBLE, nbr_rank[i], tag_shared,
+                  MPI_COMM_WORLD, &requests[i]);
+        MPI_Isend(&send_buf[offset], n, MPI_DOUBLE, nbr_rank[i], tag_shared,
+                  MPI_COMM_WORLD, &requests[nnbr + i]);
+        offset += n;
+    }
+
+    // Meanwhile, the own contributions are moved aside. The sum of a node
+    // starts from 0, then the contributions are added in the order of the
+    // ranks, the same order on all processes sharing the node.
+    for (std::size_t j=0, p=0; j<shared_nodes.size(); ++j)
+        for (int k=0; k<narrays; ++k)
+            for (int c=0; c<ncomp[k]; ++c) {
+                double &x = a[k][std::size_t(shared_nodes[j]) * ncomp[k] + c];
+                own_buf[p++] = x;
+                x = 0;
+            }
+
+    MPI_Waitall(2 * nnbr, requests.data(), MPI_STATUSES_IGNORE);
+
+    bool own_added = false;
+    for (int i=0, p=0; i<=nnbr; ++i) {
+        if (! own_added && (i == nnbr || nbr_rank[i] > rank)) {
+            for (std::size_t j=0, q=0; j<shared_nodes.size(); ++j)
+                for (int k=0; k<narrays; ++k)
+                    for (int c=0; c<ncomp[k]; ++c)
+                        a[k][std::size_t(shared_nodes[j]) * ncomp[k] + c] += own_buf[q++];
+            own_added = true;
+        }
+        if (i == nnbr) break;
+
+        const int_vec &nodes = nbr_nodes[i];
+        for (std::size_t j=0; j<nodes.size(); ++j)
+            for (int k=0; k<narrays; ++k)
+                for (int c=0; c<ncomp[k]; ++c)
+                    a[k][std::size_t(nodes[j]) * ncomp[k] + c] += recv_buf[p++];
+    }
+}
+
+#endif
+
+
+void sum_shared_nodes(const Variables &var, double_vec &a)
+{
+#ifdef USE_MPI
+    if (var.decomp) {
+        double *const arrays[] = {a.data()};
+        const int ncomp[] = {1};
+        sum_shared_in_team(var, arrays, ncomp, 1);
+    }
+#else
+    (void) var;
+    (void) a;
+#endif
+}
+
+
+void sum_shared_nodes(const Variables &var, array_t &a)
+{
+#ifdef USE_MPI
+    if (var.decomp) {
+        double *const arrays[] = {a.data()};
+        const int ncomp[] = {NDIMS};
+        sum_shared_in_team(var, arrays, ncomp, 1);
+    }
+#else
+    (void) var;
+    (void) a;
+#endif
+}
+
+
+void sum_shared_nodes(const Variables &var, double_vec &a, double_vec &b)
+{
+#ifdef USE_MPI
+    if (var.decomp) {
+        double *const arrays[] = {a.data(), b.data()};
+        const int ncomp[] = {1, 1};
+        sum_shared_in_team(var, arrays, ncomp, 2);
+    }
+#else
+    (void) var;
+    (void) a;
+    (void) b;
+#endif
+}
+
+
+void sum_shared_nodes(const Variables &var, double_vec &a, double_vec &b, double_vec &c)
+{
+#ifdef USE_MPI
+    if (var.decomp) {
+        double *const arrays[] = {a.data(), b.data(), c.data()};
+        const int ncomp[] = {1, 1, 1};
+        sum_shared_in_team(var, arrays, ncomp, 3);
+    }
+#else
+    (void) var;
+    (void) a;
+    (void) b;
+    (void) c;
+#endif
+}
+
+
+bool is_root_process()
+{
+#ifdef USE_MPI
+    return comm_rank() == 0;
+#else
+    return true;
+#endif
+}
+
+
+double global_min(const Variables &var, double x)
+{
+#ifdef USE_MPI
+    if (var.decomp)
+        MPI_Allreduce(MPI_IN_PLACE, &x, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+#else
+    (void) var;
+#endif
+    return x;
+}
+
+
+int global_max(const Variables &var, int x)
+{
+#ifdef USE_MPI
+    if (var.decomp)
+        MPI_Allreduce(MPI_IN_PLACE, &x, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+#else
+    (void) var;
+#endif
+    return x;
+}
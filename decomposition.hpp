@@ -0,0 +1,124 @@
+#ifndef DYNEARTHSOL3D_DECOMPOSITION_HPP
+#define DYNEARTHSOL3D_DECOMPOSITION_HPP
+
+#include <vector>
+
+/* Distributed-memory runs with MPI ("make mpi=1"), e.g.
+ *     mpirun -np 4 ./dynearthsol3d model.cfg
+ *
+ * The model is set up (or restarted, or remeshed) by the serial code on the
+ * root process. Its elements are then partitioned by recursive coordinate
+ * bisection of their centers, and each process receives its elements, their
+ * nodes, markers and fields. The kernels run unchanged on the local mesh.
+ * A node on the border of two partitions has a copy on both processes. The
+ * nodal sums over the elements (mass, force, ...) are completed by
+ * sum_shared_nodes(), which adds the contributions of the processes in the
+ * order of their ranks, so that all copies of a node stay bitwise identical.
+ * Global quantities (dt, mesh quality) are reduced over the processes.
+ *
+ * For output and remeshing, the whole model is gathered on the root process,
+ * which then runs the serial code, and the only process writing files. After
+ * remeshing, the new mesh is partitioned again. The root process needs the
+ * memory of the whole model, the other processes only of their partitions.
+ *
+ * In the serial build, the functions at the end are no-ops.
+ */
+
+#ifdef USE_MPI
+
+class Decomposition
+{
+public:
+    explicit Decomposition(const Param &param);
+    ~Decomposition();
+
+    bool is_root() const {return rank == 0;}
+    int get_rank() const {return rank;}
+    int get_nranks() const {return nranks;}
+
+    // The whole model on the root process, the scalars (time, steps, ...)
+    // and timers are copied from var.
+    Variables& global(const Variables &var);
+
+    // Partitions the model in global() on the root process, and replaces the
+    // mesh, markers and fields of var on all processes by their partition.
+    // The derived arrays of var (support, mass, ...) are rebuilt.
+    void scatter(Variables &var);
+
+    // Collects the mesh, markers and fields of var of all processes in
+    // global(). Does nothing if already gathered in this time step.
+    void gather(const Variables &var);
+
+    // Replaces an array of the local nodes (elements) by the array of the
+    // global nodes (elements) on the root process, e.g. the averaged fields
+    // of the output. Unchanged on the other processes.
+    template <class A> void gather_nodes(A &a) const {gather_array(a, node_gid, global_->nnode);}
+    template <class A> void gather_elems(A &a) const {gather_array(a, elem_gid, global_->nelem);}
+
+    // Adds up the contributions of all processes to the shared nodes of the
+    // arrays a[i], each of ncomp[i] values per node.
+    void sum_shared(double *const a[], const int ncomp[], int narrays) const;
+
+private:
+    const Param &param;
+    const int rank, nranks;
+
+    Variables *global_;
+    int gathered_steps;  // -1 if global_ does not hold the current fields
+
+    // root only: the global ids of the nodes and elements of each process,
+    // in ascending order
+    std::vector<int_vec> node_gid, elem_gid;
+
+    // the processes sharing nodes with this one, in ascending order, for
+    // each of them the shared local nodes in ascending global id, and the
+    // union of these nodes
+    int_vec nbr_rank;
+    std::vector<int_vec> nbr_nodes;
+    int_vec shared_nodes;
+    mutable std::vector<double> send_buf, recv_buf, own_buf;
+
+    // the local mesh and markers of a process, sent by the root process
+    struct Part;
+
+    void partition(const Variables &g, int_vec &owner) const;
+    void send_parts(const Variables &g, const int_vec &owner, Variables &var);
+    void receive_part(Variables &var);
+    void install_part(Variables &var, Part &p);
+    void release_global();
+
+    template <typename T>
+    void scatter_rows(const T *g, T *local, std::size_t n, int ncomp,
+                      const std::vector<int_vec> &gid) const;
+    template <typename T>
+    void gather_rows(const T *local, std::size_t n, int ncomp,
+                     const std::vector<int_vec> &gid, T *g) const;
+    template <class A>
+    void scatter_array(const A *g, A &a, const std::vector<int_vec> &gid) const;
+    template <class A>
+    void gather_array(const A &a, A *g, const std::vector<int_vec> &gid) const;
+    template <class A>
+    void gather_array(A &a, const std::vector<int_vec> &gid, int nglobal) const;
+
+    // disable copy
+    Decomposition(const Decomposition&);
+    Decomposition& operator=(const Decomposition&);
+};
+
+#endif
+
+
+// sum over the processes of the element contributions to the shared nodes
+void sum_shared_nodes(const Variables &var, double_vec &a);
+void sum_shared_nodes(const Variables &var, array_t &a);
+void sum_shared_nodes(const Variables &var, double_vec &a, double_vec &b);
+void sum_shared_nodes(const Variables &var, double_vec &a, double_vec &b, double_vec &c);
+
+// true on the root process, which writes the files, and in the serial build
+bool is_root_process();
+
+// min/max over the processes
+double global_min(const Variables &var, double x);
+int global_max(const Variables &var, int x);
+
+#endif
@@ -4,21 +4,34 @@
 #include <omp.h>
 #endif
 
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
 #include "constants.hpp"
 #include "parameters.hpp"
 #include "bc.hpp"
 #include "binaryio.hpp"
+#include "decomposition.hpp"
 #include "fields.hpp"
 #include "geometry.hpp"
+#include "hwcounters.hpp"
 #include "ic.hpp"
 #include "input.hpp"
 #include "matprops.hpp"
 #include "markerset.hpp"
+#include "memory.hpp"
 #include "mesh.hpp"
 #include "output.hpp"
 #include "phasechanges.hpp"
+#include "phase-graph.hpp"
 #include "remeshing.hpp"
 #include "rheology.hpp"
+#include "roofline.hpp"
+#include "scaling.hpp"
+#include "status.hpp"
+#include "team.hpp"
+#include "timers.hpp"
 
 
 void init(const Param& param, Variables& var)
@@ -30,7 +43,7 @@ void init(const Param& param, Variables& var)
     create_boundary_nodes(var);
     create_boundary_facets(var);
     create_support(var);
-    create_elem_groups(var);
+    create_elem_groups(param, var);
     create_elemmarkers(param, var);
     create_markers(param, var);
 
@@ -41,7 +54,7 @@ void init(const Param& param, Variables& var)
     compute_mass(param, var.egroups, *var.connectivity, *var.volume, *var.mat,
                  var.max_vbc_val, *var.volume_n, *var.mass, *var.tmass);
     compute_shape_fn(*var.coord, *var.connectivity, *var.volume, var.egroups,
-                     *var.shpdx, *var.shpdy, *var.shpdz);
+                     *var.shpd);
 
     apply_vbcs(param, var, *var.vel);
     // temperature should be init'd before stress and strain
@@ -60,10 +73,20 @@ void restart(const Param& param, Variables& var)
         char filename[256];
         std::snprintf(filename, 255, "%s.info", param.sim.restarting_from_modelname.c_str());
         std::FILE *f = std::fopen(filename, "r");
+        if (f == NULL) {
+            std::cerr << "Error: cannot open file: " << filename << '\n';
+            std::exit(2);
+        }
         int frame, steps, nnode, nelem, nseg;
+        char line[256];
         while (1) {
-            int n = std::fscanf(f, "%d %d %*f %*f %*f %d %d %d\n",
+            int n = 0;
+            if (std::fgets(line, 255, f) != NULL) {
+                // skipping comment lines
+                if (line[0] == '#') continue;
+                n = std::sscanf(line, "%d %d %*f %*f %*f %d %d %d",
                                 &frame, &steps, &nnode, &nelem, &nseg);
+            }
             if (n != 5) {
                 std::cerr << "Error: reading info file: " << filename << '\n';
                 std::exit(2);
@@ -80,16 +103,30 @@ void restart(const Param& param, Variables& var)
         std::fclose(f);
     }
 
-    char filename_save[256];
-    std::snprintf(filename_save, 255, "%s.save.%06d",
-                  param.sim.restarting_from_modelname.c_str(), param.sim.restarting_from_frame);
-    BinaryInput bin_save(filename_save);
+    // The frames are either in a container or in separate files
+    char filename_container[256];
+    std::snprintf(filename_container, sizeof(filename_container), "%s.frames",
+                  param.sim.restarting_from_modelname.c_str());
+    const bool from_container = is_container_file(filename_container);
+
+    char filename_save[256], group_save[32];
+    std::snprintf(group_save, sizeof(group_save), "save.%06d", param.sim.restarting_from_frame);
+    if (from_container)
+        std::snprintf(filename_save, sizeof(filename_save), "%s", filename_container);
+    else
+        std::snprintf(filename_save, sizeof(filename_save), "%s.%s",
+                      param.sim.restarting_from_modelname.c_str(), group_save);
+    BinaryInput bin_save(filename_save, (from_container) ? group_save : NULL);
     std::cout << "  Reading " << filename_save << "...\n";
 
-    char filename_chkpt[256];
-    std::snprintf(filename_chkpt, 255, "%s.chkpt.%06d",
-                  param.sim.restarting_from_modelname.c_str(), param.sim.restarting_from_frame);
-    BinaryInput bin_chkpt(filename_chkpt);
+    char filename_chkpt[256], group_chkpt[32];
+    std::snprintf(group_chkpt, sizeof(group_chkpt), "chkpt.%06d", param.sim.restarting_from_frame);
+    if (from_container)
+        std::snprintf(filename_chkpt, sizeof(filename_chkpt), "%s", filename_container);
+    else
+        std::snprintf(filename_chkpt, sizeof(filename_chkpt), "%s.%s",
+                      param.sim.restarting_from_modelname.c_str(), group_chkpt);
+    BinaryInput bin_chkpt(filename_chkpt, (from_container) ? group_chkpt : NULL);
     std::cout << "  Reading " << filename_chkpt << "...\n";
 
     //
@@ -112,62 +149,322 @@ void restart(const Param& param, Variables& var)
         // bin_chkpt.read_array(*var.regattr, "regattr", var.nelem);
     }
 
-    create_boundary_flags(var);
-    create_boundary_nodes(var);
-    create_boundary_facets(var);
-    create_support(var);
-    create_elem_groups(var);
+    // Only cheap allocations are done serially. allocate_variables() needs
+    // elemmarkers, since MatProps keeps a reference to it.
+    create_elem_groups(param, var);
     create_elemmarkers(param, var);
+    allocate_variables(param, var);
 
-    // Replacing create_markers()
-    var.markerset = new MarkerSet(param, var, bin_chkpt);
+    //
+    // The derived structures are independent of each other and of the
+    // field variables, building them concurrently while the arrays are
+    // being read from the two files. Each file is read by one section only.
+    //
+    #pragma omp parallel sections default(none) \
+        shared(param, var, bin_save, bin_chkpt)
+    {
+        #pragma omp section
+        {
+            create_boundary_flags(var);
+            create_boundary_nodes(var);
+            create_boundary_facets(var);
+        }
 
-    allocate_variables(param, var);
+        #pragma omp section
+        {
+            create_support(var);
+        }
 
+        #pragma omp section
+        {
+            // Replacing create_markers()
+            var.markerset = new MarkerSet(param, var, bin_chkpt);
+
+            bin_chkpt.read_array(*var.volume_old, "volume_old");
+
+            double_vec tmp(2);
+            bin_chkpt.read_array(tmp, "time compensation_pressure");
+            var.time = tmp[0];
+            var.compensation_pressure = tmp[1];
+        }
+
+        #pragma omp section
+        {
+            // Initializing field variables
+            bin_save.read_array(*var.vel, "velocity");
+            bin_save.read_array(*var.temperature, "temperature");
+            bin_save.read_array(*var.strain_rate, "strain-rate");
+            bin_save.read_array(*var.strain, "strain");
+            bin_save.read_array(*var.stress, "stress");
+            bin_save.read_array(*var.plstrain, "plastic strain");
+
+            // the next two fields are not needed for restarting
+            bin_save.read_array(*var.elquality, "mesh quality");
+            bin_save.read_array(*var.force, "force");
+        }
+    }
+
+    // These kernels are parallelized internally. compute_mass() needs
+    // the material types from the markers and the temperature.
     compute_volume(*var.coord, *var.connectivity, *var.volume);
-    bin_chkpt.read_array(*var.volume_old, "volume_old");
     compute_mass(param, var.egroups, *var.connectivity, *var.volume, *var.mat,
                  var.max_vbc_val, *var.volume_n, *var.mass, *var.tmass);
     compute_shape_fn(*var.coord, *var.connectivity, *var.volume, var.egroups,
-                     *var.shpdx, *var.shpdy, *var.shpdz);
-
-    apply_vbcs(param, var, *var.vel);
+                     *var.shpd);
 
-    // Initializing field variables
-    {
-        bin_save.read_array(*var.vel, "velocity");
-        bin_save.read_array(*var.temperature, "temperature");
-        bin_save.read_array(*var.strain_rate, "strain-rate");
-        bin_save.read_array(*var.strain, "strain");
-        bin_save.read_array(*var.stress, "stress");
-        bin_save.read_array(*var.plstrain, "plastic strain");
-    }
-
-    // Misc. items
-    {
-        double_vec tmp(2);
-        bin_chkpt.read_array(tmp, "time compensation_pressure");
-        var.time = tmp[0];
-        var.compensation_pressure = tmp[1];
-
-        // the next two fields are not needed for restarting
-        bin_save.read_array(*var.elquality, "mesh quality");
-        bin_save.read_array(*var.force, "force");
-    }
+    // apply_vbcs() is not needed, the restored velocity already satisfies
+    // the boundary conditions
 }
 
 
 void update_mesh(const Param& param, Variables& var)
 {
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(param, var)
+        {
+            TeamScope team;
+            update_mesh(param, var);
+        }
+        return;
+    }
+
     update_coordinate(var, *var.coord);
+    #pragma omp barrier
     surface_processes(param, var, *var.coord);
-
+    #pragma omp single
     var.volume->swap(*var.volume_old);
+
     compute_volume(*var.coord, *var.connectivity, *var.volume);
+    #pragma omp barrier
     compute_mass(param, var.egroups, *var.connectivity, *var.volume, *var.mat,
                  var.max_vbc_val, *var.volume_n, *var.mass, *var.tmass);
+    sum_shared_nodes(var, *var.volume_n, *var.mass, *var.tmass);
     compute_shape_fn(*var.coord, *var.connectivity, *var.volume, var.egroups,
-                     *var.shpdx, *var.shpdy, *var.shpdz);
+                     *var.shpd);
+}
+
+
+namespace {
+
+// the phases of a time step, as used in PhaseGraph
+
+void phase_temperature(const Param& param, Variables& var)
+{
+    update_temperature(param, var, *var.temperature, *var.ntmp);
+}
+
+
+void phase_strain_rate(const Param&, Variables& var)
+{
+    update_strain_rate(var, *var.strain_rate);
+}
+
+
+void phase_dvoldt(const Param& param, Variables& var)
+{
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(param, var)
+        {
+            TeamScope team;
+            phase_dvoldt(param, var);
+        }
+        return;
+    }
+
+    compute_dvoldt(var, *var.ntmp);
+    #pragma omp barrier
+    compute_edvoldt(var, *var.ntmp, *var.edvoldt);
+}
+
+
+void phase_stress(const Param&, Variables& var)
+{
+    update_stress(var, *var.stress, *var.strain, *var.plstrain,  *var.delta_plstrain, *var.strain_rate);
+}
+
+
+void phase_force(const Param& param, Variables& var)
+{
+    update_force(param, var, *var.force);
+}
+
+
+void phase_velocity(const Param&, Variables& var)
+{
+    update_velocity(var, *var.vel);
+}
+
+
+void phase_bc(const Param& param, Variables& var)
+{
+    apply_vbcs(param, var, *var.vel);
+}
+
+
+void phase_mesh_update(const Param& param, Variables& var)
+{
+    update_mesh(param, var);
+}
+
+
+void phase_rotate_stress(const Param&, Variables& var)
+{
+    rotate_stress(var, *var.stress, *var.strain);
+}
+
+
+void phase_dt(const Param& param, Variables& var)
+{
+    var.dt = compute_dt(param, var);
+}
+
+
+void phase_phase_changes(const Param& param, Variables& var)
+{
+    phase_changes(param, var, *var.markerset, *var.elemmarkers);
+}
+
+
+class AveragingPhase : public PhaseFunc
+{
+public:
+    AveragingPhase(Output &output, Variables &var) : output(output), var(var) {}
+    void operator()() {output.average_fields(var);}
+private:
+    Output &output;
+    Variables &var;
+};
+
+
+void add_time_step(const Param& param, Variables& var, PhaseGraph& graph)
+{
+    // advancing the solution by one time step, without output or remeshing
+    var.steps ++;
+    var.time += var.dt;
+
+    typedef PhaseGraph G;
+
+    if (param.control.has_thermal_diffusion)
+        graph.add(PhaseTimers::temperature,
+                  G::temperature | G::coord | G::shpd | G::volume | G::markers | G::mass | G::dt,
+                  G::temperature | G::ntmp, phase_temperature);
+
+    graph.add(PhaseTimers::strain_rate, G::vel | G::shpd, G::strain_rate, phase_strain_rate);
+    graph.add(PhaseTimers::dvoldt, G::strain_rate | G::volume | G::mass,
+              G::ntmp | G::edvoldt, phase_dvoldt);
+    graph.add(PhaseTimers::stress,
+              G::strain_rate | G::edvoldt | G::temperature | G::markers | G::dt | G::volume,
+              G::stress | G::plstrain | G::strain_rate, phase_stress);
+    graph.add(PhaseTimers::force,
+              G::stress | G::coord | G::shpd | G::volume | G::mass | G::vel | G::temperature | G::markers,
+              G::force, phase_force);
+    graph.add(PhaseTimers::velocity, G::force | G::mass | G::dt, G::vel, phase_velocity);
+    graph.add(PhaseTimers::bc, G::coord, G::vel, phase_bc);
+    graph.add(PhaseTimers::mesh_update, G::vel | G::dt | G::temperature | G::markers,
+              G::coord | G::volume | G::mass | G::shpd, phase_mesh_update);
+
+    // elastic stress/strain are objective (frame-indifferent)
+    if (var.mat->rheol_type & MatProps::rh_elastic)
+        graph.add(PhaseTimers::rotate_stress, G::vel | G::shpd | G::dt, G::stress,
+                  phase_rotate_stress);
+
+    // dt computation is expensive, and dt only changes slowly
+    // don't have to do it every time step
+    if (var.steps % 10 == 0)
+        graph.add(PhaseTimers::dt, G::coord | G::volume | G::temperature | G::markers,
+                  G::dt, phase_dt, true);
+
+    // ditto for phase changes
+    if (var.steps % 10 == 0 && param.mat.nmat > 1 && param.mat.phase_change_option != 0)
+        graph.add(PhaseTimers::phase_changes, G::stress | G::temperature | G::coord | G::plstrain,
+                  G::markers, phase_phase_changes);
+}
+
+
+void add_loop_step(const Param& param, Variables& var, PhaseGraph& graph, PhaseFunc& averaging)
+{
+    add_time_step(param, var, graph);
+
+    // the averaging only reads the new fields, and can overlap dt and
+    // phase changes
+    if (param.sim.output_averaged_fields)
+        graph.add(PhaseTimers::averaging,
+                  PhaseGraph::coord | PhaseGraph::stress | PhaseGraph::plstrain,
+                  PhaseGraph::averages, averaging, true);
+}
+
+
+bool is_output_due(const Param& param, const Variables& var, double starting_time,
+                   double starting_step, int next_regular_frame)
+{
+    // When output_averaged_fields in turned on, the output cannot be
+    // done at arbitrary time steps.
+    return (! param.sim.output_averaged_fields || (var.steps % param.sim.output_averaged_fields == 0)) &&
+        (((var.steps - starting_step) == next_regular_frame * param.sim.output_step_interval) ||
+         ((var.time - starting_time) > next_regular_frame * param.sim.output_time_interval_in_yr * YEAR2SEC));
+}
+
+
+void run_steps_in_team(const Param& param, Variables& var, PhaseGraph& graph, PhaseFunc& averaging,
+                       const StatusFile& status, double starting_time, double starting_step,
+                       int next_regular_frame, bool is_first_step_timed)
+{
+    /* Time steps in one parallel region (sim.has_persistent_team), until a
+     * step after which the serial part of the time loop has something to do,
+     * i.e. output, mesh quality check, the end of the run, or writing the
+     * time to the first step after restarting.
+     */
+    bool is_serial_step = false;
+
+    #pragma omp parallel default(none)                                    \
+        shared(param, var, graph, averaging, status, starting_time, starting_step, \
+               next_regular_frame, is_first_step_timed, is_serial_step)
+    {
+        TeamScope team;
+        do {
+            #pragma omp single
+            add_loop_step(param, var, graph, averaging);
+
+            graph.run();
+
+            #pragma omp single
+            is_serial_step = is_first_step_timed ||
+                (param.sim.topography_step_interval &&
+                 var.steps % param.sim.topography_step_interval == 0) ||
+                is_output_due(param, var, starting_time, starting_step, next_regular_frame) ||
+                var.steps % param.mesh.quality_check_step_interval == 0 ||
+                status.is_due(var) ||
+                var.steps >= param.sim.max_steps ||
+                var.time > param.sim.max_time_in_yr * YEAR2SEC;
+        } while (! is_serial_step);
+    }
+}
+
+} // anonymous namespace
+
+
+void time_step(const Param& param, Variables& var)
+{
+    // advancing the solution by one time step, without output or remeshing
+    PhaseGraph graph(param, var, param.sim.has_concurrent_phases);
+    add_time_step(param, var, graph);
+    graph.run();
+}
+
+
+void remesh_model(const Param& param, Variables& var, int bad_quality, int bad_quality_index)
+{
+#ifdef USE_MPI
+    // the whole model is remeshed on the root process and partitioned again
+    var.decomp->gather(var);
+    if (var.decomp->is_root())
+        remesh(param, var.decomp->global(var), bad_quality, bad_quality_index);
+    var.decomp->scatter(var);
+#else
+    remesh(param, var, bad_quality, bad_quality_index);
+#endif
 }
 
 
@@ -178,6 +475,13 @@ int main(int argc, const char* argv[])
     start_time = omp_get_wtime();
 #endif
 
+#ifdef USE_MPI
+    MPI_Init(NULL, NULL);
+    // only the root process prints the progress
+    if (! is_root_process())
+        std::cout.rdbuf(NULL);
+#endif
+
     //
     // read command line
     //
@@ -190,10 +494,21 @@ int main(int argc, const char* argv[])
     Param param;
     get_input_parameters(argv[1], param);
 
+    if (param.profiling.scaling_steps > 0 && run_scaling_policies(param, argv))
+        return 0;
+
     //
     // run simulation
     //
     static Variables var; // declared as static to silence valgrind's memory leak detection
+    var.timers = new PhaseTimers();
+    var.memory = new MemoryUsage();
+    if (param.profiling.has_hardware_counters)
+        hw_counters = HWCounters::create();
+    if (param.profiling.has_roofline_report) {
+        var.roofline = new Roofline(param);
+        var.roofline->measure_machine();
+    }
     Output output(param, start_time,
                   (param.sim.is_restarting) ? param.sim.restarting_from_frame : 0);
     var.time = 0;
@@ -204,84 +519,117 @@ int main(int argc, const char* argv[])
     else
         var.max_vbc_val = param.control.characteristic_speed;
 
-    if (! param.sim.is_restarting) {
-        init(param, var);
-    }
-    else {
-        restart(param, var);
+#ifdef USE_MPI
+    // the model is set up on the root process, then partitioned
+    var.decomp = new Decomposition(param);
+    Variables &model = var.decomp->global(var);
+#else
+    Variables &model = var;
+#endif
+
+    if (is_root_process()) {
+        if (! param.sim.is_restarting) {
+            init(param, model);
+            create_remesh_log(param);
+        }
+        else {
+            restart(param, model);
+        }
     }
 
+#ifdef USE_MPI
+    var.decomp->scatter(var);
+#endif
+
     var.dt = compute_dt(param, var);
+
+    if (param.profiling.scaling_steps > 0) {
+        scaling_study(param, var, time_step);
+        return 0;
+    }
+
     output.write(var, false);
 
     double starting_time = var.time; // var.time & var.steps might be set in restart()
     double starting_step = var.steps;
     int next_regular_frame = 1;  // excluding frames due to output_during_remeshing
+    bool is_first_step_timed = param.sim.is_restarting;  // written to the info file
+    StatusFile status(param, var);
+
+    PhaseGraph graph(param, var, param.sim.has_concurrent_phases);
+    AveragingPhase averaging(output, var);
 
     std::cout << "Starting simulation...\n";
     do {
-        var.steps ++;
-        var.time += var.dt;
-
-        if (param.control.has_thermal_diffusion)
-            update_temperature(param, var, *var.temperature, *var.ntmp);
-
-        update_strain_rate(var, *var.strain_rate);
-        compute_dvoldt(var, *var.ntmp);
-        compute_edvoldt(var, *var.ntmp, *var.edvoldt);
-        update_stress(var, *var.stress, *var.strain, *var.plstrain,  *var.delta_plstrain, *var.strain_rate);
-        update_force(param, var, *var.force);
-        update_velocity(var, *var.vel);
-        apply_vbcs(param, var, *var.vel);
-        update_mesh(param, var);
-
-        // elastic stress/strain are objective (frame-indifferent)
-        if (var.mat->rheol_type & MatProps::rh_elastic)
-            rotate_stress(var, *var.stress, *var.strain);
+        if (param.sim.has_persistent_team)
+            run_steps_in_team(param, var, graph, averaging, status,
+                              starting_time, starting_step, next_regular_frame,
+                              is_first_step_timed);
+        else {
+            add_loop_step(param, var, graph, averaging);
+            graph.run();
+        }
 
-        // dt computation is expensive, and dt only changes slowly
-        // don't have to do it every time step
-        if (var.steps % 10 == 0) var.dt = compute_dt(param, var);
+        if (is_first_step_timed) {
+            output.write_time_to_first_step();
+            is_first_step_timed = false;
+        }
 
-        // ditto for phase changes
-        if (var.steps % 10 == 0) phase_changes(param, var, *var.markerset, *var.elemmarkers);
+        PhaseTimers &timers = *var.timers;
 
-        if (param.sim.output_averaged_fields)
-            output.average_fields(var);
+        if (param.sim.topography_step_interval &&
+            var.steps % param.sim.topography_step_interval == 0)
+            TIMED(timers, output, output.write_topography(var));
 
-	if ((! param.sim.output_averaged_fields || (var.steps % param.sim.output_averaged_fields == 0)) &&
-            // When output_averaged_fields in turned on, the output cannot be
-            // done at arbitrary time steps.
-            (((var.steps - starting_step) == next_regular_frame * param.sim.output_step_interval) ||
-             ((var.time - starting_time) > next_regular_frame * param.sim.output_time_interval_in_yr * YEAR2SEC)) ) {
+        if (is_output_due(param, var, starting_time, starting_step, next_regular_frame)) {
 
             if (next_regular_frame % param.sim.checkpoint_frame_interval == 0)
-                output.write_checkpoint(var);
+                TIMED(timers, output, output.write_checkpoint(var));
 
-            output.write(var);
+            TIMED(timers, output, output.write(var));
 
             next_regular_frame ++;
         }
 
         if (var.steps % param.mesh.quality_check_step_interval == 0) {
             int quality_is_bad, bad_quality_index;
-            quality_is_bad = bad_mesh_quality(param, var, bad_quality_index);
+            TIMED(timers, quality_check, quality_is_bad = bad_mesh_quality(param, var, bad_quality_index));
             if (quality_is_bad) {
 
                 if (param.sim.has_output_during_remeshing) {
-                    output.write(var, false);
+                    TIMED(timers, output, output.write(var, false));
                 }
 
-                remesh(param, var, quality_is_bad);
+                TIMED(timers, remesh, remesh_model(param, var, quality_is_bad, bad_quality_index));
+                status.remeshed(var);
 
                 if (param.sim.has_output_during_remeshing) {
-                    output.write(var, false);
+                    TIMED(timers, output, output.write(var, false));
                 }
             }
         }
 
+        if (status.is_due(var))
+            TIMED(timers, output, status.write(var));
+
     } while (var.steps < param.sim.max_steps && var.time <= param.sim.max_time_in_yr * YEAR2SEC);
 
+    if (param.sim.status_step_interval)
+        status.write(var, "finished");
+
+    if (var.roofline) {
+        // the steps after the last frame
+        double t[PhaseTimers::nphases];
+        var.timers->sum(t);
+        var.timers->reset();
+        var.roofline->add(var, t);
+        if (is_root_process()) var.roofline->write(param.sim.modelname);
+    }
+
     std::cout << "Ending simulation.\n";
+#ifdef USE_MPI
+    delete var.decomp;
+    MPI_Finalize();
+#endif
     return 0;
 }
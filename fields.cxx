@@ -2,7 +2,10 @@
 #include "constants.hpp"
 #include "parameters.hpp"
 #include "bc.hpp"
+#include "decomposition.hpp"
+#include "hwcounters.hpp"
 #include "matprops.hpp"
+#include "team.hpp"
 #include "utils.hpp"
 #include "fields.hpp"
 
@@ -19,73 +22,80 @@ void allocate_variables(const Param &param, Variables& var)
     var.mass = new double_vec(n);
     var.tmass = new double_vec(n);
 
-    var.edvoldt = new double_vec(e);
+    var.edvoldt = new lowp_vec(e);
 
     {
         // these fields are reallocated during remeshing interpolation
         var.temperature = new double_vec(n);
         var.plstrain = new double_vec(e);
-        var.delta_plstrain = new double_vec(e);
+        var.delta_plstrain = new lowp_vec(e);
         var.vel = new array_t(n, 0);
         var.strain = new tensor_t(e, 0);
         var.stress = new tensor_t(e, 0);
     }
 
     var.ntmp= new double_vec(n);
-    var.elquality= new double_vec(e);
+    var.elquality= new lowp_vec(e);
 
     var.force = new array_t(n, 0);
 
     var.strain_rate = new tensor_t(e, 0);
 
-    var.shpdx = new shapefn(e);
-    if (NDIMS == 3) var.shpdy = new shapefn(e);
-    var.shpdz = new shapefn(e);
+    var.shpd = new ShapeDeriv(e, *var.coord, *var.connectivity, *var.volume);
 
     var.mat = new MatProps(param, var);
 }
 
 
+namespace {
+
+    // Resize in place and zero the content, as if newly allocated. The
+    // buffer is kept if the new size is similar, see Array2D::resize().
+    template <typename T, typename A>
+    void resize_zeroed(std::vector<T,A> &a, int n)
+    {
+        if (n > static_cast<int>(a.capacity()))
+            a.reserve(n + n / 16);
+        else if (n < static_cast<int>(a.capacity()) / 2)
+            std::vector<T,A>(n).swap(a);
+        a.resize(n);
+        aligned::fill(a.data(), a.size(), T(0));
+    }
+
+
+    template <int N>
+    void resize_zeroed(Array2D<double,N> &a, int n)
+    {
+        a.resize(n);
+        aligned::fill(a.data(), a.num_elements(), 0.0);
+    }
+
+}
+
+
 void reallocate_variables(const Param& param, Variables& var)
 {
     const int n = var.nnode;
     const int e = var.nelem;
 
-    delete var.volume;
-    delete var.volume_old;
-    delete var.volume_n;
-    var.volume = new double_vec(e);
-    var.volume_old = new double_vec(e);
-    var.volume_n = new double_vec(n);
+    resize_zeroed(*var.volume, e);
+    resize_zeroed(*var.volume_old, e);
+    resize_zeroed(*var.volume_n, n);
 
-    delete var.mass;
-    delete var.tmass;
-    var.mass = new double_vec(n);
-    var.tmass = new double_vec(n);
+    resize_zeroed(*var.mass, n);
+    resize_zeroed(*var.tmass, n);
 
-    delete var.edvoldt;
-    var.edvoldt = new double_vec(e);
+    resize_zeroed(*var.edvoldt, e);
 
-    delete var.ntmp;
-    var.ntmp = new double_vec(n);
+    resize_zeroed(*var.ntmp, n);
 
-    delete var.elquality;
-    var.elquality = new double_vec(e);
+    resize_zeroed(*var.elquality, e);
 
-    delete var.force;
-    var.force = new array_t(n, 0);
+    resize_zeroed(*var.force, n);
 
-    delete var.strain_rate;
-    var.strain_rate = new tensor_t(e, 0);
+    resize_zeroed(*var.strain_rate, e);
 
-    delete var.shpdx;
-    delete var.shpdz;
-    var.shpdx = new shapefn(e);
-    if (NDIMS == 3) {
-        delete var.shpdy;
-        var.shpdy = new shapefn(e);
-    }
-    var.shpdz = new shapefn(e);
+    var.shpd->resize(e);
 
     delete var.mat;
     var.mat = new MatProps(param, var);
@@ -95,7 +105,19 @@ void reallocate_variables(const Param& param, Variables& var)
 void update_temperature(const Param &param, const Variables &var,
                         double_vec &temperature, double_vec &tdot)
 {
-    tdot.assign(var.nnode, 0);
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(param, var, temperature, tdot)
+        {
+            TeamScope team;
+            update_temperature(param, var, temperature, tdot);
+        }
+        return;
+    }
+
+    #pragma omp for
+    for (int n=0; n<var.nnode; ++n)
+        tdot[n] = 0;
 
     class ElemFunc_temperature : public ElemFunc
     {
@@ -113,11 +135,12 @@ void update_temperature(const Param &param, const Variables &var,
 
             const int *conn = (*var.connectivity)[e];
             double kv = var.mat->k(e) *  (*var.volume)[e]; // thermal conductivity * volumn
-            const double *shpdx = (*var.shpdx)[e];
+            const ShapeDeriv::elem shp(*var.shpd, e);
+            ShapeDeriv::const_row shpdx = shp[0];
 #ifdef THREED
-            const double *shpdy = (*var.shpdy)[e];
+            ShapeDeriv::const_row shpdy = shp[1];
 #endif
-            const double *shpdz = (*var.shpdz)[e];
+            ShapeDeriv::const_row shpdz = shp[NDIMS-1];
             for (int i=0; i<NODES_PER_ELEM; ++i) {
                 for (int j=0; j<NODES_PER_ELEM; ++j) {
 #ifdef THREED
@@ -140,10 +163,11 @@ void update_temperature(const Param &param, const Variables &var,
         }
     } elemf(var, temperature, tdot);
 
-    loop_all_elem(var.egroups, elemf);
+    COUNTED(temperature_elem, var.nelem, loop_all_elem(var.egroups, elemf));
+    sum_shared_nodes(var, tdot);
 
-     #pragma omp parallel for default(none)      \
-         shared(var, param, tdot, temperature)
+    HW_COUNTED(temperature_node, var.nnode);
+     #pragma omp for nowait
      for (int n=0; n<var.nnode; ++n) {
         if ((*var.bcflag)[n] & BOUNDZ1)
             temperature[n] = param.bc.surface_temperature;
@@ -155,14 +179,25 @@ void update_temperature(const Param &param, const Variables &var,
 
 void update_strain_rate(const Variables& var, tensor_t& strain_rate)
 {
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(var, strain_rate)
+        {
+            TeamScope team;
+            update_strain_rate(var, strain_rate);
+        }
+        return;
+    }
+
+    HW_COUNTED(strain_rate, var.nelem);
     double *v[NODES_PER_ELEM];
 
-    #pragma omp parallel for default(none) \
-        shared(var, strain_rate) private(v)
+    #pragma omp for nowait
     for (int e=0; e<var.nelem; ++e) {
         const int *conn = (*var.connectivity)[e];
-        const double *shpdx = (*var.shpdx)[e];
-        const double *shpdz = (*var.shpdz)[e];
+        const ShapeDeriv::elem shp(*var.shpd, e);
+        ShapeDeriv::const_row shpdx = shp[0];
+        ShapeDeriv::const_row shpdz = shp[NDIMS-1];
         double *s = (*var.strain_rate)[e];
 
         for (int i=0; i<NODES_PER_ELEM; ++i)
@@ -175,7 +210,7 @@ void update_strain_rate(const Variables& var, tensor_t& strain_rate)
             s[n] += v[i][0] * shpdx[i];
 
 #ifdef THREED
-        const double *shpdy = (*var.shpdy)[e];
+        ShapeDeriv::const_row shpdy = shp[1];
         // YY component
         n = 1;
         s[n] = 0;
@@ -228,8 +263,8 @@ static void apply_damping(const Param& param, const Variables& var, array_t& for
     double* ff = force.data();
     const double* v = var.vel->data();
     const double small_vel = 1e-13;
-    #pragma omp parallel for default(none)          \
-        shared(var, param, ff, v)
+    HW_COUNTED(damping, var.nnode);
+    #pragma omp for nowait
     for (int i=0; i<var.nnode*NDIMS; ++i) {
         if (std::fabs(v[i]) > small_vel) {
             ff[i] -= param.control.damping_factor * std::copysign(ff[i], v[i]);
@@ -240,7 +275,20 @@ static void apply_damping(const Param& param, const Variables& var, array_t& for
 
 void update_force(const Param& param, const Variables& var, array_t& force)
 {
-    std::fill_n(force.data(), var.nnode*NDIMS, 0);
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(param, var, force)
+        {
+            TeamScope team;
+            update_force(param, var, force);
+        }
+        return;
+    }
+
+    double* ff = force.data();
+    #pragma omp for
+    for (int i=0; i<var.nnode*NDIMS; ++i)
+        ff[i] = 0;
 
     class ElemFunc_force : public ElemFunc
     {
@@ -254,11 +302,12 @@ void update_force(const Param& param, const Variables& var, array_t& force)
         void operator()(int e)
         {
             const int *conn = (*var.connectivity)[e];
-            const double *shpdx = (*var.shpdx)[e];
+            const ShapeDeriv::elem shp(*var.shpd, e);
+            ShapeDeriv::const_row shpdx = shp[0];
 #ifdef THREED
-            const double *shpdy = (*var.shpdy)[e];
+            ShapeDeriv::const_row shpdy = shp[1];
 #endif
-            const double *shpdz = (*var.shpdz)[e];
+            ShapeDeriv::const_row shpdz = shp[NDIMS-1];
             double *s = (*var.stress)[e];
             double vol = (*var.volume)[e];
 
@@ -280,9 +329,12 @@ void update_force(const Param& param, const Variables& var, array_t& force)
         }
     } elemf(var, force, param.control.gravity);
 
-    loop_all_elem(var.egroups, elemf);
+    COUNTED(force_elem, var.nelem, loop_all_elem(var.egroups, elemf));
 
+    #pragma omp single
     apply_stress_bcs(param, var, force);
+    // damping is not linear in the force, the sum must be complete
+    sum_shared_nodes(var, force);
 
     if (param.control.is_quasi_static) {
         apply_damping(param, var, force);
@@ -292,12 +344,22 @@ void update_force(const Param& param, const Variables& var, array_t& force)
 
 void update_velocity(const Variables& var, array_t& vel)
 {
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(var, vel)
+        {
+            TeamScope team;
+            update_velocity(var, vel);
+        }
+        return;
+    }
+
     const double* m = &(*var.mass)[0];
     // flatten 2d arrays to simplify indexing
     const double* f = var.force->data();
     double* v = vel.data();
-    #pragma omp parallel for default(none) \
-        shared(var, m, f, v)
+    HW_COUNTED(velocity, var.nnode);
+    #pragma omp for nowait
     for (int i=0; i<var.nnode*NDIMS; ++i) {
         int n = i / NDIMS;
         v[i] += var.dt * f[i] / m[n];
@@ -307,11 +369,21 @@ void update_velocity(const Variables& var, array_t& vel)
 
 void update_coordinate(const Variables& var, array_t& coord)
 {
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(var, coord)
+        {
+            TeamScope team;
+            update_coordinate(var, coord);
+        }
+        return;
+    }
+
     double* x = var.coord->data();
     const double* v = var.vel->data();
 
-    #pragma omp parallel for default(none) \
-        shared(var, x, v)
+    HW_COUNTED(coordinate, var.nnode);
+    #pragma omp for nowait
     for (int i=0; i<var.nnode*NDIMS; ++i) {
         x[i] += v[i] * var.dt;
     }
@@ -371,8 +443,18 @@ void rotate_stress(const Variables &var, tensor_t &stress, tensor_t &strain)
     // sj[4] = dt * ( s0 * w4 - s2 * w4 + s3 * w5 - s5 * w3)
     // sj[5] = dt * ( s1 * w5 - s2 * w5 + s3 * w4 + s4 * w3)
 
-    #pragma omp parallel for default(none) \
-        shared(var, stress, strain)
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(var, stress, strain)
+        {
+            TeamScope team;
+            rotate_stress(var, stress, strain);
+        }
+        return;
+    }
+
+    HW_COUNTED(rotate_stress, var.nelem);
+    #pragma omp for nowait
     for (int e=0; e<var.nelem; ++e) {
         const int *conn = (*var.connectivity)[e];
 
@@ -380,9 +462,10 @@ void rotate_stress(const Variables &var, tensor_t &stress, tensor_t &strain)
 
         double w3, w4, w5;
         {
-            const double *shpdx = (*var.shpdx)[e];
-            const double *shpdy = (*var.shpdy)[e];
-            const double *shpdz = (*var.shpdz)[e];
+            const ShapeDeriv::elem shp(*var.shpd, e);
+            ShapeDeriv::const_row shpdx = shp[0];
+            ShapeDeriv::const_row shpdy = shp[1];
+            ShapeDeriv::const_row shpdz = shp[NDIMS-1];
 
             double *v[NODES_PER_ELEM];
             for (int i=0; i<NODES_PER_ELEM; ++i)
@@ -408,8 +491,9 @@ void rotate_stress(const Variables &var, tensor_t &stress, tensor_t &strain)
 
         double w2;
         {
-            const double *shpdx = (*var.shpdx)[e];
-            const double *shpdz = (*var.shpdz)[e];
+            const ShapeDeriv::elem shp(*var.shpd, e);
+            ShapeDeriv::const_row shpdx = shp[0];
+            ShapeDeriv::const_row shpdz = shp[NDIMS-1];
 
             double *v[NODES_PER_ELEM];
             for (int i=0; i<NODES_PER_ELEM; ++i)
@@ -5,7 +5,10 @@
 
 #include "constants.hpp"
 #include "parameters.hpp"
+#include "decomposition.hpp"
+#include "hwcounters.hpp"
 #include "matprops.hpp"
+#include "team.hpp"
 #include "utils.hpp"
 #include "geometry.hpp"
 
@@ -84,8 +87,18 @@ static double triangle_area(const double *a,
 void compute_volume(const array_t &coord, const conn_t &connectivity,
                     double_vec &volume)
 {
-    #pragma omp parallel for default(none)      \
-        shared(coord, connectivity, volume)
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(coord, connectivity, volume)
+        {
+            TeamScope team;
+            compute_volume(coord, connectivity, volume);
+        }
+        return;
+    }
+
+    HW_COUNTED(volume, volume.size());
+    #pragma omp for nowait
     for (std::size_t e=0; e<volume.size(); ++e) {
         int n0 = connectivity[e][0];
         int n1 = connectivity[e][1];
@@ -111,9 +124,21 @@ void compute_dvoldt(const Variables &var, double_vec &dvoldt)
     /* dvoldt is the volumetric strain rate, weighted by the element volume,
      * lumped onto the nodes.
      */
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(var, dvoldt)
+        {
+            TeamScope team;
+            compute_dvoldt(var, dvoldt);
+        }
+        return;
+    }
+
     const double_vec& volume = *var.volume;
     const double_vec& volume_n = *var.volume_n;
-    std::fill_n(dvoldt.begin(), var.nnode, 0);
+    #pragma omp for
+    for (int n=0; n<var.nnode; ++n)
+        dvoldt[n] = 0;
 
     class ElemFunc_dvoldt : public ElemFunc
     {
@@ -139,11 +164,12 @@ void compute_dvoldt(const Variables &var, double_vec &dvoldt)
     } elemf(var, volume, dvoldt);
 
 
-    loop_all_elem(var.egroups, elemf);
+    COUNTED(dvoldt_elem, var.nelem, loop_all_elem(var.egroups, elemf));
+    sum_shared_nodes(var, dvoldt);
 
 
-    #pragma omp parallel for default(none)      \
-        shared(var, dvoldt, volume_n)
+    HW_COUNTED(dvoldt_node, var.nnode);
+    #pragma omp for nowait
     for (int n=0; n<var.nnode; ++n)
          dvoldt[n] /= volume_n[n];
 
@@ -154,13 +180,23 @@ void compute_dvoldt(const Variables &var, double_vec &dvoldt)
 
 
 void compute_edvoldt(const Variables &var, double_vec &dvoldt,
-                     double_vec &edvoldt)
+                     lowp_vec &edvoldt)
 {
     /* edvoldt is the averaged (i.e. smoothed) dvoldt on the element.
      * It is used in update_stress() to prevent mesh locking.
      */
-    #pragma omp parallel for default(none)      \
-        shared(var, dvoldt, edvoldt)
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(var, dvoldt, edvoldt)
+        {
+            TeamScope team;
+            compute_edvoldt(var, dvoldt, edvoldt);
+        }
+        return;
+    }
+
+    HW_COUNTED(edvoldt, var.nelem);
+    #pragma omp for nowait
     for (int e=0; e<var.nelem; ++e) {
         const int *conn = (*var.connectivity)[e];
         double dj = 0;
@@ -239,7 +275,7 @@ double compute_dt(const Param& param, const Variables& var)
                   << " " << dt_advection << " " << dt_elastic << "\n";
         std::exit(11);
     }
-    return dt;
+    return global_min(var, dt);
 }
 
 
@@ -249,10 +285,25 @@ void compute_mass(const Param &param,
                   double max_vbc_val, double_vec &volume_n,
                   double_vec &mass, double_vec &tmass)
 {
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none)                              \
+            shared(param, egroups, connectivity, volume, mat, max_vbc_val, volume_n, mass, tmass)
+        {
+            TeamScope team;
+            compute_mass(param, egroups, connectivity, volume, mat, max_vbc_val,
+                         volume_n, mass, tmass);
+        }
+        return;
+    }
+
     // volume_n is (node-averaged volume * NODES_PER_ELEM)
-    volume_n.assign(volume_n.size(), 0);
-    mass.assign(mass.size(), 0);
-    tmass.assign(tmass.size(), 0);
+    #pragma omp for
+    for (std::size_t n=0; n<mass.size(); ++n) {
+        volume_n[n] = 0;
+        mass[n] = 0;
+        tmass[n] = 0;
+    }
 
     const double pseudo_speed = max_vbc_val * param.control.inertial_scaling;
 
@@ -293,97 +344,55 @@ void compute_mass(const Param &param,
     } elemf(mat, connectivity, volume, pseudo_speed, param.control.is_quasi_static,
             param.control.has_thermal_diffusion, volume_n, mass, tmass);
 
-    loop_all_elem(egroups, elemf);
+    COUNTED(mass, volume.size(), loop_all_elem(egroups, elemf));
 }
 
 
 void compute_shape_fn(const array_t &coord, const conn_t &connectivity,
                       const double_vec &volume, const int_vec &egroups,
-                      shapefn &shpdx, shapefn &shpdy, shapefn &shpdz)
+                      ShapeDeriv &shpd)
 {
+    // computed on the fly by the kernels, see shape-deriv.hpp
+    if (! ShapeDeriv::is_stored) return;
+
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(coord, connectivity, volume, egroups, shpd)
+        {
+            TeamScope team;
+            compute_shape_fn(coord, connectivity, volume, egroups, shpd);
+        }
+        return;
+    }
+
+
     class ElemFunc_shape_fn : public ElemFunc
     {
     private:
         const array_t &coord;
         const conn_t &connectivity;
         const double_vec &volume;
-        shapefn &shpdx, &shpdy, &shpdz;
+        ShapeDeriv &shpd;
     public:
         ElemFunc_shape_fn(const array_t &coord, const conn_t &connectivity, const double_vec &volume,
-                          shapefn &shpdx, shapefn &shpdy, shapefn &shpdz) :
-            coord(coord), connectivity(connectivity), volume(volume),
-            shpdx(shpdx), shpdy(shpdy), shpdz(shpdz) {};
+                          ShapeDeriv &shpd) :
+            coord(coord), connectivity(connectivity), volume(volume), shpd(shpd) {};
         void operator()(int e)
         {
+            const int *conn = connectivity[e];
+            const double *x[NODES_PER_ELEM];
+            for (int i=0; i<NODES_PER_ELEM; ++i)
+                x[i] = coord[conn[i]];
 
-            int n0 = connectivity[e][0];
-            int n1 = connectivity[e][1];
-            int n2 = connectivity[e][2];
-
-            const double *d0 = coord[n0];
-            const double *d1 = coord[n1];
-            const double *d2 = coord[n2];
-
-#ifdef THREED
-            {
-                int n3 = connectivity[e][3];
-                const double *d3 = coord[n3];
-
-                double iv = 1 / (6 * volume[e]);
-
-                double x01 = d0[0] - d1[0];
-                double x02 = d0[0] - d2[0];
-                double x03 = d0[0] - d3[0];
-                double x12 = d1[0] - d2[0];
-                double x13 = d1[0] - d3[0];
-                double x23 = d2[0] - d3[0];
-
-                double y01 = d0[1] - d1[1];
-                double y02 = d0[1] - d2[1];
-                double y03 = d0[1] - d3[1];
-                double y12 = d1[1] - d2[1];
-                double y13 = d1[1] - d3[1];
-                double y23 = d2[1] - d3[1];
-
-                double z01 = d0[2] - d1[2];
-                double z02 = d0[2] - d2[2];
-                double z03 = d0[2] - d3[2];
-                double z12 = d1[2] - d2[2];
-                double z13 = d1[2] - d3[2];
-                double z23 = d2[2] - d3[2];
-
-                shpdx[e][0] = iv * (y13*z12 - y12*z13);
-                shpdx[e][1] = iv * (y02*z23 - y23*z02);
-                shpdx[e][2] = iv * (y13*z03 - y03*z13);
-                shpdx[e][3] = iv * (y01*z02 - y02*z01);
-
-                shpdy[e][0] = iv * (z13*x12 - z12*x13);
-                shpdy[e][1] = iv * (z02*x23 - z23*x02);
-                shpdy[e][2] = iv * (z13*x03 - z03*x13);
-                shpdy[e][3] = iv * (z01*x02 - z02*x01);
-
-                shpdz[e][0] = iv * (x13*y12 - x12*y13);
-                shpdz[e][1] = iv * (x02*y23 - x23*y02);
-                shpdz[e][2] = iv * (x13*y03 - x03*y13);
-                shpdz[e][3] = iv * (x01*y02 - x02*y01);
-            }
-#else
-            {
-                double iv = 1 / (2 * volume[e]);
-
-                shpdx[e][0] = iv * (d1[1] - d2[1]);
-                shpdx[e][1] = iv * (d2[1] - d0[1]);
-                shpdx[e][2] = iv * (d0[1] - d1[1]);
+            ShapeDeriv::row d[NDIMS];
+            for (int i=0; i<NDIMS; ++i)
+                d[i] = shpd.get(i, e);
 
-                shpdz[e][0] = iv * (d2[0] - d1[0]);
-                shpdz[e][1] = iv * (d0[0] - d2[0]);
-                shpdz[e][2] = iv * (d1[0] - d0[0]);
-            }
-#endif
+            ShapeDeriv::compute(x, volume[e], d);
         }
-    } elemf(coord, connectivity, volume, shpdx, shpdy, shpdz);
+    } elemf(coord, connectivity, volume, shpd);
 
-    loop_all_elem(egroups, elemf);
+    COUNTED(shape_fn, volume.size(), loop_all_elem(egroups, elemf));
 }
 
 
@@ -429,7 +438,7 @@ static double elem_quality(const array_t &coord, const conn_t &connectivity,
 
 
 double worst_elem_quality(const array_t &coord, const conn_t &connectivity,
-                          const double_vec &volume, double_vec &elquality, int &worst_elem)
+                          const double_vec &volume, lowp_vec &elquality, int &worst_elem)
 {
     double q = 1;
     worst_elem = 0;
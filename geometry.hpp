@@ -8,7 +8,7 @@ void compute_volume(const array_t &coord, const conn_t &connectivity,
 void compute_dvoldt(const Variables &var, double_vec &dvoldt);
 
 void compute_edvoldt(const Variables &var, double_vec &dvoldt,
-                     double_vec &edvoldt);
+                     lowp_vec &edvoldt);
 
 double compute_dt(const Param& param, const Variables& var);
 
@@ -21,9 +21,9 @@ void compute_mass(const Param &param,
 void compute_shape_fn(const array_t &coord, const conn_t &connectivity,
                       const double_vec &volume,
                       const int_vec &egroups,
-                      shapefn &shpdx, shapefn &shpdy, shapefn &shpdz);
+                      ShapeDeriv &shpd);
 
 double worst_elem_quality(const array_t &coord, const conn_t &connectivity,
-                          const double_vec &volume, double_vec &elquality, int &worst_elem);
+                          const double_vec &volume, lowp_vec &elquality, int &worst_elem);
 
 #endif
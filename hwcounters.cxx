@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "hwcounters.hpp"
+
+
+HWCounters *hw_counters = NULL;
+
+
+namespace {
+
+    const int cache_line_size = 64;
+
+#ifdef __linux__
+    int open_counter(unsigned long long config, int group_fd)
+    {
+        // counting the calling thread on any cpu, in user space only
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+    }
+#endif
+
+}
+
+
+HWCounters* HWCounters::create()
+{
+#ifdef __linux__
+    int nthreads = 1;
+#ifdef USE_OMP
+    nthreads = omp_get_max_threads();
+#endif
+    std::vector<int> fd(nthreads * nevents, -1);
+    unsigned long long config[nevents] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    // the counters of a thread must be opened by the thread itself
+    #pragma omp parallel default(none) shared(fd, config)
+    {
+        int t = 0;
+#ifdef USE_OMP
+        t = omp_get_thread_num();
+#endif
+        int *f = &fd[t * nevents];
+        f[0] = open_counter(config[0], -1);
+        if (f[0] >= 0)
+            for (int i=1; i<nevents; ++i)
+                f[i] = open_counter(config[i], f[0]);
+    }
+
+    if (std::count(fd.begin(), fd.end(), -1) == 0)
+        return new HWCounters(nthreads, fd);
+
+    for (std::size_t i=0; i<fd.size(); ++i)
+        if (fd[i] >= 0) close(fd[i]);
+    std::cerr << "Warning: hardware counters are not available"
+              << " (check /proc/sys/kernel/perf_event_paranoid).\n";
+#else
+    std::cerr << "Warning: hardware counters are only supported on Linux.\n";
+#endif
+    return NULL;
+}
+
+
+HWCounters::HWCounters(int nthreads, const std::vector<int> &fd) :
+    nthreads(nthreads), fd(fd)
+{
+    reset();
+}
+
+
+HWCounters::~HWCounters()
+{
+#ifdef __linux__
+    for (std::size_t i=0; i<fd.size(); ++i)
+        close(fd[i]);
+#endif
+}
+
+
+const char* HWCounters::name(int region)
+{
+    static const char *names[nregions] = {
+        "temperature_elem", "temperature_node", "strain_rate", "dvoldt_elem", "dvoldt_node",
+        "edvoldt", "stress", "force_elem", "damping", "velocity", "coordinate", "volume",
+        "mass", "shape_fn", "rotate_stress"
+    };
+    return names[region];
+}
+
+
+void HWCounters::read(unsigned long long count[nevents]) const
+{
+    /* Sum of the counters of all threads. A per-thread counter can be read
+     * by any thread. */
+    std::fill_n(count, static_cast<int>(nevents), 0);
+#ifdef __linux__
+    for (int t=0; t<nthreads; ++t) {
+        // read_format of a group: number of events, then the values
+        unsigned long long buf[1 + nevents];
+        if (::read(fd[t * nevents], buf, sizeof(buf)) != sizeof(buf)) continue;
+        for (int i=0; i<nevents; ++i)
+            count[i] += buf[1 + i];
+    }
+#endif
+}
+
+
+void HWCounters::add(Region region, long n, const unsigned long long start[nevents])
+{
+    unsigned long long end[nevents];
+    read(end);
+    calls[region] ++;
+    items[region] += n;
+    for (int i=0; i<nevents; ++i)
+        acc[region][i] += end[i] - start[i];
+}
+
+
+void HWCounters::reset()
+{
+    std::fill_n(calls, static_cast<int>(nregions), 0);
+    std::fill_n(items, static_cast<int>(nregions), 0);
+    std::fill_n(&acc[0][0], nregions * nevents, 0ULL);
+}
+
+
+void HWCounters::write(const std::string &modelname, int frame)
+{
+    /* Appending the counters of each region since the previous frame to
+     * modelname.counters. The memory traffic is estimated as one cache line
+     * per last-level cache miss. */
+    std::string filename(modelname + ".counters");
+    std::FILE* f = std::fopen(filename.c_str(), (frame == 0) ? "w" : "a");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << filename << '\n';
+        std::exit(2);
+    }
+
+    if (frame == 0)
+        std::fprintf(f, "# frame\tregion\tcalls\titems\tcycles\tinstructions\tllc_misses"
+                     "\tipc\tcycles_per_item\tbytes_per_item\n");
+
+    for (int r=0; r<nregions; ++r) {
+        if (calls[r] == 0) continue;
+        const double n = std::max(items[r], 1L);
+        std::fprintf(f, "%6d\t%s\t%ld\t%ld\t%llu\t%llu\t%llu\t%.3f\t%.3f\t%.3f\n",
+                     frame, name(r), calls[r], items[r],
+                     acc[r][cycles], acc[r][instructions], acc[r][llc_misses],
+                     (acc[r][cycles] ? double(acc[r][instructions]) / acc[r][cycles] : 0.0),
+                     acc[r][cycles] / n,
+                     acc[r][llc_misses] * double(cache_line_size) / n);
+    }
+    std::fclose(f);
+    reset();
+}
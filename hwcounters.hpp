@@ -0,0 +1,101 @@
+#ifndef DYNEARTHSOL3D_HWCOUNTERS_HPP
+#define DYNEARTHSOL3D_HWCOUNTERS_HPP
+
+#include <string>
+#include <vector>
+
+/* Hardware performance counters (Linux perf_event) of the hot kernels,
+ * enabled by profiling.has_hardware_counters in the config file.
+ *
+ * Each thread counts its own events. The counters of all threads are read
+ * at the beginning and the end of a region:
+ *     HW_COUNTED(volume, nelem);  // till the end of current scope
+ * or
+ *     COUNTED(dvoldt_elem, nelem, loop_all_elem(egroups, elemf));
+ *
+ * In a team kernel (see team.hpp), the team waits at the beginning and the
+ * end of a region, and the master thread reads the counters.
+ *
+ * The counters are not read at all when they are disabled, i.e. when
+ * hw_counters is NULL.
+ */
+
+class HWCounters
+{
+public:
+    enum Region {
+        temperature_elem, temperature_node, strain_rate, dvoldt_elem, dvoldt_node,
+        edvoldt, stress, force_elem, damping, velocity, coordinate, volume,
+        mass, shape_fn, rotate_stress,
+        nregions
+    };
+
+    enum Event {
+        cycles, instructions, llc_misses,
+        nevents
+    };
+
+    // returns NULL if the counters are not available
+    static HWCounters* create();
+    ~HWCounters();
+
+    static const char* name(int region);
+
+    void read(unsigned long long count[nevents]) const;
+    void add(Region region, long items, const unsigned long long start[nevents]);
+    void write(const std::string &modelname, int frame);
+
+private:
+    int nthreads;
+    std::vector<int> fd;  // fd[thread * nevents + event]
+
+    long calls[nregions];
+    long items[nregions];
+    unsigned long long acc[nregions][nevents];
+
+    HWCounters(int nthreads, const std::vector<int> &fd);
+    void reset();
+
+    // disable copy
+    HWCounters(const HWCounters&);
+    HWCounters& operator=(const HWCounters&);
+};
+
+extern HWCounters *hw_counters;
+
+
+class CountedRegion
+{
+public:
+    CountedRegion(HWCounters::Region region, long items) :
+        region(region), items(items)
+    {
+        if (hw_counters) {
+            #pragma omp barrier
+            #pragma omp master
+            hw_counters->read(start);
+        }
+    }
+
+    ~CountedRegion()
+    {
+        if (hw_counters) {
+            #pragma omp barrier
+            #pragma omp master
+            hw_counters->add(region, items, start);
+        }
+    }
+
+private:
+    const HWCounters::Region region;
+    const long items;
+    unsigned long long start[HWCounters::nevents];
+};
+
+
+#define COUNTED(region, items, ...) \
+    do { CountedRegion counted_(HWCounters::region, items); __VA_ARGS__; } while (0)
+// counting till the end of current scope
+#define HW_COUNTED(region, items) CountedRegion counted_##region(HWCounters::region, items)
+
+#endif
@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <ctime>
 #include <iostream>
 #include <limits>
 #include <sstream>
@@ -53,6 +54,20 @@ static void declare_parameters(po::options_description &cfg,
 
         ("sim.has_marker_output", po::value<bool>(&p.sim.has_marker_output)->default_value(false),
          "Output marker coordinate and material?")
+        ("sim.has_container_output", po::value<bool>(&p.sim.has_container_output)->default_value(false),
+         "Write all output frames and checkpoints into a single append-only container file 'modelname.frames', "
+         "instead of separate 'modelname.save.NNNNNN' and 'modelname.chkpt.NNNNNN' files?")
+        ("sim.output_field_intervals", po::value<std::string>(&p.sim.output_field_intervals)->default_value(""),
+         "How often each field is written, in the unit of output frames, e.g. 'strain:0, stress:5, density:2'.\n"
+         "0 turns off the field, N writes the field in every N-th frame. Unlisted fields are written in every frame.\n"
+         "Fields: velocity, temperature, mesh_quality, plastic_strain, plastic_strain_rate, strain_rate, strain, "
+         "stress, density, viscosity, material, force, markers.\n"
+         "The fields needed for restarting are always written in the frames with a checkpoint.")
+        ("sim.topography_step_interval", po::value<int>(&p.sim.topography_step_interval)->default_value(0),
+         "Append the coordinate of the top surface nodes to 'modelname.topo' every N time steps. 0 for no output.")
+        ("sim.status_step_interval", po::value<int>(&p.sim.status_step_interval)->default_value(0),
+         "Rewrite 'modelname.status' every N time steps with the progress of the run (throughput, dt, "
+         "mesh size, memory, projected completion) for monitoring. 0 for no status file.")
         ("sim.has_output_during_remeshing", po::value<bool>(&p.sim.has_output_during_remeshing)->default_value(false),
          "Output immediately before and after remeshing?")
         ("sim.output_averaged_fields", po::value<int>(&p.sim.output_averaged_fields)->default_value(1),
@@ -60,6 +75,23 @@ static void declare_parameters(po::options_description &cfg,
          "0: no, output instaneous fields. The velocity and strain-rate might oscillate temporally.\n"
          "1: yes, output field variables averaged over mesh.quality_check_step_interval time steps.\n"
          "N: (integer N > 2) yes, output field variables averaged over N time steps. The value of N is strongly related to the value of mesh.quality_check_step_interval, which must be a multiple of N.\n")
+        ("sim.random_seed", po::value<int>(&p.sim.random_seed)->default_value(0),
+         "Seed of the random numbers of the markers and of the mesh generation. "
+         "0 for a seed from the clock, which is printed at startup.\n"
+         "The random numbers are independent of the number of threads.")
+        ("sim.deterministic_ngroups", po::value<int>(&p.sim.deterministic_ngroups)->default_value(0),
+         "Number of element groups of the parallel element loops. 0 for two groups per thread.\n"
+         "N: (even integer N > 0) use N groups for any number of threads, so that the nodal sums "
+         "(force, mass, etc.) are added in the same order and the results are reproducible bit-for-bit "
+         "with any number of threads. N should be at least twice the number of threads, but small enough "
+         "that each group is several elements thick.")
+        ("sim.has_concurrent_phases", po::value<bool>(&p.sim.has_concurrent_phases)->default_value(false),
+         "Run the independent phases of a time step (e.g. temperature and strain rate) at the same time, "
+         "each with a share of the OpenMP threads (see phase-graph.hpp).")
+        ("sim.has_persistent_team", po::value<bool>(&p.sim.has_persistent_team)->default_value(false),
+         "Run the time steps in one parallel region, which is left only for output and remeshing, "
+         "instead of a parallel region in each kernel (see team.hpp). Saves the fork/join overhead "
+         "for small meshes.")
         ;
 
     cfg.add_options()
@@ -73,6 +105,13 @@ static void declare_parameters(po::options_description &cfg,
          "Output verbose during mesh/remeshing. -1 for no output.")
         ("mesh.tetgen_optlevel", po::value<int>(&p.mesh.tetgen_optlevel)->default_value(3),
          "Optimization level for tetgen. 0: no optimization; 1: multiple edge filps; 2: 1 & free vertex deletion; 3: 2 & new vertex insertion. High optimization level could slow down the speed of mesh generation. For 3D only.")
+        ("mesh.renumbering_option", po::value<int>(&p.mesh.renumbering_option)->default_value(0),
+         "How to renumber the nodes and elements of a new mesh for cache locality?\n"
+         "0: along a space-filling curve of the node and element positions\n"
+         "1: nodes in reverse Cuthill-McKee order of the node graph, elements by their lowest node")
+        ("mesh.has_renumbering_report", po::value<bool>(&p.mesh.has_renumbering_report)->default_value(false),
+         "Print the bandwidth and the average gather distance of the nodes of the elements for each "
+         "renumbering option whenever a new mesh is renumbered, to choose mesh.renumbering_option.")
 
         ("mesh.xlength", po::value<double>(&p.mesh.xlength)->required(),
          "Length of x (in meters)")
@@ -326,6 +365,25 @@ static void declare_parameters(po::options_description &cfg,
         ("mat.dilation_angle1", po::value<std::string>()->default_value("[0]"),
          "Dilation angle of the materials when weakening saturates '[d0, d1, d2, ...]' (in degree)")
         ;
+
+    cfg.add_options()
+        ("profiling.has_hardware_counters", po::value<bool>(&p.profiling.has_hardware_counters)->default_value(false),
+         "Count the cycles, instructions and last-level cache misses of the hot kernels with "
+         "the Linux perf_event interface, and write them to 'modelname.counters' at each output frame.")
+        ("profiling.has_roofline_report", po::value<bool>(&p.profiling.has_roofline_report)->default_value(false),
+         "Measure the memory bandwidth and the flop rate of the machine at startup, and write the "
+         "achieved throughput of each kernel of the time loop against them to 'modelname.roofline' "
+         "at the end of the run. Needs the phase timers (make timers=1).")
+        ("profiling.scaling_steps", po::value<int>(&p.profiling.scaling_steps)->default_value(0),
+         "Run a strong-scaling study instead of the simulation: time N steps with 1, 2, 4, ... up to "
+         "the max. number of OpenMP threads, and write the timings to 'modelname.scaling'. 0 to turn off.")
+        ("profiling.scaling_proc_bind", po::value<std::string>(&p.profiling.scaling_proc_bind)->default_value(""),
+         "Thread affinity policies of the scaling study, e.g. 'false, close, spread'. The study is repeated "
+         "for each policy with OMP_PROC_BIND set. Empty to use the environment as is.")
+        ("profiling.scaling_places", po::value<std::string>(&p.profiling.scaling_places)->default_value(""),
+         "OMP_PLACES of the affinity policies of the scaling study, e.g. 'cores' or 'sockets'. "
+         "Empty to use the environment as is.")
+        ;
 }
 
 
@@ -444,6 +502,52 @@ static void validate_parameters(const po::variables_map &vm, Param &p)
         }
     }
 
+    if (p.sim.status_step_interval < 0) {
+        std::cerr << "sim.status_step_interval cannot be negative!\n";
+        std::exit(1);
+    }
+
+    if (p.sim.topography_step_interval < 0) {
+        std::cerr << "sim.topography_step_interval cannot be negative!\n";
+        std::exit(1);
+    }
+
+    if (p.mesh.renumbering_option < 0 || p.mesh.renumbering_option > 1) {
+        std::cerr << "mesh.renumbering_option must be 0 or 1!\n";
+        std::exit(1);
+    }
+
+    if (p.sim.random_seed == 0) {
+        p.sim.random_seed = static_cast<int>(std::time(NULL) & 0x7fffffff);
+        std::cout << "Random seed: " << p.sim.random_seed << '\n';
+    }
+    if (p.sim.deterministic_ngroups < 0 || p.sim.deterministic_ngroups % 2 != 0) {
+        std::cerr << "sim.deterministic_ngroups must be a non-negative even number!\n";
+        std::exit(1);
+    }
+    if (p.sim.has_concurrent_phases && p.profiling.has_hardware_counters) {
+        std::cerr << "sim.has_concurrent_phases cannot be used with profiling.has_hardware_counters!\n";
+        std::exit(1);
+    }
+    if (p.sim.has_concurrent_phases && p.sim.has_persistent_team) {
+        std::cerr << "sim.has_concurrent_phases and sim.has_persistent_team cannot be used together!\n";
+        std::exit(1);
+    }
+#ifdef USE_MPI
+    if (p.sim.has_persistent_team) {
+        std::cerr << "sim.has_persistent_team is not supported in the MPI build!\n";
+        std::exit(1);
+    }
+    if (p.sim.has_concurrent_phases) {
+        std::cerr << "sim.has_concurrent_phases is not supported in the MPI build!\n";
+        std::exit(1);
+    }
+    if (p.profiling.scaling_steps > 0) {
+        std::cerr << "profiling.scaling_steps is not supported in the MPI build!\n";
+        std::exit(1);
+    }
+#endif
+
     if (p.sim.output_averaged_fields == 1)
         p.sim.output_averaged_fields = p.mesh.quality_check_step_interval;
     if (p.sim.output_averaged_fields && (p.mesh.quality_check_step_interval % p.sim.output_averaged_fields) != 0) {
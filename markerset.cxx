@@ -1,6 +1,6 @@
+#include <algorithm>
 #include <cstring>
 #include <iostream> // for std::cerr
-#include <time.h> // for time()
 #include <assert.h>
 
 #include "ANN/ANN.h"
@@ -10,6 +10,8 @@
 #include "barycentric-fn.hpp"
 #include "binaryio.hpp"
 #include "markerset.hpp"
+#include "rng.hpp"
+#include "memory.hpp"
 #include "mesh.hpp"
 #include "geometry.hpp"
 #include "utils.hpp"
@@ -22,7 +24,8 @@ namespace {
 }
 
 
-MarkerSet::MarkerSet(const Param& param, Variables& var)
+MarkerSet::MarkerSet(const Param& param, Variables& var) :
+    _seed(param.sim.random_seed)
 {
     _last_id = _nmarkers = 0;
 
@@ -40,13 +43,32 @@ MarkerSet::MarkerSet(const Param& param, Variables& var)
 }
 
 
-MarkerSet::MarkerSet(const Param& param, Variables& var, BinaryInput& bin)
+MarkerSet::MarkerSet(const Param& param, Variables& var, BinaryInput& bin) :
+    _seed(param.sim.random_seed)
 {
     // init from checkpoint file
     read_chkpt_file(var, bin);
 }
 
 
+MarkerSet::MarkerSet(const Param& param, shapefn& eta, int_vec& elem,
+                     int_vec& mattype, int_vec& id, int last_id) :
+    _seed(param.sim.random_seed)
+{
+    _nmarkers = _reserved_space = elem.size();
+    _last_id = last_id;
+
+    _eta = new shapefn;
+    _eta->swap(eta);
+    _elem = new int_vec;
+    _elem->swap(elem);
+    _mattype = new int_vec;
+    _mattype->swap(mattype);
+    _id = new int_vec;
+    _id->swap(id);
+}
+
+
 void MarkerSet::allocate_markerdata( const int max_markers )
 {
     _reserved_space = max_markers;
@@ -57,15 +79,16 @@ void MarkerSet::allocate_markerdata( const int max_markers )
 }
 
 
-void MarkerSet::random_eta( double *eta )
+void MarkerSet::random_eta( int id, double *eta )
 {
     // eta for randomly scattered markers within an element.
     // An alternative would be to fix barycentric coordinates and add random perturbations.
     //
-    // 1. populate eta with random numbers between 0 and 1.0.
+    // 1. populate eta with random numbers between 0 and 1.0, determined by the marker id.
     double sum = 0;
     for( int n = 0; n < NODES_PER_ELEM; n++ ) {
-        eta[n] = (rand()/(double)RAND_MAX);
+        eta[n] = rng::uniform(_seed, rng::marker_eta,
+                              static_cast<uint64_t>(id) * NODES_PER_ELEM + n);
         sum += eta[n];
     }
     // 2. normalize.
@@ -85,7 +108,7 @@ void MarkerSet::append_marker( double *eta, int el, int mt )
     }
 
     int m = _nmarkers;
-    std::memcpy((*_eta)[m], eta, NODES_PER_ELEM*sizeof(double));
+    std::copy(eta, eta + NODES_PER_ELEM, (*_eta)[m]);
     (*_elem)[m] = el;
     (*_mattype)[m] = mt;
     (*_id)[m] = _last_id;
@@ -110,7 +133,7 @@ void MarkerSet::append_marker( double *eta, int el, int mt )
 void MarkerSet::append_random_marker_in_elem( int el, int mt )
 {
     double eta[NODES_PER_ELEM];
-    random_eta(eta);
+    random_eta(_last_id, eta);
     append_marker(eta, el, mt);
 }
 
@@ -124,16 +147,13 @@ void MarkerSet::random_markers( const Param& param, Variables &var )
 
     // allocate memory for data members.
     allocate_markerdata( max_markers );
-    
-    // initialize random seed:
-    srand (time(NULL));
-    
+
     // Generate particles in each element.
     for( int e = 0; e < ne; e++ )
         for( int m = 0; m < mpe; m++ ) {
             // random barycentric coordinate
             double eta[NODES_PER_ELEM];
-            random_eta(eta);
+            random_eta(_last_id, eta);
 
             // decide the mattype of markers
             int mt = initial_mattype(param, var, e, eta);
@@ -264,7 +284,7 @@ void MarkerSet::remove_marker(int i)
 {
     // Replace marker i by the last marker.
     --_nmarkers;
-    std::memcpy( (*_eta)[i], (*_eta)[_nmarkers], sizeof(double)*(NODES_PER_ELEM) );
+    std::copy( (*_eta)[_nmarkers], (*_eta)[_nmarkers] + NODES_PER_ELEM, (*_eta)[i] );
     (*_id)[i] = (*_id)[_nmarkers];
     (*_elem)[i] = (*_elem)[_nmarkers];
     (*_mattype)[i] = (*_mattype)[_nmarkers];
@@ -281,6 +301,13 @@ void MarkerSet::set_eta( const int i, const double r[NDIMS] ) {
 }
 
 
+std::size_t MarkerSet::memory_usage() const
+{
+    // including the space reserved for future markers
+    return _reserved_space * (NODES_PER_ELEM * sizeof(lowp_t) + 3 * sizeof(int));
+}
+
+
 void MarkerSet::resize( const int newsize )
 {
     if( newsize > _reserved_space ) {
@@ -288,7 +315,7 @@ void MarkerSet::resize( const int newsize )
         std::cout << "  Increasing marker arrays size to " << newsize << " markers.\n";
         _reserved_space = newsize;
 
-        double *new_eta = new double[NODES_PER_ELEM * newsize];
+        lowp_t *new_eta = new lowp_t[NODES_PER_ELEM * newsize];
         std::copy( (*_eta)[0], (*_eta)[_nmarkers], new_eta );
         _eta->reset( new_eta, _nmarkers );
 
@@ -307,8 +334,10 @@ void MarkerSet::resize( const int newsize )
 
 
 void remap_markers(const Param& param, Variables &var, const array_t &old_coord, 
-                   const conn_t &old_connectivity)
+                   const conn_t &old_connectivity, int &ndeleted, int &nadded)
 {
+    ndeleted = nadded = 0;
+
     // Re-create elemmarkers
     delete var.elemmarkers;
     create_elemmarkers( param, var );
@@ -318,6 +347,10 @@ void remap_markers(const Param& param, Variables &var, const array_t &old_coord,
 
     Barycentric_transformation bary( *var.coord, *var.connectivity, new_volume );
 
+    ScopedMemory mem( *var.memory, MemoryUsage::markers,
+                      nbytes(new_volume) + barycentric_nbytes(var.nelem) +
+                      elem_center_nbytes(var.nelem) + kdtree_nbytes(var.nelem) );
+
     // nearest-neighbor search structure
     double **centroid = elem_center(*var.coord, *var.connectivity); // centroid of elements
     ANNkd_tree kdtree(centroid, var.nelem, NDIMS);
@@ -388,6 +421,7 @@ void remap_markers(const Param& param, Variables &var, const array_t &old_coord,
             // Note i is not inc'd.
             --last_marker;
             ms->remove_marker(i);
+            ++ndeleted;
         }
     }
 
@@ -412,12 +446,15 @@ void remap_markers(const Param& param, Variables &var, const array_t &old_coord,
             cpdf[param.mat.nmat - 1] = 1; // fix to 1 to avoid round-off error
             while( num_marker_in_elem < mpe / 2 ) {
                 // Determine new marker's matttype based on cpdf
-                auto upper = std::upper_bound(cpdf.begin(), cpdf.end(), drand48());
+                const double r = rng::uniform(param.sim.random_seed, rng::marker_mattype,
+                                              ms->get_last_id());
+                auto upper = std::upper_bound(cpdf.begin(), cpdf.end(), r);
                 const int mt = upper - cpdf.begin();
                 ms->append_random_marker_in_elem(e, mt);
 
                 ++(*var.elemmarkers)[e][mt];
                 ++num_marker_in_elem;
+                ++nadded;
             }
         }
     }
@@ -461,28 +498,37 @@ void MarkerSet::read_chkpt_file(Variables &var, BinaryInput &bin)
 }
 
 
-void MarkerSet::write_save_file(const Variables &var, BinaryOutput &bin)
+void MarkerSet::compute_coordinates(const Variables &var, array_t &mcoord) const
 {
-    int_vec itmp(1);
-    itmp[0] = _nmarkers;
-    bin.write_array(itmp, "markerset size");
+    // mcoord is a scratch buffer owned by the caller, its memory is kept
+    // when the number of markers changes a little
+    mcoord.resize(_nmarkers);
 
-    array_t mcoord(_nmarkers, 0);
     const array_t &coord = *var.coord;
+    const conn_t &connectivity = *var.connectivity;
+    const int_vec &elem = *_elem;
+    const shapefn &eta = *_eta;
 
+    #pragma omp parallel for default(none)          \
+        shared(mcoord, coord, connectivity, elem, eta)
     for (int i=0; i<_nmarkers; ++i) {
-        int e = (*_elem)[i];
-        const int *conn = (*var.connectivity)[e];
-        const double *eta = (*_eta)[i];
+        const int *conn = connectivity[elem[i]];
+        const lowp_t *eta_i = eta[i];
         double *x = mcoord[i];
-        for (int j = 0; j < NDIMS; j++)
+        for (int j = 0; j < NDIMS; j++) {
+            x[j] = 0;
             for (int k = 0; k < NODES_PER_ELEM; k++)
-                x[j] += eta[k] * coord[ conn[k] ][j];
-
-        // std::cout << i << '\t';
-        // print(std::cout, x, NDIMS);
-        // std::cout << "\n";
+                x[j] += eta_i[k] * coord[ conn[k] ][j];
+        }
     }
+}
+
+
+void MarkerSet::write_save_file(const array_t &mcoord, BinaryOutput &bin)
+{
+    int_vec itmp(1);
+    itmp[0] = _nmarkers;
+    bin.write_array(itmp, "markerset size");
 
     bin.write_array(mcoord, "markerset.coord");
     bin.write_array(*_elem, "markerset.elem");
@@ -11,6 +11,10 @@ class MarkerSet
 public:
     MarkerSet( const Param& param, Variables& var );
     MarkerSet( const Param& param, Variables& var, BinaryInput& bin );
+    // markers of a partition of the mesh (see decomposition.cxx), the
+    // content of the arrays is taken over
+    MarkerSet( const Param& param, shapefn& eta, int_vec& elem,
+               int_vec& mattype, int_vec& id, int last_id );
     ~MarkerSet()
     { 
         delete _id;
@@ -24,11 +28,16 @@ public:
     void resize(const int);
     void write_chkpt_file(BinaryOutput &bin);
     void read_chkpt_file(Variables &var, BinaryInput &bin);
-    void write_save_file(const Variables &var, BinaryOutput &bin);
+    void compute_coordinates(const Variables &var, array_t &mcoord) const;
+    void write_save_file(const array_t &mcoord, BinaryOutput &bin);
+    std::size_t memory_usage() const;
 
     inline int get_nmarkers() const { return _nmarkers; }
     inline void set_nmarkers(int n) { _nmarkers = n; }
 
+    // id of the next appended marker
+    inline int get_last_id() const { return _last_id; }
+
     inline int get_id(int m) const { return (*_id)[m]; }
     inline void set_id(const int m, const int i) { (*_id)[m] = i; }
 
@@ -38,7 +47,7 @@ public:
     inline int get_mattype(int m) const { return (*_mattype)[m]; }
     inline void set_mattype(const int m, const int mt) { (*_mattype)[m] = mt; }
 
-    inline const double *get_eta(int m) const { return (*_eta)[m]; }
+    inline const lowp_t *get_eta(int m) const { return (*_eta)[m]; }
     inline void set_eta( const int i, const double r[NDIMS] );
 
 private:
@@ -48,6 +57,8 @@ private:
     int _nmarkers;
     int _reserved_space;
     int _last_id;
+    // Seed of the random barycentric coordinates
+    const int _seed;
 
     // Barycentric (local) coordinate within the reference element
     shapefn *_eta;
@@ -58,7 +69,7 @@ private:
     // Unique id
     int_vec *_id;
 
-    void random_eta( double* );
+    void random_eta( int id, double* );
     void append_marker( double *eta, int el, int mt );
     void random_markers( const Param&, Variables& );
     void regularly_spaced_markers( const Param&, Variables& );
@@ -69,6 +80,6 @@ private:
 };
 
 void remap_markers(const Param&, Variables &, 
-                   const array_t &, const conn_t &);
+                   const array_t &, const conn_t &, int &, int &);
 
 #endif
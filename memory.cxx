@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "constants.hpp"
+#include "parameters.hpp"
+#include "markerset.hpp"
+#include "memory.hpp"
+
+
+namespace {
+
+    std::size_t max_resident_set_size()
+    {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+        return usage.ru_maxrss;  // in bytes
+#else
+        return static_cast<std::size_t>(usage.ru_maxrss) * 1024;  // in kilobytes
+#endif
+    }
+
+}
+
+
+std::size_t resident_set_size()
+{
+    // in bytes, Linux only
+    // the total program size, then the resident set size, in pages
+    long size = 0, pages = 0;
+    std::FILE *f = std::fopen("/proc/self/statm", "r");
+    if (f == NULL) return 0;
+    if (std::fscanf(f, "%ld %ld", &size, &pages) != 2) pages = 0;
+    std::fclose(f);
+    return static_cast<std::size_t>(pages) * sysconf(_SC_PAGESIZE);
+}
+
+
+std::size_t elem_center_nbytes(int nelem)
+{
+    return nelem * (NDIMS * sizeof(double) + sizeof(double*));
+}
+
+
+std::size_t barycentric_nbytes(int nelem)
+{
+    return nelem * (NODES_PER_ELEM * NDIMS * sizeof(double));
+}
+
+
+std::size_t kdtree_nbytes(int npoints)
+{
+    const std::size_t leaf = 3 * sizeof(void*);
+    const std::size_t split = 3 * sizeof(void*) + 4 * sizeof(double);
+    return npoints * (sizeof(int) + leaf + split);
+}
+
+
+MemoryUsage::MemoryUsage()
+{
+    std::fill_n(owned, static_cast<int>(nsubsystems), 0);
+    std::fill_n(transient, static_cast<int>(nsubsystems), 0);
+    std::fill_n(peaks, static_cast<int>(nsubsystems), 0);
+    peak_sum = 0;
+}
+
+
+const char* MemoryUsage::name(int subsystem)
+{
+    static const char *names[nsubsystems] = {
+        "mesh", "fields", "markers", "support", "remesh", "interpolation"
+    };
+    return names[subsystem];
+}
+
+
+void MemoryUsage::update(const Variables &var)
+{
+    std::size_t n;
+
+    n = nbytes(var.coord) + nbytes(var.connectivity) + nbytes(var.segment)
+        + nbytes(var.segflag) + nbytes(var.regattr) + nbytes(var.bcflag)
+        + nbytes(var.egroups);
+    for (int i=0; i<6; ++i)
+        n += nbytes(var.bnodes[i]) + nbytes(var.bfacets[i]);
+    owned[mesh] = n;
+
+    n = nbytes(var.volume) + nbytes(var.volume_old) + nbytes(var.volume_n)
+        + nbytes(var.mass) + nbytes(var.tmass) + nbytes(var.edvoldt)
+        + nbytes(var.temperature) + nbytes(var.plstrain) + nbytes(var.delta_plstrain)
+        + nbytes(var.ntmp) + nbytes(var.elquality)
+        + nbytes(var.vel) + nbytes(var.force)
+        + nbytes(var.strain_rate) + nbytes(var.strain) + nbytes(var.stress)
+        + nbytes(var.shpd);
+    owned[fields] = n;
+
+    n = nbytes(var.elemmarkers);
+    if (var.markerset) n += var.markerset->memory_usage();
+    owned[markers] = n;
+
+    owned[support] = nbytes(var.support);
+
+    update_peaks();
+}
+
+
+void MemoryUsage::add(Subsystem subsystem, std::size_t bytes)
+{
+    transient[subsystem] += bytes;
+    update_peaks();
+}
+
+
+void MemoryUsage::remove(Subsystem subsystem, std::size_t bytes)
+{
+    transient[subsystem] -= bytes;
+}
+
+
+std::size_t MemoryUsage::current(int subsystem) const
+{
+    return owned[subsystem] + transient[subsystem];
+}
+
+
+std::size_t MemoryUsage::peak(int subsystem) const
+{
+    return peaks[subsystem];
+}
+
+
+std::size_t MemoryUsage::total() const
+{
+    std::size_t n = 0;
+    for (int i=0; i<nsubsystems; ++i)
+        n += current(i);
+    return n;
+}
+
+
+std::size_t MemoryUsage::peak_total() const
+{
+    return peak_sum;
+}
+
+
+void MemoryUsage::update_peaks()
+{
+    for (int i=0; i<nsubsystems; ++i)
+        peaks[i] = std::max(peaks[i], current(i));
+    peak_sum = std::max(peak_sum, total());
+}
+
+
+void MemoryUsage::write_log(const std::string &modelname, const char *event,
+                            int steps, bool new_file)
+{
+    /* Appending the current and peak memory usage (in bytes) of each
+     * subsystem to modelname.memory, then resetting the peaks. The resident
+     * set size of the process (current and max. since the start) includes
+     * the memory not accounted for, e.g. of the mesh generators and Stellar. */
+    std::string filename(modelname + ".memory");
+    std::FILE* f = std::fopen(filename.c_str(), new_file ? "w" : "a");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << filename << '\n';
+        std::exit(2);
+    }
+
+    // a restart under a new modelname appends to a new file, too
+    std::fseek(f, 0, SEEK_END);
+    if (std::ftell(f) == 0) {
+        std::fprintf(f, "# event\tsteps");
+        for (int i=0; i<nsubsystems; ++i)
+            std::fprintf(f, "\t%s\t%s_peak", name(i), name(i));
+        std::fprintf(f, "\ttotal\ttotal_peak\trss\trss_max\n");
+    }
+
+    std::fprintf(f, "%s\t%10d", event, steps);
+    for (int i=0; i<nsubsystems; ++i)
+        std::fprintf(f, "\t%zu\t%zu", current(i), peak(i));
+    std::fprintf(f, "\t%zu\t%zu\t%zu\t%zu\n", total(), peak_total(),
+                 resident_set_size(), max_resident_set_size());
+    std::fclose(f);
+
+    for (int i=0; i<nsubsystems; ++i)
+        peaks[i] = current(i);
+    peak_sum = total();
+}
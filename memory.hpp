@@ -0,0 +1,127 @@
+#ifndef DYNEARTHSOL3D_MEMORY_HPP
+#define DYNEARTHSOL3D_MEMORY_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "array2d.hpp"
+#include "shape-deriv.hpp"
+
+struct Variables;
+
+/* Heap memory held by each subsystem, current and peak.
+ *
+ * The arrays in Variables and MarkerSet are counted by update(var). The
+ * temporary arrays, which are not referenced by Variables, are registered
+ * by their owners for the duration of their scope:
+ *     ScopedMemory mem(*var.memory, MemoryUsage::remesh, nbytes(old_coord));
+ *
+ * The peaks are the largest usage since the last call to write_log().
+ */
+
+class MemoryUsage
+{
+public:
+    enum Subsystem {
+        mesh, fields, markers, support, remesh, interpolation,
+        nsubsystems
+    };
+
+    MemoryUsage();
+
+    static const char* name(int subsystem);
+
+    void update(const Variables &var);
+    void add(Subsystem subsystem, std::size_t bytes);
+    void remove(Subsystem subsystem, std::size_t bytes);
+
+    std::size_t current(int subsystem) const;
+    std::size_t peak(int subsystem) const;
+    std::size_t total() const;
+    std::size_t peak_total() const;
+
+    void write_log(const std::string &modelname, const char *event,
+                   int steps, bool new_file);
+
+private:
+    std::size_t owned[nsubsystems];      // counted by update()
+    std::size_t transient[nsubsystems];  // registered by add() and remove()
+    std::size_t peaks[nsubsystems];
+    std::size_t peak_sum;
+
+    void update_peaks();
+};
+
+
+class ScopedMemory
+{
+public:
+    ScopedMemory(MemoryUsage &memory, MemoryUsage::Subsystem subsystem, std::size_t bytes) :
+        memory(memory), subsystem(subsystem), bytes(bytes)
+    {
+        memory.add(subsystem, bytes);
+    }
+
+    ~ScopedMemory()
+    {
+        memory.remove(subsystem, bytes);
+    }
+
+private:
+    MemoryUsage &memory;
+    const MemoryUsage::Subsystem subsystem;
+    const std::size_t bytes;
+};
+
+
+//
+// Size of the heap memory of an array
+//
+
+template <typename T, int N>
+std::size_t nbytes(const Array2D<T,N> &a)
+{
+    return a.capacity() * N * sizeof(T);
+}
+
+template <typename T, typename A>
+std::size_t nbytes(const std::vector<T,A> &a)
+{
+    return a.capacity() * sizeof(T);
+}
+
+template <typename T, typename A>
+std::size_t nbytes(const std::vector< std::vector<T,A> > &a)
+{
+    std::size_t n = a.capacity() * sizeof(std::vector<T,A>);
+    for (std::size_t i=0; i<a.size(); ++i)
+        n += nbytes(a[i]);
+    return n;
+}
+
+inline std::size_t nbytes(const ShapeDeriv &a)
+{
+    return a.capacity_bytes();
+}
+
+template <typename T>
+std::size_t nbytes(const T *a)
+{
+    return (a == NULL) ? 0 : nbytes(*a);
+}
+
+// resident set size of the process, in bytes, 0 if not available
+std::size_t resident_set_size();
+
+// elem_center() of a mesh of nelem elements
+std::size_t elem_center_nbytes(int nelem);
+
+// Barycentric_transformation of a mesh of nelem elements
+std::size_t barycentric_nbytes(int nelem);
+
+// ANN kd-tree of npoints points, roughly one leaf and one splitting node
+// per point, excluding the points themselves
+std::size_t kdtree_nbytes(int npoints);
+
+#endif
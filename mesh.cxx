@@ -1,8 +1,14 @@
 
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <iostream>
+#include <limits>
+#include <numeric>
 #include <string>
+#include <stdint.h>
 
 #ifdef USE_OMP
 #include <omp.h>
@@ -31,6 +37,7 @@
 #include "utils.hpp"
 #include "mesh.hpp"
 #include "markerset.hpp"
+#include "rng.hpp"
 
 
 namespace { // anonymous namespace
@@ -490,6 +497,7 @@ void new_mesh_refined_zone(const Param& param, Variables& var)
     // To prevent the meshing library giving us a regular grid, the nodes
     // will be shifted randomly by a small distance
     const double shift_factor = 0.1;
+    const int seed = param.sim.random_seed;
 
     // typical distance between nodes in the refined zone
     const double d = param.mesh.resolution / std::sqrt(2);
@@ -558,8 +566,8 @@ void new_mesh_refined_zone(const Param& param, Variables& var)
         int n = 8;
         for (int i=0; i<nx; ++i) {
             for (int k=0; k<nz; ++k) {
-                double rx = drand48() - 0.5;
-                double rz = drand48() - 0.5;
+                double rx = rng::uniform(seed, rng::mesh_shift, n  ) - 0.5;
+                double rz = rng::uniform(seed, rng::mesh_shift, n+1) - 0.5;
                 points[n  ] = x0 * m.xlength + (i + shift_factor*rx) * dx;
                 points[n+1] = (1-z0) * -m.zlength + (k + shift_factor*rz) * dz;
                 n += NDIMS;
@@ -650,9 +658,9 @@ void new_mesh_refined_zone(const Param& param, Variables& var)
         for (int i=0; i<nx; ++i) {
             for (int j=0; j<ny; ++j) {
                 for (int k=0; k<nz; ++k) {
-                    double rx = drand48() - 0.5;
-                    double ry = drand48() - 0.5;
-                    double rz = drand48() - 0.5;
+                    double rx = rng::uniform(seed, rng::mesh_shift, n  ) - 0.5;
+                    double ry = rng::uniform(seed, rng::mesh_shift, n+1) - 0.5;
+                    double rz = rng::uniform(seed, rng::mesh_shift, n+2) - 0.5;
                     points[n  ] = x0 * m.xlength + (i + shift_factor*rx) * dx;
                     points[n+1] = y0 * m.ylength + (j + shift_factor*ry) * dy;
                     points[n+2] = (1-z0) * -m.zlength + (k + shift_factor*rz) * dz;
@@ -956,6 +964,352 @@ void new_mesh_from_polyfile(const Param& param, Variables& var)
     delete [] regattr;
 }
 
+
+uint64_t hilbert_index(uint32_t n, uint32_t x, uint32_t y)
+{
+    /* Position of the cell (x, y) along the Hilbert curve filling an n x n
+     * grid, n a power of 2. The curve starts at (0, 0) and ends at (n-1, 0).
+     */
+    uint64_t d = 0;
+    for (uint32_t s=n/2; s>0; s/=2) {
+        const uint32_t rx = (x & s) ? 1 : 0;
+        const uint32_t ry = (y & s) ? 1 : 0;
+        d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+        // rotate the quadrant
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+
+class SpaceFillingKey
+{
+    /* Sort key of a point for renumbering_mesh(). The domain is cut into
+     * slabs along x, a quarter of the mean node spacing thick, visited in
+     * order of x, so that the element groups of create_elem_groups() are
+     * still bands along x. Within a slab, the points follow a Hilbert curve
+     * in the (y, z) plane (along z in 2D), in the same direction in every
+     * slab, so that an element is about as far in the numbering from its
+     * neighbors in the next slabs as the slabs between them. Thicker slabs,
+     * or reversing every other slab, make the groups need more elements to
+     * stay bands, i.e. fewer threads for the same mesh.
+     */
+public:
+    SpaceFillingKey(const array_t &coord)
+    {
+        for (int d=0; d<NDIMS; ++d) {
+            xmin[d] = std::numeric_limits<double>::max();
+            xmax[d] = -std::numeric_limits<double>::max();
+        }
+        for (std::size_t i=0; i<coord.size(); ++i) {
+            for (int d=0; d<NDIMS; ++d) {
+                xmin[d] = std::min(xmin[d], coord[i][d]);
+                xmax[d] = std::max(xmax[d], coord[i][d]);
+            }
+        }
+        double vol = 1;
+        for (int d=0; d<NDIMS; ++d)
+            vol *= std::max(xmax[d] - xmin[d], 1e-300);
+        const double spacing = std::pow(vol / std::max(coord.size(), std::size_t(1)), 1.0 / NDIMS);
+        nslabs = std::max(1, static_cast<int>(4 * (xmax[0] - xmin[0]) / spacing));
+    }
+
+    uint64_t operator()(const double *x) const
+    {
+        const uint32_t slab = static_cast<uint32_t>(cell(x[0], 0, nslabs));
+#ifdef THREED
+        const uint32_t n = 1u << 16;
+        const uint64_t c = hilbert_index(n, cell(x[1], 1, n), cell(x[2], 2, n));
+#else
+        const uint32_t n = 1u << 31;
+        const uint64_t c = cell(x[1], 1, n);
+#endif
+        return (static_cast<uint64_t>(slab) << 32) | c;
+    }
+
+private:
+    double xmin[NDIMS], xmax[NDIMS];
+    int nslabs;
+
+    uint32_t cell(double x, int d, uint32_t n) const
+    {
+        const double f = (x - xmin[d]) / std::max(xmax[d] - xmin[d], 1e-300);
+        return static_cast<uint32_t>(std::min(std::max(f * n, 0.0), n - 1.0));
+    }
+};
+
+
+void space_filling_order(const array_t &coord, const conn_t &connectivity,
+                         std::vector<std::size_t> &nd_idx, std::vector<std::size_t> &el_idx)
+{
+    const SpaceFillingKey key(coord);
+
+    std::vector<uint64_t> wn(coord.size());
+    #pragma omp parallel for default(none) shared(coord, key, wn)
+    for(std::size_t i=0; i<wn.size(); i++) {
+        wn[i] = key(coord[i]);
+    }
+
+    std::vector<uint64_t> we(connectivity.size());
+    #pragma omp parallel for default(none) shared(coord, connectivity, key, we)
+    for(std::size_t i=0; i<we.size(); i++) {
+        const int *conn = connectivity[i];
+        double center[NDIMS] = {0};
+        for(int j=0; j<NODES_PER_ELEM; j++)
+            for(int d=0; d<NDIMS; d++)
+                center[d] += coord[conn[j]][d];
+        for(int d=0; d<NDIMS; d++)
+            center[d] /= NODES_PER_ELEM;
+        we[i] = key(center);
+    }
+
+    sortindex(wn, nd_idx);
+    sortindex(we, el_idx);
+}
+
+
+int bfs_levels(const int_vec &adj_start, const int_vec &adj, int root,
+               int_vec &level, int_vec &queue)
+{
+    /* Breadth-first search of the component of root, the nodes are appended
+     * to queue in the order of their visit. Returns the number of levels.
+     */
+    const std::size_t q0 = queue.size();
+    level[root] = 0;
+    queue.push_back(root);
+    int nlevels = 1;
+    for (std::size_t q=q0; q<queue.size(); ++q) {
+        const int n = queue[q];
+        for (int k=adj_start[n]; k<adj_start[n+1]; ++k) {
+            const int m = adj[k];
+            if (level[m] < 0) {
+                level[m] = level[n] + 1;
+                nlevels = level[m] + 1;
+                queue.push_back(m);
+            }
+        }
+    }
+    return nlevels;
+}
+
+
+void rcm_order(int nnode, const conn_t &connectivity,
+               std::vector<std::size_t> &nd_idx, std::vector<std::size_t> &el_idx)
+{
+    /* Nodes in reverse Cuthill-McKee order of the graph of the nodes sharing
+     * an element, starting each component from a pseudo-peripheral node.
+     * Elements in order of their lowest node, then of their highest node.
+     * The levels of the search are fronts across the mesh, so contiguous
+     * element groups are still bands (see create_elem_groups()).
+     */
+    const int nelem = connectivity.size();
+
+    // node adjacency in compressed rows
+    int_vec adj_start(nnode + 1, 0);
+    for (int e=0; e<nelem; ++e)
+        for (int i=0; i<NODES_PER_ELEM; ++i)
+            adj_start[connectivity[e][i] + 1] += NODES_PER_ELEM - 1;
+    for (int n=0; n<nnode; ++n)
+        adj_start[n+1] += adj_start[n];
+    int_vec adj(adj_start[nnode]);
+    {
+        int_vec pos(adj_start.begin(), adj_start.end() - 1);
+        for (int e=0; e<nelem; ++e) {
+            const int *conn = connectivity[e];
+            for (int i=0; i<NODES_PER_ELEM; ++i)
+                for (int j=0; j<NODES_PER_ELEM; ++j)
+                    if (i != j) adj[pos[conn[i]]++] = conn[j];
+        }
+    }
+    // remove the duplicated neighbors
+    int_vec degree(nnode);
+    {
+        int k = 0;
+        for (int n=0; n<nnode; ++n) {
+            std::sort(adj.begin() + adj_start[n], adj.begin() + adj_start[n+1]);
+            const int end = std::unique(adj.begin() + adj_start[n], adj.begin() + adj_start[n+1])
+                - adj.begin();
+            const int start = k;
+            for (int m=adj_start[n]; m<end; ++m)
+                adj[k++] = adj[m];
+            adj_start[n] = start;
+            degree[n] = k - start;
+        }
+        adj_start[nnode] = k;
+        adj.resize(k);
+    }
+
+    int_vec order;
+    order.reserve(nnode);
+    int_vec level(nnode, -1);
+    int_vec queue;
+    for (int seed=0; seed<nnode; ++seed) {
+        if (level[seed] >= 0) continue;
+
+        // pseudo-peripheral node: the node of lowest degree in the last
+        // level of a search, until the number of levels stops growing
+        int root = seed;
+        int nlevels = 0;
+        for (;;) {
+            queue.clear();
+            const int nl = bfs_levels(adj_start, adj, root, level, queue);
+            int next = root;
+            for (std::size_t q=0; q<queue.size(); ++q) {
+                const int n = queue[q];
+                if (level[n] == nl - 1 && (next == root || degree[n] < degree[next]))
+                    next = n;
+            }
+            for (std::size_t q=0; q<queue.size(); ++q)
+                level[queue[q]] = -1;
+            if (nl <= nlevels) break;
+            nlevels = nl;
+            root = next;
+        }
+
+        // Cuthill-McKee: visit the neighbors in ascending degree
+        const std::size_t first = order.size();
+        level[root] = 0;
+        order.push_back(root);
+        int_vec nbrs;
+        for (std::size_t q=first; q<order.size(); ++q) {
+            const int n = order[q];
+            nbrs.clear();
+            for (int k=adj_start[n]; k<adj_start[n+1]; ++k) {
+                const int m = adj[k];
+                if (level[m] < 0) {
+                    level[m] = level[n] + 1;
+                    nbrs.push_back(m);
+                }
+            }
+            for (std::size_t i=1; i<nbrs.size(); ++i) {
+                // insertion sort, the lists are short
+                const int m = nbrs[i];
+                std::size_t j = i;
+                for (; j>0 && degree[nbrs[j-1]] > degree[m]; --j)
+                    nbrs[j] = nbrs[j-1];
+                nbrs[j] = m;
+            }
+            order.insert(order.end(), nbrs.begin(), nbrs.end());
+        }
+    }
+
+    for (int i=0; i<nnode; ++i)
+        nd_idx[i] = order[nnode - 1 - i];
+
+    int_vec nd_new(nnode);
+    for (int i=0; i<nnode; ++i)
+        nd_new[nd_idx[i]] = i;
+
+    std::vector<uint64_t> we(nelem);
+    for (int e=0; e<nelem; ++e) {
+        const int *conn = connectivity[e];
+        int lo = nd_new[conn[0]], hi = lo;
+        for (int i=1; i<NODES_PER_ELEM; ++i) {
+            lo = std::min(lo, nd_new[conn[i]]);
+            hi = std::max(hi, nd_new[conn[i]]);
+        }
+        we[e] = (static_cast<uint64_t>(lo) << 32) | static_cast<uint32_t>(hi);
+    }
+    sortindex(we, el_idx);
+}
+
+
+void ordering_quality(const conn_t &connectivity, const int_vec &nd_new,
+                      const std::vector<std::size_t> &el_idx,
+                      int &bandwidth, double &gather_distance)
+{
+    /* bandwidth: the max. difference of the node numbers of an element.
+     * gather distance: the distance of the number of a node read by an
+     * element from the mean node number of the previous element, averaged
+     * over the nodes of all elements. The smaller, the more of the nodal
+     * data of an element are still in cache from the previous one.
+     */
+    const int nelem = connectivity.size();
+    bandwidth = 0;
+    double sum = 0;
+    double prev_mean = 0;
+    for (int i=0; i<nelem; ++i) {
+        const int *conn = connectivity[el_idx[i]];
+        int lo = nd_new[conn[0]], hi = lo;
+        double mean = 0;
+        for (int j=0; j<NODES_PER_ELEM; ++j) {
+            const int n = nd_new[conn[j]];
+            lo = std::min(lo, n);
+            hi = std::max(hi, n);
+            mean += n;
+            if (i > 0) sum += std::fabs(n - prev_mean);
+        }
+        bandwidth = std::max(bandwidth, hi - lo);
+        prev_mean = mean / NODES_PER_ELEM;
+    }
+    gather_distance = (nelem > 1) ? sum / (double(nelem - 1) * NODES_PER_ELEM) : 0;
+}
+
+
+void mesh_order(int option, const array_t &coord, const conn_t &connectivity,
+                std::vector<std::size_t> &nd_idx, std::vector<std::size_t> &el_idx)
+{
+    switch (option) {
+    case 0:
+        space_filling_order(coord, connectivity, nd_idx, el_idx);
+        break;
+    case 1:
+        rcm_order(coord.size(), connectivity, nd_idx, el_idx);
+        break;
+    default:
+        // as generated
+        std::iota(nd_idx.begin(), nd_idx.end(), 0);
+        std::iota(el_idx.begin(), el_idx.end(), 0);
+        break;
+    }
+}
+
+
+void inverse_permutation(const std::vector<std::size_t> &idx, int_vec &inv)
+{
+    for(std::size_t i=0; i<idx.size(); i++)
+        inv[idx[i]] = i;
+}
+
+
+void split_elem_groups(Variables& var, int ngroups)
+{
+    /* Cut the elements into ngroups (even) contiguous groups. Each node must
+     * be shared by the elements of at most two adjacent groups, see
+     * loop_all_elem(). When the groups are thinner than the bands of the
+     * mesh numbering, e.g. on a small mesh or the partition of a process in
+     * the MPI build, a node is shared by groups two apart. Use fewer groups
+     * until it is not. */
+    for (;; ngroups -= 2) {
+        var.egroups.clear();
+        for(int i=0; i<ngroups; i++)
+            var.egroups.push_back(static_cast<long>(i) * var.nelem / ngroups);
+        var.egroups.push_back(var.nelem);
+        if (ngroups <= 2) break;
+
+        int_vec gmin(var.nnode, ngroups), gmax(var.nnode, -1);
+        for (int g=0; g<ngroups; ++g) {
+            for (int e=var.egroups[g]; e<var.egroups[g+1]; ++e) {
+                const int *conn = (*var.connectivity)[e];
+                for (int i=0; i<NODES_PER_ELEM; ++i) {
+                    gmin[conn[i]] = std::min(gmin[conn[i]], g);
+                    gmax[conn[i]] = std::max(gmax[conn[i]], g);
+                }
+            }
+        }
+        int n;
+        for (n=0; n<var.nnode; ++n)
+            if (gmax[n] - gmin[n] > 1) break;
+        if (n == var.nnode) break;
+    }
+}
+
 }
 
 
@@ -1034,38 +1388,37 @@ void points_to_new_surface(const Mesh &mesh, int npoints, const double *points,
 
 void renumbering_mesh(const Param& param, array_t &coord, conn_t &connectivity, segment_t &segment)
 {
-    /* Renumbering nodes and elements to enhance cache coherance and better parallel performace. */
+    /* Renumbering nodes and elements to enhance cache coherance and better parallel performace.
+     * See mesh.renumbering_option for the orderings.
+     */
 
     const int nnode = coord.size();
     const int nelem = connectivity.size();
     const int nseg = segment.size();
 
-    //
-    // sort coordinate of nodes and element centers
-    //
-
-    //
-    double_vec wn(nnode);
-    double aspect_ratio_factor = 1e-6 * param.mesh.xlength / param.mesh.zlength;
-    for(int i=0; i<nnode; i++) {
-        wn[i] = coord[i][0] - aspect_ratio_factor * coord[i][NDIMS-1];
-    }
-
-    double_vec we(nelem);
-    for(int i=0; i<nelem; i++) {
-        const int *conn = connectivity[i];
-        we[i] = wn[conn[0]] + wn[conn[1]]
-#ifdef THREED
-            + wn[conn[2]]
-#endif
-            + wn[conn[NODES_PER_ELEM-1]];
-    }
-
     // arrays to store the result of sorting
     std::vector<std::size_t> nd_idx(nnode);
     std::vector<std::size_t> el_idx(nelem);
-    sortindex(wn, nd_idx);
-    sortindex(we, el_idx);
+    // the new number of each old node
+    int_vec nd_new(nnode);
+
+    if (param.mesh.has_renumbering_report) {
+        static const char *names[] = {"space-filling curve", "reverse Cuthill-McKee", "as generated"};
+        std::cout << "  Renumbering " << nnode << " nodes and " << nelem << " elements:\n";
+        for (int option=2; option>=0; --option) {
+            mesh_order(option, coord, connectivity, nd_idx, el_idx);
+            inverse_permutation(nd_idx, nd_new);
+            int bandwidth;
+            double gather_distance;
+            ordering_quality(connectivity, nd_new, el_idx, bandwidth, gather_distance);
+            std::cout << "    " << names[option] << ": bandwidth = " << bandwidth
+                      << ", average gather distance = " << gather_distance
+                      << (option == param.mesh.renumbering_option ? " (used)\n" : "\n");
+        }
+    }
+
+    mesh_order(param.mesh.renumbering_option, coord, connectivity, nd_idx, el_idx);
+    inverse_permutation(nd_idx, nd_new);
 
     //
     // renumbering
@@ -1081,19 +1434,15 @@ void renumbering_mesh(const Param& param, array_t &coord, conn_t &connectivity,
     conn_t conn2(nelem);
     for(int i=0; i<nelem; i++) {
         int n = el_idx[i];
-        for(int j=0; j<NODES_PER_ELEM; j++) {
-            int k = connectivity[n][j];
-            conn2[i][j] = std::find(nd_idx.begin(), nd_idx.end(), k) - nd_idx.begin();
-        }
+        for(int j=0; j<NODES_PER_ELEM; j++)
+            conn2[i][j] = nd_new[connectivity[n][j]];
     }
     connectivity.steal_ref(conn2);
 
     segment_t seg2(nseg);
     for(int i=0; i<nseg; i++) {
-        for(int j=0; j<NDIMS; j++) {
-            int k = segment[i][j];
-            seg2[i][j] = std::find(nd_idx.begin(), nd_idx.end(), k) - nd_idx.begin();
-        }
+        for(int j=0; j<NDIMS; j++)
+            seg2[i][j] = nd_new[segment[i][j]];
     }
     segment.steal_ref(seg2);
 }
@@ -1204,26 +1553,33 @@ void create_support(Variables& var)
 }
 
 
-void create_elem_groups(Variables& var)
+void create_elem_groups(const Param& param, Variables& var)
 {
     var.egroups.clear();
 
+    if (param.sim.deterministic_ngroups > 0) {
+        /* A fixed number of groups, independent of the number of threads.
+         * Each node is shared by the elements of at most two adjacent groups,
+         * so its sum is always added in the same order: the elements of the
+         * even group, then of the odd group, see loop_all_elem(). */
+        int ngroups = std::min(param.sim.deterministic_ngroups, std::max(var.nelem, 1));
+        ngroups += ngroups % 2;
+        split_elem_groups(var, ngroups);
+        return;
+    }
+
 #ifdef USE_OMP
 
     /* T: # of openmp threads
      *
      * Decompose the mesh into 2T bands.
      * The band is ordered as: 0, 1, 2, ...., 2T-2, 2T-1.
-     * Band-N and Band-(N+2) will be disjoint and not sharing any nodes.
+     * Band-N and Band-(N+2) will be disjoint and not sharing any nodes,
+     * with fewer bands if the mesh is too thin for 2T.
      */
 
     int nthreads = omp_get_max_threads();
-    int ngroups = 2 * nthreads;
-    int el_per_group = var.nelem / ngroups;
-
-    for(int i=0; i<ngroups; i++)
-        var.egroups.push_back(i*el_per_group);
-    var.egroups.push_back(var.nelem);
+    split_elem_groups(var, 2 * nthreads);
 
 #else
 
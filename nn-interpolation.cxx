@@ -4,6 +4,7 @@
 
 #include "constants.hpp"
 #include "parameters.hpp"
+#include "memory.hpp"
 #include "mesh.hpp"
 #include "nn-interpolation.hpp"
 
@@ -11,6 +12,11 @@
 void find_nearest_neighbor(Variables &var, const array_t &old_coord,
                            const conn_t &old_connectivity, int_vec &idx)
 {
+    ScopedMemory mem(*var.memory, MemoryUsage::interpolation,
+                     elem_center_nbytes(old_connectivity.size()) +
+                     kdtree_nbytes(old_connectivity.size()) +
+                     elem_center_nbytes(var.nelem));
+
     std::cout << "Constructing a kd-tree.\n";
     // kdtree requires the coordinate as double**
     double **old_center = elem_center(old_coord, old_connectivity);
@@ -39,7 +45,8 @@ void find_nearest_neighbor(Variables &var, const array_t &old_coord,
 }
 
 
-static void inject_field(const int_vec &idx, const double_vec &source, double_vec &target)
+template <typename T, typename A>
+static void inject_field(const int_vec &idx, const std::vector<T,A> &source, std::vector<T,A> &target)
 {
     #pragma omp parallel for default(none)          \
         shared(idx, source, target)
@@ -68,29 +75,30 @@ static void nn_interpolate_elem_fields(Variables &var, const int_vec &idx)
     const int n = var.nnode;
     const int e = var.nelem;
 
-    double_vec *a;
-
-    a = new double_vec(e);
-    inject_field(idx, *var.plstrain, *a);
-    delete var.plstrain;
-    var.plstrain = a;
-
-    a = new double_vec(e);
-    inject_field(idx, *var.delta_plstrain, *a);
-    delete var.delta_plstrain;
-    var.delta_plstrain = a;
+    // The old field is still read while injecting, so the new field needs
+    // its own buffer. After the swap, the buffer of the old field is reused
+    // for the next field of the same type.
+    {
+        double_vec a(e);
+        inject_field(idx, *var.plstrain, a);
+        var.plstrain->swap(a);
+    }
 
-    tensor_t *b;
-    b = new tensor_t(e);
-    inject_field(idx, *var.strain, *b);
-    delete var.strain;
-    var.strain = b;
+    {
+        lowp_vec a(e);
+        inject_field(idx, *var.delta_plstrain, a);
+        var.delta_plstrain->swap(a);
+    }
 
-    b = new tensor_t(e);
-    inject_field(idx, *var.stress, *b);
-    delete var.stress;
-    var.stress = b;
+    {
+        tensor_t b(e);
+        inject_field(idx, *var.strain, b);
+        var.strain->swap(b);
 
+        b.resize(e);
+        inject_field(idx, *var.stress, b);
+        var.stress->swap(b);
+    }
 }
 
 
@@ -98,6 +106,7 @@ void nearest_neighbor_interpolation(Variables &var, const array_t &old_coord,
                                     const conn_t &old_connectivity)
 {
     int_vec idx(var.nelem);
+    ScopedMemory mem(*var.memory, MemoryUsage::interpolation, nbytes(idx));
     find_nearest_neighbor(var, old_coord, old_connectivity, idx);
 
     nn_interpolate_elem_fields(var, idx);
@@ -3,6 +3,7 @@
 #include <cstdio>
 #include <iterator>  // For std::distance
 #include <iostream>
+#include <sstream>
 
 #ifdef USE_OMP
 #include <omp.h>
@@ -13,9 +14,14 @@
 #include "constants.hpp"
 #include "parameters.hpp"
 #include "binaryio.hpp"
+#include "decomposition.hpp"
+#include "hwcounters.hpp"
 #include "markerset.hpp"
 #include "matprops.hpp"
+#include "memory.hpp"
 #include "output.hpp"
+#include "roofline.hpp"
+#include "timers.hpp"
 
 
 Output::Output(const Param& param, double start_time, int start_frame) :
@@ -23,22 +29,108 @@ Output::Output(const Param& param, double start_time, int start_frame) :
     start_time(start_time),
     average_interval(param.sim.output_averaged_fields),
     has_marker_output(param.sim.has_marker_output),
+    has_container_output(param.sim.has_container_output),
     frame(start_frame),
+    last_chkpt_frame(-1),
     time0(0)
-{}
+{
+    register_fields(param.sim.output_field_intervals);
+
+    if (! is_root_process()) return;
+
+    if (has_container_output && start_frame == 0) {
+        // starting a new container, discarding previous content
+        std::string filename(modelname + ".frames");
+        create_container_file(filename.c_str());
+    }
+
+    if (param.sim.topography_step_interval && start_frame == 0) {
+        // starting a new topography file, discarding previous content
+        std::string filename(modelname + ".topo");
+        std::FILE* f = std::fopen(filename.c_str(), "w");
+        if (f == NULL) {
+            std::cerr << "Error: cannot open file: " << filename << '\n';
+            std::exit(2);
+        }
+        std::fclose(f);
+    }
+}
 
 
 Output::~Output()
 {}
 
 
-void Output::write_info(const Variables& var, double dt)
+void Output::register_fields(const std::string &intervals)
+{
+    /* Coordinate and connectivity are always written, and are not listed
+     * here. Fields read by restart() must be present in the frames with a
+     * checkpoint. */
+    const char *restart_fields[] = {"velocity", "temperature", "mesh_quality",
+                                    "plastic_strain", "strain_rate", "strain",
+                                    "stress", "force"};
+    const char *other_fields[] = {"plastic_strain_rate", "density", "viscosity",
+                                  "material", "markers"};
+    for (std::size_t i=0; i<sizeof(restart_fields)/sizeof(restart_fields[0]); ++i) {
+        FieldSpec spec = {1, true};
+        fields[restart_fields[i]] = spec;
+    }
+    for (std::size_t i=0; i<sizeof(other_fields)/sizeof(other_fields[0]); ++i) {
+        FieldSpec spec = {1, false};
+        fields[other_fields[i]] = spec;
+    }
+
+    // parsing 'name:N, name:N, ...'
+    std::istringstream stream(intervals);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        std::istringstream is(item);
+        std::string name;
+        int n;
+        char sep;
+        if (! (is >> std::ws).good()) continue;  // empty item
+        if (! std::getline(is, name, ':') || ! (is >> n) || (is >> sep)) {
+            std::cerr << "Error: incorrect format for sim.output_field_intervals: '" << item << "',\n"
+                      << "       must be 'name:N, name:N, ...'\n";
+            std::exit(1);
+        }
+        name.erase(name.find_last_not_of(" \t") + 1);
+
+        std::map<std::string, FieldSpec>::iterator it = fields.find(name);
+        if (it == fields.end()) {
+            std::cerr << "Error: unknown field name in sim.output_field_intervals: " << name << '\n';
+            std::exit(1);
+        }
+        if (n < 0) {
+            std::cerr << "Error: negative interval in sim.output_field_intervals: " << name << '\n';
+            std::exit(1);
+        }
+        it->second.interval = n;
+    }
+}
+
+
+bool Output::is_due(const char *field) const
+{
+    const FieldSpec &spec = fields.find(field)->second;
+    if (spec.needed_by_restart && frame == last_chkpt_frame) return true;
+    return spec.interval && (frame % spec.interval == 0);
+}
+
+
+double Output::elapsed_time() const
 {
 #ifdef USE_OMP
-    double run_time = omp_get_wtime() - start_time;
+    return omp_get_wtime() - start_time;
 #else
-    double run_time = double(std::clock()) / CLOCKS_PER_SEC;
+    return double(std::clock()) / CLOCKS_PER_SEC;
 #endif
+}
+
+
+void Output::write_info(const Variables& var, double dt)
+{
+    double run_time = elapsed_time();
 
     char buffer[256];
     std::snprintf(buffer, 255, "%6d\t%10d\t%12.6e\t%12.4e\t%12.6e\t%8d\t%8d\t%8d\n",
@@ -56,111 +148,302 @@ void Output::write_info(const Variables& var, double dt)
 }
 
 
-void Output::write(const Variables& var, bool is_averaged)
+void Output::write_timing(const Variables& var)
 {
-    double dt = var.dt;
-    double inv_dt = 1 / var.dt;
-    if (average_interval && is_averaged) {
-        dt = (var.time - time0) / average_interval;
-        inv_dt = 1.0 / (var.time - time0);
+    /* Appending the time spent in each phase since the previous frame to
+     * modelname.timing. The time of writing a frame is counted in the next
+     * frame. */
+    std::string filename(modelname + ".timing");
+    std::FILE* f;
+    if (frame == 0)
+        f = std::fopen(filename.c_str(), "w");
+    else
+        f = std::fopen(filename.c_str(), "a");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << filename << '\n';
+        std::exit(2);
     }
-    write_info(var, dt);
 
-    char filename[256];
-    std::snprintf(filename, 255, "%s.save.%06d", modelname.c_str(), frame);
-    BinaryOutput bin(filename);
+    if (frame == 0) {
+        std::fprintf(f, "# frame\tsteps");
+        for (int i=0; i<PhaseTimers::nphases; ++i)
+            std::fprintf(f, "\t%s", PhaseTimers::name(i));
+        std::fprintf(f, "\n");
+    }
 
-    bin.write_array(*var.coord, "coordinate");
-    bin.write_array(*var.connectivity, "connectivity");
+    double t[PhaseTimers::nphases];
+    var.timers->sum(t);
+    var.timers->reset();
+    if (var.roofline) var.roofline->add(var, t);
 
-    bin.write_array(*var.vel, "velocity");
-    if (average_interval && is_averaged) {
+    std::fprintf(f, "%6d\t%10d", frame, var.steps);
+    for (int i=0; i<PhaseTimers::nphases; ++i)
+        std::fprintf(f, "\t%10.4e", t[i]);
+    std::fprintf(f, "\n");
+    std::fclose(f);
+}
+
+
+const char* Output::output_target(const char *kind, char *filename, char *group) const
+{
+    /* Returns the group name if writing to the container, or NULL if
+     * writing to a separate file. */
+    if (has_container_output) {
+        std::snprintf(filename, 255, "%s.frames", modelname.c_str());
+        std::snprintf(group, 31, "%s.%06d", kind, frame);
+        return group;
+    }
+
+    std::snprintf(filename, 255, "%s.%s.%06d", modelname.c_str(), kind, frame);
+    return NULL;
+}
+
+
+void Output::write_time_to_first_step()
+{
+    if (! is_root_process()) return;
+
+    /* Appending a comment line to the info file, the line is skipped when
+     * the info file is parsed. */
+    char buffer[256];
+    std::snprintf(buffer, 255, "# time to first step after restarting from frame %d: %12.6e sec\n",
+                  frame - 1, elapsed_time());
+
+    std::string filename(modelname + ".info");
+    std::FILE* f = std::fopen(filename.c_str(), "a");
+    std::fputs(buffer, f);
+    std::fclose(f);
+}
+
+
+void Output::compute_derived_fields(const Variables& var, double inv_dt, bool is_averaged)
+{
+    /* Computing all fields that are not stored in var, before any of the
+     * arrays is written. */
+
+    if (average_interval && is_averaged && is_due("velocity")) {
         // average_velocity = displacement / delta_t
         double *c0 = coord0.data();
         const double *c = var.coord->data();
-        for (int i=0; i<coord0.num_elements(); ++i) {
+        int n = coord0.num_elements();
+        #pragma omp parallel for default(none) shared(c0, c, n, inv_dt)
+        for (int i=0; i<n; ++i) {
             c0[i] = (c[i] - c0[i]) * inv_dt;
         }
-        bin.write_array(coord0, "velocity averaged");
     }
 
-    bin.write_array(*var.temperature, "temperature");
-
-
-    bin.write_array(*var.elquality, "mesh quality");
-    bin.write_array(*var.plstrain, "plastic strain");
-
-    // Strain rate and plastic strain rate do not need to be checkpointed,
-    // so we don't have to distinguish averged/non-averaged variants.
-    double_vec *delta_plstrain = var.delta_plstrain;
-    if (average_interval && is_averaged) {
+    if (average_interval && is_averaged && is_due("strain_rate")) {
         // average_strain_rate = delta_strain / delta_t
-        delta_plstrain = &delta_plstrain_avg;
+        double *s0 = strain0.data();
+        const double *s = var.strain->data();
+        int m = strain0.num_elements();
+        #pragma omp parallel for default(none) shared(s0, s, m, inv_dt)
+        for (int i=0; i<m; ++i) {
+            s0[i] = (s[i] - s0[i]) * inv_dt;
+        }
+    }
+
+    if (average_interval && is_averaged && is_due("stress")) {
+        double *s_avg = stress_avg.data();
+        double tmp = 1.0 / (average_interval + 1);
+        int l = stress_avg.num_elements();
+        #pragma omp parallel for default(none) shared(s_avg, l, tmp)
+        for (int i=0; i<l; ++i) {
+            s_avg[i] *= tmp;
+        }
     }
     for (std::size_t i=0; i<delta_plstrain_avg.size(); ++i) {
         delta_plstrain_avg[i] *= inv_dt;
     }
-    bin.write_array(*delta_plstrain, "plastic strain-rate");
 
-    tensor_t *strain_rate = var.strain_rate;
-    if (average_interval && is_averaged) {
-        // average_strain_rate = delta_strain / delta_t
-        strain_rate = &strain0;
-        double *s0 = strain0.data();
-        const double *s = var.strain->data();
-        for (int i=0; i<strain0.num_elements(); ++i) {
-            s0[i] = (s[i] - s0[i]) * inv_dt;
+    if (is_due("density")) {
+        density.resize(var.nelem);
+        double_vec &rho = density;
+        #pragma omp parallel for default(none) shared(var, rho)
+        for (int e=0; e<var.nelem; ++e) {
+            rho[e] = var.mat->rho(e);
         }
     }
-    bin.write_array(*strain_rate, "strain-rate");
 
-    bin.write_array(*var.strain, "strain");
-    bin.write_array(*var.stress, "stress");
+    if (is_due("viscosity")) {
+        viscosity.resize(var.nelem);
+        double_vec &visc = viscosity;
+        #pragma omp parallel for default(none) shared(var, visc)
+        for (int e=0; e<var.nelem; ++e) {
+            visc[e] = var.mat->visc(e);
+        }
+    }
+
+    if (is_due("material")) {
+        material.resize(var.nelem);
+        double_vec &mat = material;
+        #pragma omp parallel for default(none) shared(var, mat)
+        for (int e=0; e<var.nelem; ++e) {
+            // Find the most abundant marker mattype in this element
+            const int_vec &a = (*var.elemmarkers)[e];
+            mat[e] = std::distance(a.begin(), std::max_element(a.begin(), a.end()));
+        }
+    }
 
+    if (has_marker_output && is_due("markers"))
+        var.markerset->compute_coordinates(var, marker_coord);
+}
+
+
+void Output::write_topography(const Variables& local_var)
+{
+#ifdef USE_MPI
+    local_var.decomp->gather(local_var);
+    if (! local_var.decomp->is_root()) return;
+    const Variables &var = local_var.decomp->global(local_var);
+#else
+    const Variables &var = local_var;
+#endif
+
+    /* Appending a record to modelname.topo. Each record contains:
+     * step (int), time (double), number of top surface nodes n (int), and
+     * the coordinate of these nodes (n*NDIMS doubles). */
+    const int top_bdry = bdry_order.find(BOUNDZ1)->second;
+    const int_vec& top_nodes = var.bnodes[top_bdry];
+    const int ntop = top_nodes.size();
+
+    topo.resize(ntop * NDIMS);
+    for (int i=0; i<ntop; ++i) {
+        const double *x = (*var.coord)[top_nodes[i]];
+        for (int j=0; j<NDIMS; ++j)
+            topo[i*NDIMS + j] = x[j];
+    }
+
+    std::string filename(modelname + ".topo");
+    std::FILE* f = std::fopen(filename.c_str(), "ab");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << filename << '\n';
+        std::exit(2);
+    }
+    std::fwrite(&var.steps, sizeof(int), 1, f);
+    std::fwrite(&var.time, sizeof(double), 1, f);
+    std::fwrite(&ntop, sizeof(int), 1, f);
+    std::fwrite(topo.data(), sizeof(double), topo.size(), f);
+    std::fclose(f);
+}
+
+
+void Output::write(const Variables& local_var, bool is_averaged)
+{
+#ifdef USE_MPI
+    // the model is gathered and written by the root process
+    Decomposition &decomp = *local_var.decomp;
+    decomp.gather(local_var);
     if (average_interval && is_averaged) {
-        double *s = stress_avg.data();
-        double tmp = 1.0 / (average_interval + 1);
-        for (int i=0; i<stress_avg.num_elements(); ++i) {
-            s[i] *= tmp;
+        decomp.gather_nodes(coord0);
+        decomp.gather_elems(strain0);
+        decomp.gather_elems(stress_avg);
+        decomp.gather_elems(delta_plstrain_avg);
+    }
+    if (! decomp.is_root()) {
+        frame ++;
+        return;
+    }
+    const Variables &var = decomp.global(local_var);
+#else
+    const Variables &var = local_var;
+#endif
+
+    double dt = var.dt;
+    double inv_dt = 1 / var.dt;
+    if (average_interval && is_averaged) {
+        dt = (var.time - time0) / average_interval;
+        inv_dt = 1.0 / (var.time - time0);
+    }
+    write_info(var, dt);
+#ifndef NO_PHASE_TIMERS
+    write_timing(var);
+#endif
+    var.memory->update(var);
+    var.memory->write_log(modelname, "frame", var.steps, frame == 0);
+    if (hw_counters) hw_counters->write(modelname, frame);
+
+    double t0 = elapsed_time();
+    compute_derived_fields(var, inv_dt, is_averaged);
+    double t1 = elapsed_time();
+
+    char filename[256], group[32];
+    const char *in_group = output_target("save", filename, group);
+    BinaryOutput bin(filename, in_group);
+
+    bin.write_array(*var.coord, "coordinate");
+    bin.write_array(*var.connectivity, "connectivity");
+
+    if (is_due("velocity")) {
+        bin.write_array(*var.vel, "velocity");
+        if (average_interval && is_averaged) {
+            bin.write_array(coord0, "velocity averaged");
         }
-        bin.write_array(stress_avg, "stress averaged");
     }
 
-    double_vec tmp(var.nelem);
-    for (int e=0; e<var.nelem; ++e) {
-        tmp[e] = var.mat->rho(e);
+    if (is_due("temperature"))
+        bin.write_array(*var.temperature, "temperature");
+
+    if (is_due("mesh_quality"))
+        bin.write_array(*var.elquality, "mesh quality");
+    if (is_due("plastic_strain"))
+        bin.write_array(*var.plstrain, "plastic strain");
+
+    // Strain rate and plastic strain rate do not need to be checkpointed,
+    // so we don't have to distinguish averged/non-averaged variants.
+    if (is_due("plastic_strain_rate")) {
+        if (average_interval && is_averaged)
+            bin.write_array(delta_plstrain_avg, "plastic strain-rate");
+        else
+            bin.write_array(*var.delta_plstrain, "plastic strain-rate");
     }
-    bin.write_array(tmp, "density");
 
-    for (int e=0; e<var.nelem; ++e) {
-        tmp[e] = var.mat->visc(e);
+    if (is_due("strain_rate")) {
+        tensor_t *strain_rate = var.strain_rate;
+        if (average_interval && is_averaged) {
+            strain_rate = &strain0;
+        }
+        bin.write_array(*strain_rate, "strain-rate");
     }
-    bin.write_array(tmp, "viscosity");
+
+    if (is_due("strain"))
+        bin.write_array(*var.strain, "strain");
+    if (is_due("stress")) {
+        bin.write_array(*var.stress, "stress");
+        if (average_interval && is_averaged) {
+            bin.write_array(stress_avg, "stress averaged");
+        }
+    }
+
+    if (is_due("density"))
+        bin.write_array(density, "density");
+    if (is_due("viscosity"))
+        bin.write_array(viscosity, "viscosity");
     // bin.write_array(*var.mass, "mass");
     // bin.write_array(*var.tmass, "tmass");
     // bin.write_array(*var.volume_n, "volume_n");
     // bin.write_array(*var.volume, "volume");
     // bin.write_array(*var.edvoldt, "edvoldt");
 
-    for (int e=0; e<var.nelem; ++e) {
-        // Find the most abundant marker mattype in this element
-        int_vec &a = (*var.elemmarkers)[e];
-        tmp[e] = std::distance(a.begin(), std::max_element(a.begin(), a.end()));
-    }
-    bin.write_array(tmp, "material");
+    if (is_due("material"))
+        bin.write_array(material, "material");
 
-    bin.write_array(*var.force, "force");
+    if (is_due("force"))
+        bin.write_array(*var.force, "force");
 
     //bin.write_array(*var.bcflag, "bcflag");
 
-    if (has_marker_output)
-        var.markerset->write_save_file(var, bin);
+    if (has_marker_output && is_due("markers"))
+        var.markerset->write_save_file(marker_coord, bin);
 
     bin.close();
+    double t2 = elapsed_time();
+
     std::cout << "  Output # " << frame
               << ", step = " << var.steps
               << ", time = " << var.time / YEAR2SEC << " yr"
-              << ", dt = " << dt / YEAR2SEC << " yr.\n";
+              << ", dt = " << dt / YEAR2SEC << " yr"
+              << ", prep/write = " << t1 - t0 << "/" << t2 - t1 << " sec.\n";
 
     frame ++;
 
@@ -189,25 +472,16 @@ void Output::average_fields(Variables& var)
     if (var.steps % average_interval == 1) {
         time0 = var.time;
 
-        if (coord0.size() != var.coord->size()) {
-            double *tmp = new double[(var.coord)->num_elements()];
-            coord0.reset(tmp, var.coord->size());
-        }
+        coord0.resize(var.coord->size());
         std::copy(var.coord->begin(), var.coord->end(), coord0.begin());
 
-        if (strain0.size() != var.strain->size()) {
-            double *tmp = new double[(var.strain)->num_elements()];
-            strain0.reset(tmp, var.strain->size());
-        }
+        strain0.resize(var.strain->size());
         std::copy(var.strain->begin(), var.strain->end(), strain0.begin());
 
-        if (stress_avg.size() != var.stress->size()) {
-            double *tmp = new double[(var.stress)->num_elements()];
-            stress_avg.reset(tmp, var.stress->size());
-        }
+        stress_avg.resize(var.stress->size());
         std::copy(var.stress->begin(), var.stress->end(), stress_avg.begin());
 
-        delta_plstrain_avg = *var.delta_plstrain;
+        delta_plstrain_avg.assign(var.delta_plstrain->begin(), var.delta_plstrain->end());
     }
     else {
         // Averaging stress & plastic strain
@@ -224,11 +498,25 @@ void Output::average_fields(Variables& var)
 }
 
 
-void Output::write_checkpoint(const Variables& var)
+void Output::write_checkpoint(const Variables& local_var)
 {
-    char filename[256];
-    std::snprintf(filename, 255, "%s.chkpt.%06d", modelname.c_str(), frame);
-    BinaryOutput bin(filename);
+#ifdef USE_MPI
+    local_var.decomp->gather(local_var);
+    if (! local_var.decomp->is_root()) {
+        last_chkpt_frame = frame;
+        return;
+    }
+    const Variables &var = local_var.decomp->global(local_var);
+#else
+    const Variables &var = local_var;
+#endif
+
+    char filename[256], group[32];
+    const char *in_group = output_target("chkpt", filename, group);
+    BinaryOutput bin(filename, in_group);
+
+    // the save file of this frame must contain the fields for restarting
+    last_chkpt_frame = frame;
 
     double_vec tmp(2);
     tmp[0] = var.time;
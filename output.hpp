@@ -1,6 +1,8 @@
 #ifndef DYNEARTHSOL3D_OUTPUT_HPP
 #define DYNEARTHSOL3D_OUTPUT_HPP
 
+#include <map>
+#include <string>
 #include "array2d.hpp"
 
 class Output
@@ -10,7 +12,16 @@ private:
     const double start_time;
     const int average_interval;
     const bool has_marker_output;
+    const bool has_container_output;
     int frame;
+    int last_chkpt_frame;
+
+    struct FieldSpec {
+        int interval;  // in the unit of output frames, 0 for never
+        bool needed_by_restart;
+    };
+    // registry of fields that can be turned off or written less frequently
+    std::map<std::string, FieldSpec> fields;
 
     // stuffs for averging fields
     double time0;
@@ -19,13 +30,28 @@ private:
     tensor_t stress_avg;
     double_vec delta_plstrain_avg;
 
+    // scratch buffers for derived fields, reused between frames
+    double_vec density;
+    double_vec viscosity;
+    double_vec material;
+    array_t marker_coord;
+    double_vec topo;
+
+    void register_fields(const std::string &intervals);
+    bool is_due(const char *field) const;
+    double elapsed_time() const;
     void write_info(const Variables& var, double dt);
+    void write_timing(const Variables& var);
+    void compute_derived_fields(const Variables& var, double inv_dt, bool is_averaged);
+    const char* output_target(const char *kind, char *filename, char *group) const;
 
 public:
     Output(const Param& param, double start_time, int start_frame);
     ~Output();
     void write(const Variables& var, bool is_averaged=true);
     void write_checkpoint(const Variables& var);
+    void write_time_to_first_step();
+    void write_topography(const Variables& var);
     void average_fields(Variables& var);
 
 };
@@ -7,17 +7,21 @@
 
 #include "constants.hpp"
 #include "array2d.hpp"
+#include "shape-deriv.hpp"
 
 typedef std::pair<double,double> double_pair;
 
-typedef std::vector<double> double_vec;
+// the fields are aligned and first-touched in parallel, see aligned-alloc.hpp
+typedef std::vector<double, aligned::allocator<double> > double_vec;
+// fields that are not accumulated, stored in single precision if lowp_t is float
+typedef std::vector<lowp_t, aligned::allocator<lowp_t> > lowp_vec;
 typedef std::vector<int> int_vec;
 typedef std::vector<int_vec> int_vec2D;
 typedef std::vector<uint> uint_vec;
 
 typedef Array2D<double,NDIMS> array_t;
 typedef Array2D<double,NSTR> tensor_t;
-typedef Array2D<double,NODES_PER_ELEM> shapefn;
+typedef Array2D<lowp_t,NODES_PER_ELEM> shapefn;
 typedef Array2D<double,1> regattr_t;
 
 typedef Array2D<int,NODES_PER_ELEM> conn_t;
@@ -34,19 +38,28 @@ struct Sim {
     int output_step_interval;
     int output_averaged_fields;
     int checkpoint_frame_interval;
+    int topography_step_interval;
+    int status_step_interval;
     int restarting_from_frame;
+    int random_seed;
+    int deterministic_ngroups;
     bool is_restarting;
     bool has_output_during_remeshing;
     bool has_marker_output;
+    bool has_container_output;
+    bool has_concurrent_phases;
+    bool has_persistent_team;
 
     std::string modelname;
     std::string restarting_from_modelname;
+    std::string output_field_intervals;
 };
 
 struct Mesh {
     int meshing_option;
     int meshing_verbosity;
     int tetgen_optlevel;
+    int renumbering_option;
     int quality_check_step_interval;
 
     double xlength, ylength, zlength;
@@ -63,6 +76,7 @@ struct Mesh {
     std::string poly_filename;
 
     int remeshing_option;
+    bool has_renumbering_report;
 };
 
 struct Control {
@@ -160,6 +174,15 @@ struct Markers {
     double init_marker_spacing;
 };
 
+struct Profiling {
+    bool has_hardware_counters;
+    bool has_roofline_report;
+
+    int scaling_steps;
+    std::string scaling_proc_bind;
+    std::string scaling_places;
+};
+
 struct Param {
     Sim sim;
     Mesh mesh;
@@ -168,6 +191,7 @@ struct Param {
     IC ic;
     Mat mat;
     Markers markers;
+    Profiling profiling;
 };
 
 
@@ -176,6 +200,10 @@ struct Param {
 //
 class MatProps;
 class MarkerSet;
+class PhaseTimers;
+class MemoryUsage;
+class Roofline;
+class Decomposition;
 struct Variables {
     double time;
     double dt;
@@ -204,18 +232,26 @@ struct Variables {
 
     double_vec *volume, *volume_old, *volume_n;
     double_vec *mass, *tmass;
-    double_vec *edvoldt;
-    double_vec *temperature, *plstrain, *delta_plstrain;
+    lowp_vec *edvoldt;
+    double_vec *temperature, *plstrain;
+    lowp_vec *delta_plstrain;
     double_vec *ntmp;
-    double_vec *elquality;
+    lowp_vec *elquality;
 
     array_t *vel, *force;
     tensor_t *strain_rate, *strain, *stress;
-    shapefn *shpdx, *shpdy, *shpdz;
+    ShapeDeriv *shpd;
 
     MatProps *mat;
 
     MarkerSet *markerset;
+
+    PhaseTimers *timers;
+    MemoryUsage *memory;
+    Roofline *roofline;
+
+    // the partition of this process, NULL in the serial build
+    Decomposition *decomp;
 };
 
 #endif
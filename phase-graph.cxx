@@ -0,0 +1,203 @@
+#include <algorithm>
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include "constants.hpp"
+#include "parameters.hpp"
+#include "phase-graph.hpp"
+#include "team.hpp"
+
+
+PhaseGraph::PhaseGraph(const Param &param, Variables &var, bool is_concurrent) :
+    param(param), var(var), is_concurrent(is_concurrent)
+{}
+
+
+void PhaseGraph::add(PhaseTimers::Phase phase, DataSet reads, DataSet writes, Fn fn,
+                     bool is_serial)
+{
+    Node node;
+    node.phase = phase;
+    node.reads = reads;
+    node.writes = writes;
+    node.fn = fn;
+    node.f = NULL;
+    node.is_serial = is_serial;
+    node.nthreads = 0;
+    node.npred = 0;
+    nodes.push_back(node);
+}
+
+
+void PhaseGraph::add(PhaseTimers::Phase phase, DataSet reads, DataSet writes, PhaseFunc &f,
+                     bool is_serial)
+{
+    add(phase, reads, writes, static_cast<Fn>(NULL), is_serial);
+    nodes.back().f = &f;
+}
+
+
+void PhaseGraph::execute(Node &node, bool is_timed)
+{
+#ifdef USE_OMP
+    // the team size of the nested parallel loops of this phase
+    if (node.nthreads > 0) omp_set_num_threads(node.nthreads);
+#endif
+#ifndef NO_PHASE_TIMERS
+    const double t0 = PhaseTimers::wtime();
+#endif
+    if (node.f)
+        (*node.f)();
+    else
+        node.fn(param, var);
+#ifndef NO_PHASE_TIMERS
+    if (is_timed) var.timers->add(node.phase, PhaseTimers::wtime() - t0);
+#endif
+}
+
+
+int PhaseGraph::schedule()
+{
+    /* The dependencies of the phases, and the number of threads of each.
+     * The phases are grouped in levels, the phases of a level depending on
+     * the previous levels only. The threads are shared among the phases of
+     * a level, a serial phase taking one. Returns the max. number of phases
+     * in a level, up to the number of threads.
+     */
+    const int n = nodes.size();
+    std::vector<int> level(n, 0);
+    for (int j=0; j<n; ++j) {
+        Node &b = nodes[j];
+        b.npred = 0;
+        b.succ.clear();
+        for (int i=0; i<j; ++i) {
+            Node &a = nodes[i];
+            if ((a.writes & (b.reads | b.writes)) || (a.reads & b.writes)) {
+                a.succ.push_back(j);
+                ++b.npred;
+                level[j] = std::max(level[j], level[i] + 1);
+            }
+        }
+    }
+
+    const int nlevels = n ? *std::max_element(level.begin(), level.end()) + 1 : 0;
+    std::vector<int> nserial(nlevels, 0), nparallel(nlevels, 0);
+    for (int i=0; i<n; ++i) {
+        if (nodes[i].is_serial)
+            ++nserial[level[i]];
+        else
+            ++nparallel[level[i]];
+    }
+
+    int nthreads = 1;
+#ifdef USE_OMP
+    nthreads = omp_get_max_threads();
+#endif
+
+    int width = 1;
+    for (int i=0; i<n; ++i) {
+        const int l = level[i];
+        width = std::max(width, nserial[l] + nparallel[l]);
+        if (nodes[i].is_serial)
+            nodes[i].nthreads = 1;
+        else
+            nodes[i].nthreads = std::max(1, (nthreads - nserial[l]) / nparallel[l]);
+    }
+    return std::min(width, nthreads);
+}
+
+
+void PhaseGraph::spawn(int i)
+{
+#ifdef USE_OMP
+    #pragma omp task default(shared) firstprivate(i)
+    {
+        Node &node = nodes[i];
+        execute(node, true);
+        for (std::size_t k=0; k<node.succ.size(); ++k) {
+            const int j = node.succ[k];
+            int npred;
+            #pragma omp atomic capture
+            npred = --nodes[j].npred;
+            // the last predecessor to finish starts the phase
+            if (npred == 0) spawn(j);
+        }
+    }
+#endif
+}
+
+
+void PhaseGraph::run_in_team()
+{
+#ifdef USE_OMP
+    const bool is_master = omp_get_thread_num() == 0;
+
+    // the data of the phases since the last barrier
+    DataSet reads = 0, writes = 0;
+    for (std::size_t i=0; i<nodes.size(); ++i) {
+        Node &node = nodes[i];
+        if ((writes & (node.reads | node.writes)) || (reads & node.writes)) {
+            #pragma omp barrier
+            reads = writes = 0;
+        }
+        reads |= node.reads;
+        writes |= node.writes;
+
+        if (node.is_serial) {
+            #pragma omp single nowait
+            execute(node, true);
+        }
+        else
+            execute(node, is_master);
+    }
+
+    // all phases are finished, before the nodes are cleared
+    #pragma omp barrier
+    #pragma omp single
+    nodes.clear();
+#endif
+}
+
+
+void PhaseGraph::run()
+{
+#ifdef USE_OMP
+    if (in_team()) {
+        run_in_team();
+        return;
+    }
+#endif
+
+    int width = 1;
+#ifdef USE_OMP
+    if (is_concurrent && omp_get_max_threads() > 1) width = schedule();
+#endif
+
+    if (width == 1) {
+        for (std::size_t i=0; i<nodes.size(); ++i) {
+            nodes[i].nthreads = 0;
+            execute(nodes[i], true);
+        }
+        nodes.clear();
+        return;
+    }
+
+#ifdef USE_OMP
+    const int max_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(std::max(max_levels, 2));
+
+    #pragma omp parallel num_threads(width) default(shared)
+    {
+        #pragma omp single
+        {
+            for (std::size_t i=0; i<nodes.size(); ++i)
+                if (nodes[i].npred == 0) spawn(i);
+        }
+    }
+
+    omp_set_max_active_levels(max_levels);
+#endif
+    nodes.clear();
+}
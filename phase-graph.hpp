@@ -0,0 +1,104 @@
+#ifndef DYNEARTHSOL3D_PHASE_GRAPH_HPP
+#define DYNEARTHSOL3D_PHASE_GRAPH_HPP
+
+#include <vector>
+
+#include "timers.hpp"
+
+/* The phases of a time step, run in the order they are added, or, with
+ * sim.has_concurrent_phases, concurrently when they are independent.
+ *
+ * Each phase declares the data it reads and writes:
+ *     graph.add(PhaseTimers::strain_rate, PhaseGraph::vel | PhaseGraph::shpd,
+ *               PhaseGraph::strain_rate, phase_strain_rate);
+ *     ...
+ *     graph.run();
+ * A phase depends on the earlier phases that write what it reads or writes,
+ * or read what it writes. In the concurrent mode, a phase is started as an
+ * OpenMP task as soon as these are finished, so that e.g. the temperature
+ * and the strain rate are computed at the same time. The parallel loops of
+ * a phase run in a nested team, with the threads shared among the phases
+ * that can run at the same time. As the kernels do not depend on the number
+ * of threads with sim.deterministic_ngroups, the results are the same as in
+ * the sequential order.
+ *
+ * Called by all threads of a team (sim.has_persistent_team), run() runs the
+ * phases in order as team kernels (see team.hpp). The team waits between
+ * two phases only if the second depends on a phase since the last barrier,
+ * e.g. the strain rate does not wait for the temperature. The phases must
+ * be added by one thread before, e.g. in "omp single". The time of a phase
+ * is that of the master thread.
+ */
+
+class PhaseFunc  // base class for functor used in PhaseGraph
+{
+public:
+    virtual void operator()() = 0;
+    virtual ~PhaseFunc() {};
+};
+
+
+class PhaseGraph
+{
+public:
+    // the data read or written by the phases
+    enum Data {
+        coord       = 1 << 0,
+        vel         = 1 << 1,
+        force       = 1 << 2,
+        temperature = 1 << 3,
+        ntmp        = 1 << 4,
+        strain_rate = 1 << 5,
+        edvoldt     = 1 << 6,
+        stress      = 1 << 7,   // stress and strain
+        plstrain    = 1 << 8,   // plstrain and delta_plstrain
+        mass        = 1 << 9,   // mass, tmass and volume_n
+        volume      = 1 << 10,  // volume and volume_old
+        shpd        = 1 << 11,
+        markers     = 1 << 12,  // markers and elemmarkers
+        dt          = 1 << 13,
+        averages    = 1 << 14   // the averaged fields of the output
+    };
+    typedef unsigned int DataSet;
+
+    typedef void (*Fn)(const Param&, Variables&);
+
+    PhaseGraph(const Param &param, Variables &var, bool is_concurrent);
+
+    // is_serial: the phase has no parallel loop, and needs a single thread
+    void add(PhaseTimers::Phase phase, DataSet reads, DataSet writes, Fn fn,
+             bool is_serial=false);
+    void add(PhaseTimers::Phase phase, DataSet reads, DataSet writes, PhaseFunc &f,
+             bool is_serial=false);
+
+    // runs the phases added since the last call
+    void run();
+
+private:
+    struct Node {
+        PhaseTimers::Phase phase;
+        DataSet reads, writes;
+        Fn fn;
+        PhaseFunc *f;
+        bool is_serial;
+        int nthreads;
+        int npred;
+        std::vector<int> succ;
+    };
+
+    const Param &param;
+    Variables &var;
+    const bool is_concurrent;
+    std::vector<Node> nodes;
+
+    void execute(Node &node, bool is_timed);
+    void run_in_team();
+    void spawn(int i);
+    int schedule();
+
+    // disable copy
+    PhaseGraph(const PhaseGraph&);
+    PhaseGraph& operator=(const PhaseGraph&);
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "constants.hpp"
 #include "parameters.hpp"
 #include "markerset.hpp"
+#include "team.hpp"
 #include "utils.hpp"
 
 #include "phasechanges.hpp"
@@ -13,7 +14,7 @@ namespace {
     {
         int current_mt = ms.get_mattype(m);
         int e = ms.get_elem(m);
-        const double* eta = ms.get_eta(m);
+        const lowp_t* eta = ms.get_eta(m);
 
         // Get temperature at the marker
         double T = 0;
@@ -56,8 +57,17 @@ void phase_changes(const Param& param, const Variables& var,
         std::exit(1);
     }
 
-    #pragma omp parallel for default(none)          \
-        shared(param, var, ms, elemmarkers, phase_change_fn)
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(param, var, ms, elemmarkers)
+        {
+            TeamScope team;
+            phase_changes(param, var, ms, elemmarkers);
+        }
+        return;
+    }
+
+    #pragma omp for nowait
     for (int m=0; m<ms.get_nmarkers(); m++) {
         int current_mt = ms.get_mattype(m);
         int new_mt = phase_change_fn(param, var, ms, m);
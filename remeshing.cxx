@@ -10,6 +10,7 @@
 
 #include "barycentric-fn.hpp"
 #include "brc-interpolation.hpp"
+#include "decomposition.hpp"
 #include "fields.hpp"
 #include "geometry.hpp"
 #include "matprops.hpp"
@@ -17,7 +18,9 @@
 #include "nn-interpolation.hpp"
 #include "utils.hpp"
 #include "markerset.hpp"
+#include "memory.hpp"
 #include "remeshing.hpp"
+#include "timers.hpp"
 extern "C" {
 #include "Starbase.h"
 #include "src/top.c"
@@ -53,6 +56,30 @@ const double sizefactor = 0.433;
 const int DELETED_FACET = -1;
 const int DEBUG = 0;
 
+
+// statistics of a remeshing event, see write_remesh_log()
+struct RemeshEvent
+{
+    int reason, index;
+    int nnode0, nelem0, nnode1, nelem1;
+    int nloops;
+    int nmarkers0, ndeleted, nadded, nmarkers1;
+    // time (in seconds) spent in each stage
+    double improve, smooth, topo, contract, insert;
+    double tetgen, renumber, nn_interp, brc_interp, markers;
+    double reallocate, rebuild, total;
+};
+
+
+double lap(double &t)
+{
+    /* Returns the time since t, and resets t to now. */
+    double now = PhaseTimers::wtime();
+    double elapsed = now - t;
+    t = now;
+    return elapsed;
+}
+
 bool is_boundary(uint flag)
 {
     return flag & (BOUNDX0 | BOUNDX1 | BOUNDY0 | BOUNDY1 | BOUNDZ0 | BOUNDZ1);
@@ -864,7 +891,8 @@ void delete_points_on_boundary(int_vec &points_to_delete,
 
 void new_mesh(const Param &param, Variables &var, int bad_quality,
               const array_t &original_coord, const conn_t &original_connectivity,
-              const segment_t &original_segment, const segflag_t &original_segflag)
+              const segment_t &original_segment, const segflag_t &original_segflag,
+              int &nloops)
 {
     // We don't want to refine large elements during remeshing,
     // so using negative size as the max area
@@ -900,6 +928,13 @@ void new_mesh(const Param &param, Variables &var, int bad_quality,
         old_bnodes[i] = var.bnodes[i];
     }
 
+    std::size_t copy_bytes = nbytes(old_coord) + nbytes(old_connectivity)
+        + nbytes(old_segment) + nbytes(old_segflag)
+        + nbytes(old_volume) + nbytes(old_bcflag);
+    for (int i=0; i<6; ++i)
+        copy_bytes += nbytes(facet_polygons[i]) + nbytes(old_bnodes[i]);
+    ScopedMemory copy_mem(*var.memory, MemoryUsage::remesh, copy_bytes);
+
     int_vec points_to_delete;
     bool (*excl_func)(uint) = NULL; // function pointer indicating which point cannot be deleted
 
@@ -974,7 +1009,7 @@ void new_mesh(const Param &param, Variables &var, int bad_quality,
     double *pcoord, *pregattr;
     int *pconnectivity, *psegment, *psegflag;
 
-    int nloops = 0;
+    nloops = 0;
     while (1) {
 
         if (bad_quality == 3) {
@@ -1005,6 +1040,12 @@ void new_mesh(const Param &param, Variables &var, int bad_quality,
         double_vec new_volume(new_nelem);
         compute_volume(new_coord, new_connectivity, new_volume);
 
+        // the old and new meshes coexist here
+        ScopedMemory new_mem(*var.memory, MemoryUsage::remesh,
+                             nbytes(new_coord) + nbytes(new_connectivity)
+                             + new_nseg * (NDIMS + 1) * sizeof(int)
+                             + nbytes(new_bcflag) + nbytes(new_volume));
+
         const double smallest_vol = param.mesh.smallest_size * sizefactor * std::pow(param.mesh.resolution, NDIMS);
         bad_quality = 0;
         for (int e=0; e<var.nelem; e++) {
@@ -1040,10 +1081,65 @@ void new_mesh(const Param &param, Variables &var, int bad_quality,
     var.segflag->reset(psegflag, var.nseg);
 }
 
+
+const char remesh_log_columns[] =
+    "# steps\ttime_in_yr\treason\tindex"
+    "\tnnode_before\tnelem_before\tnnode_after\tnelem_after\ttetgen_loops"
+    "\tmarkers_before\tmarkers_deleted\tmarkers_added\tmarkers_after"
+    "\tstellar\tstellar_smooth\tstellar_topo\tstellar_contract\tstellar_insert"
+    "\ttetgen\trenumbering\tnn_interpolation\tbrc_interpolation\tremap_markers"
+    "\treallocate\trebuild\ttotal\n";
+
+
+void write_remesh_log(const Param &param, const Variables &var, const RemeshEvent &ev)
+{
+    /* Appending one line per remeshing event to modelname.remesh. The reason
+     * and index are from bad_mesh_quality(). The time is in seconds, the
+     * stellar_* columns are part of the stellar column. */
+    std::string filename(param.sim.modelname + ".remesh");
+    std::FILE* f = std::fopen(filename.c_str(), "a");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << filename << '\n';
+        std::exit(2);
+    }
+
+    // create_remesh_log() is not called when restarting, a restart under a
+    // new modelname starts the log here
+    std::fseek(f, 0, SEEK_END);
+    if (std::ftell(f) == 0)
+        std::fputs(remesh_log_columns, f);
+
+    std::fprintf(f, "%10d\t%12.6e\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d",
+                 var.steps, var.time / YEAR2SEC, ev.reason, ev.index,
+                 ev.nnode0, ev.nelem0, ev.nnode1, ev.nelem1, ev.nloops,
+                 ev.nmarkers0, ev.ndeleted, ev.nadded, ev.nmarkers1);
+    const double t[] = {ev.improve, ev.smooth, ev.topo, ev.contract, ev.insert,
+                        ev.tetgen, ev.renumber, ev.nn_interp, ev.brc_interp, ev.markers,
+                        ev.reallocate, ev.rebuild, ev.total};
+    for (std::size_t i=0; i<sizeof(t)/sizeof(t[0]); ++i)
+        std::fprintf(f, "\t%10.4e", t[i]);
+    std::fprintf(f, "\n");
+    std::fclose(f);
+}
+
 } // anonymous namespace
 
 
-int bad_mesh_quality(const Param &param, const Variables &var, int &index)
+void create_remesh_log(const Param &param)
+{
+    /* Starting a new remeshing log, discarding previous content */
+    std::string filename(param.sim.modelname + ".remesh");
+    std::FILE* f = std::fopen(filename.c_str(), "w");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << filename << '\n';
+        std::exit(2);
+    }
+    std::fputs(remesh_log_columns, f);
+    std::fclose(f);
+}
+
+
+static int check_mesh_quality(const Param &param, const Variables &var, int &index)
 {
     /* Check the quality of the mesh, return 0 if the mesh quality (by several
      * measures) is good. Non-zero returned values indicate --
@@ -1098,9 +1194,28 @@ int bad_mesh_quality(const Param &param, const Variables &var, int &index)
 }
 
 
-void remesh(const Param &param, Variables &var, int bad_quality)
+int bad_mesh_quality(const Param &param, const Variables &var, int &index)
+{
+    // The checks are in the order of decreasing return value, the first
+    // failed check in any partition wins (see decomposition.hpp). The index
+    // is local to the partition.
+    return global_max(var, check_mesh_quality(param, var, index));
+}
+
+
+void remesh(const Param &param, Variables &var, int bad_quality, int bad_quality_index)
 {
     std::cout << "  Remeshing starts...\n";
+    PhaseTimers &timers = *var.timers;
+
+    RemeshEvent ev;
+    ev.reason = bad_quality;
+    ev.index = bad_quality_index;
+    ev.nnode0 = var.nnode;
+    ev.nelem0 = var.nelem;
+    ev.nmarkers0 = var.markerset->get_nmarkers();
+    const double t_start = PhaseTimers::wtime();
+    double t = t_start;
    
     { 
         // creating a "copy" of mesh pointer so that they are not deleted
@@ -1113,6 +1228,12 @@ void remesh(const Param &param, Variables &var, int bad_quality)
         old_segment.steal_ref(*var.segment);
         old_segflag.steal_ref(*var.segflag);
 
+        // the old mesh is owned by remeshing until the end of this block
+        var.memory->update(var);
+        ScopedMemory old_mesh_mem(*var.memory, MemoryUsage::remesh,
+                                  nbytes(old_coord) + nbytes(old_connectivity) +
+                                  nbytes(old_segment) + nbytes(old_segflag));
+
         int argc1;
          char **argv1;
    struct proxipool imb;
@@ -1253,27 +1374,47 @@ int *ndtm;
   /*********************************************************/
   /* IMPROVEMENT HAPPENS HERE                              */
   /*********************************************************/
-  staticimprove(&behave, &in, &vertexpool, &mesh, argc1, argv1);
-
-        new_mesh(param, var, bad_quality, old_coord, old_connectivity,
-                 old_segment, old_segflag);
-
-        renumbering_mesh(param, *var.coord, *var.connectivity, *var.segment);
-
-        // interpolating fields defined on elements
-        nearest_neighbor_interpolation(var, old_coord, old_connectivity);
-
-        // interpolating fields defined on nodes
-        barycentric_node_interpolation(var, old_coord, old_connectivity);
+  // the stats are global and accumulate, start this remeshing from zero
+  initimprovestats();
+  TIMED(timers, remesh_improve, staticimprove(&behave, &in, &vertexpool, &mesh, argc1, argv1));
+  ev.improve = lap(t);
+  // Stellar keeps the time of each kind of passes in msec
+  ev.smooth = stats.smoothmsec * 1e-3;
+  ev.topo = stats.topomsec * 1e-3;
+  ev.contract = stats.contractmsec * 1e-3;
+  ev.insert = stats.insertmsec * 1e-3;
+
+        TIMED(timers, remesh_new_mesh,
+              new_mesh(param, var, bad_quality, old_coord, old_connectivity,
+                       old_segment, old_segflag, ev.nloops);
+              ev.tetgen = lap(t);
+              renumbering_mesh(param, *var.coord, *var.connectivity, *var.segment);
+              ev.renumber = lap(t));
+        var.memory->update(var);
+
+        TIMED(timers, remesh_interpolation,
+              // interpolating fields defined on elements
+              nearest_neighbor_interpolation(var, old_coord, old_connectivity);
+              ev.nn_interp = lap(t);
+
+              // interpolating fields defined on nodes
+              barycentric_node_interpolation(var, old_coord, old_connectivity);
+              ev.brc_interp = lap(t));
+        var.memory->update(var);
 
         // remap markers. elemmarkers are updated here, too.
-        remap_markers(param, var, old_coord, old_connectivity);
+        TIMED(timers, remesh_markers,
+              remap_markers(param, var, old_coord, old_connectivity, ev.ndeleted, ev.nadded));
+        ev.markers = lap(t);
   
         // old_coord et al. are destroyed before exiting this block
     }
 
+    SCOPED_TIMER(timers, remesh_rebuild);
+
     // memory for new fields
     reallocate_variables(param, var);
+    ev.reallocate = lap(t);
 
     // updating other arrays
     delete var.bcflag;
@@ -1286,7 +1427,7 @@ int *ndtm;
     create_boundary_facets(var);
     delete var.support;
     create_support(var);
-    create_elem_groups(var);
+    create_elem_groups(param, var);
 
     compute_volume(*var.coord, *var.connectivity, *var.volume);
     // TODO: using edvoldt and volume to get volume_old
@@ -1294,7 +1435,7 @@ int *ndtm;
     compute_mass(param, var.egroups, *var.connectivity, *var.volume, *var.mat,
                  var.max_vbc_val, *var.volume_n, *var.mass, *var.tmass);
     compute_shape_fn(*var.coord, *var.connectivity, *var.volume, var.egroups,
-                     *var.shpdx, *var.shpdy, *var.shpdz);
+                     *var.shpd);
 
     if (param.sim.has_output_during_remeshing) {
         // the following variables need to be re-computed only when we are
@@ -1305,6 +1446,16 @@ int *ndtm;
         worst_elem_quality(*var.coord, *var.connectivity,
                            *var.volume, *var.elquality, junk);
     }
+    ev.rebuild = lap(t);
+
+    ev.nnode1 = var.nnode;
+    ev.nelem1 = var.nelem;
+    ev.nmarkers1 = var.markerset->get_nmarkers();
+    ev.total = t - t_start;
+    write_remesh_log(param, var, ev);
+
+    var.memory->update(var);
+    var.memory->write_log(param.sim.modelname, "remesh", var.steps, false);
 
     std::cout << "  Remeshing finished.\n";
 }
@@ -2,6 +2,7 @@
 #define DYNEARTHSOL3D_REMESHING_HPP
 
 int bad_mesh_quality(const Param&, const Variables&, int&);
-void remesh(const Param&, Variables&, int);
+void remesh(const Param&, Variables&, int, int);
+void create_remesh_log(const Param&);
 
 #endif
@@ -5,8 +5,10 @@
 
 #include "constants.hpp"
 #include "parameters.hpp"
+#include "hwcounters.hpp"
 #include "matprops.hpp"
 #include "rheology.hpp"
+#include "team.hpp"
 #include "utils.hpp"
 
 
@@ -511,12 +513,23 @@ static void elasto_plastic2d(double bulkm, double shearm,
 
 void update_stress(const Variables& var, tensor_t& stress,
                    tensor_t& strain, double_vec& plstrain,
-                   double_vec& delta_plstrain, tensor_t& strain_rate)
+                   lowp_vec& delta_plstrain, tensor_t& strain_rate)
 {
-    const int rheol_type = var.mat->rheol_type;
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none)                           \
+            shared(var, stress, strain, plstrain, delta_plstrain, strain_rate)
+        {
+            TeamScope team;
+            update_stress(var, stress, strain, plstrain, delta_plstrain, strain_rate);
+        }
+        return;
+    }
+
+    int rheol_type = var.mat->rheol_type;
 
-    #pragma omp parallel for default(none)                           \
-        shared(var, stress, strain, plstrain, delta_plstrain, strain_rate, std::cerr)
+    HW_COUNTED(stress, var.nelem);
+    #pragma omp for nowait
     for (int e=0; e<var.nelem; ++e) {
         // stress, strain and strain_rate of this element
         double* s = stress[e];
@@ -0,0 +1,44 @@
+#ifndef DYNEARTHSOL3D_RNG_HPP
+#define DYNEARTHSOL3D_RNG_HPP
+
+#include <stdint.h>
+
+/* Counter-based random numbers.
+ *
+ * The random number is a hash of (seed, stream, counter), there is no
+ * hidden state. The counter is the index of the object being randomized,
+ * e.g. the marker id or the node index, so the random numbers do not depend
+ * on the order of the calls nor on the number of threads, and the same seed
+ * (sim.random_seed) always gives the same model.
+ */
+
+namespace rng {
+
+    // independent sequences for different purposes
+    enum Stream {
+        marker_eta, marker_mattype, mesh_shift
+    };
+
+    inline uint64_t hash(uint64_t seed, int stream, uint64_t counter)
+    {
+        // splitmix64 finalizer, applied twice to decorrelate the streams
+        uint64_t z = seed + 0x9e3779b97f4a7c15ULL * (static_cast<uint64_t>(stream) + 1);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= (z >> 31);
+
+        z += 0x9e3779b97f4a7c15ULL * (counter + 1);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // uniformly distributed in [0, 1)
+    inline double uniform(uint64_t seed, int stream, uint64_t counter)
+    {
+        return (hash(seed, stream, counter) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+}
+
+#endif
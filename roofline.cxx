@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include "constants.hpp"
+#include "parameters.hpp"
+#include "matprops.hpp"
+#include "roofline.hpp"
+
+
+namespace {
+
+    // large enough to be out of the last-level cache
+    const long stream_size = 1 << 23;
+    const int stream_repeats = 5;
+
+    // iterations of the flop-rate kernel per thread
+    const long flop_iterations = 1 << 22;
+
+
+    double stream_triad(int &nthreads)
+    {
+        /* Best bandwidth of a[i] = b[i] + q * c[i], in bytes/sec. As in
+         * STREAM, 3 doubles are counted per iteration, the write-allocate
+         * traffic is not counted. */
+        double *a = new double[stream_size];
+        double *b = new double[stream_size];
+        double *c = new double[stream_size];
+        const double q = 3.0;
+        const long n = stream_size;
+
+        // first touch by the same threads as below
+        #pragma omp parallel for default(none) shared(a, b, c) schedule(static)
+        for (long i=0; i<n; ++i) {
+            a[i] = 0;
+            b[i] = 1;
+            c[i] = 2;
+        }
+
+        double best = 0;
+        for (int r=0; r<stream_repeats; ++r) {
+            double t0 = PhaseTimers::wtime();
+            #pragma omp parallel for default(none) shared(a, b, c) schedule(static)
+            for (long i=0; i<n; ++i)
+                a[i] = b[i] + q * c[i];
+            double t1 = PhaseTimers::wtime();
+            if (t1 > t0)
+                best = std::max(best, 3 * sizeof(double) * double(n) / (t1 - t0));
+        }
+
+        nthreads = 1;
+#ifdef USE_OMP
+        nthreads = omp_get_max_threads();
+#endif
+        // use the result, so that the loops are not optimized out
+        if (a[n/2] != 1 + q * 2)
+            std::cerr << "Warning: unexpected result of the bandwidth measurement.\n";
+
+        delete [] a;
+        delete [] b;
+        delete [] c;
+        return best;
+    }
+
+
+    double scalar_flop_rate()
+    {
+        /* Flops/sec of independent multiply-add chains in each thread.
+         * There are enough chains to hide the latency and to be vectorized
+         * by the compiler. */
+        const int nchains = 32;
+        double sum = 0;
+        double t0 = PhaseTimers::wtime();
+        #pragma omp parallel default(none) reduction(+:sum)
+        {
+            double x[nchains];
+            for (int j=0; j<nchains; ++j)
+                x[j] = 1.0 + j * 1e-3;
+            for (long i=0; i<flop_iterations; ++i)
+                for (int j=0; j<nchains; ++j)
+                    x[j] = x[j] * 0.999999 + 1e-6;
+            for (int j=0; j<nchains; ++j)
+                sum += x[j];
+        }
+        double t1 = PhaseTimers::wtime();
+
+        int nthreads = 1;
+#ifdef USE_OMP
+        nthreads = omp_get_max_threads();
+#endif
+        if (sum == 0)
+            std::cerr << "Warning: unexpected result of the flop-rate measurement.\n";
+        return (t1 > t0) ? 2.0 * nchains * flop_iterations * nthreads / (t1 - t0) : 0;
+    }
+
+}
+
+
+Roofline::Roofline(const Param &param) :
+    has_thermal_diffusion(param.control.has_thermal_diffusion),
+    nmat(param.mat.nmat),
+    bandwidth(0), flop_rate(0), nthreads(1), last_steps(0)
+{
+    std::fill_n(calls, static_cast<int>(nkernels), 0);
+    std::fill_n(seconds, static_cast<int>(nkernels), 0.0);
+    std::fill_n(bytes, static_cast<int>(nkernels), 0.0);
+    std::fill_n(flops, static_cast<int>(nkernels), 0.0);
+    std::fill_n(elem_calls, static_cast<int>(nkernels), 0.0);
+#ifdef NO_PHASE_TIMERS
+    std::cerr << "Warning: the roofline report needs the phase timers, rebuild with timers=1.\n";
+#endif
+}
+
+
+void Roofline::measure_machine()
+{
+    std::cout << "Measuring memory bandwidth and flop rate...\n";
+    bandwidth = stream_triad(nthreads);
+    flop_rate = scalar_flop_rate();
+    std::cout << "  " << bandwidth * 1e-9 << " GB/s, "
+              << flop_rate * 1e-9 << " GFlop/s with " << nthreads << " threads\n";
+}
+
+
+int Roofline::ncalls(int kernel, const Variables &var, int steps) const
+{
+    switch (kernel) {
+    case PhaseTimers::temperature:
+        return has_thermal_diffusion ? steps : 0;
+    case PhaseTimers::rotate_stress:
+        return (var.mat->rheol_type & MatProps::rh_elastic) ? steps : 0;
+    case PhaseTimers::dt:
+        // every 10 steps
+        return var.steps / 10 - last_steps / 10;
+    }
+    return steps;
+}
+
+
+double Roofline::bytes_per_call(int kernel, const Variables &var) const
+{
+    /* Compulsory memory traffic. Nodal data gathered or scattered by an
+     * element are counted once per element, as the elements are not
+     * ordered for cache reuse in general. A read-modify-write counts twice.
+     * The material properties of an element are looked up from its row
+     * of elemmarkers. */
+    const double i4 = sizeof(int);
+    const double f8 = sizeof(double);
+    const double lp = sizeof(lowp_t);
+    const double nelem = var.nelem;
+    const double nnode = var.nnode;
+    const double N = NODES_PER_ELEM;
+
+    const double conn = N * i4;
+    const double shp = ShapeDeriv::elem_bytes;
+    const double geom = conn + N * NDIMS * f8;
+    const double matprop = nmat * i4;
+
+    switch (kernel) {
+    case PhaseTimers::temperature:
+        // gathering temperature, scattering tdot; then the nodal update
+        return nelem * (conn + shp + f8 + matprop + N * f8 + 2 * N * f8)
+            + nnode * (i4 + 4 * f8);
+    case PhaseTimers::strain_rate:
+        return nelem * (conn + N * NDIMS * f8 + shp + NSTR * f8);
+    case PhaseTimers::dvoldt:
+        // compute_dvoldt, then compute_edvoldt
+        return nelem * (conn + NSTR * f8 + f8 + 2 * N * f8)
+            + nnode * (f8 + 3 * f8)
+            + nelem * (conn + N * f8 + lp);
+    case PhaseTimers::stress:
+        // strain_rate, strain and stress are updated in place, plus
+        // edvoldt, plstrain and delta_plstrain
+        return nelem * (3 * 2 * NSTR * f8 + lp + 2 * f8 + lp + matprop);
+    case PhaseTimers::force:
+        return nelem * (conn + shp + NSTR * f8 + f8 + matprop + 2 * N * NDIMS * f8)
+            + nnode * NDIMS * f8;
+    case PhaseTimers::velocity:
+        return nnode * (2 * NDIMS * f8 + NDIMS * f8 + f8);
+    case PhaseTimers::bc:
+        return nnode * (i4 + 2 * NDIMS * f8);
+    case PhaseTimers::mesh_update:
+        // coordinate, volume, mass and shape functions
+        return nnode * 3 * NDIMS * f8
+            + nelem * (geom + 2 * f8)
+            + nelem * (conn + f8 + matprop + 3 * 2 * N * f8) + nnode * 3 * f8
+            + nelem * (geom + f8 + shp);
+    case PhaseTimers::rotate_stress:
+        return nelem * (conn + N * NDIMS * f8 + shp + 2 * 2 * NSTR * f8);
+    case PhaseTimers::dt:
+        return nelem * (geom + f8 + matprop);
+    }
+    return 0;
+}
+
+
+double Roofline::flops_per_call(int kernel, const Variables &var) const
+{
+    /* Floating-point operations, counted from the source of each kernel.
+     * The count of update_stress() is a rough estimate, dominated by the
+     * eigen-decomposition of the stress in the plastic rheologies. */
+    const double nelem = var.nelem;
+    const double nnode = var.nnode;
+    const double N = NODES_PER_ELEM;
+    const double D = NDIMS;
+
+    switch (kernel) {
+    case PhaseTimers::temperature:
+        return nelem * (N * N * 2 * D + N * N * 2 + 2 * N + 1) + nnode * 3;
+    case PhaseTimers::strain_rate:
+        return nelem * (D * 2 * N + (NSTR - D) * 5 * N);
+    case PhaseTimers::dvoldt:
+        return nelem * (D - 1 + 2 * N) + nnode + nelem * N;
+    case PhaseTimers::stress:
+        {
+            double f = 3 * D + 3 * NSTR;  // anti-locking correction and strain update
+            const int rheol_type = var.mat->rheol_type;
+            if (rheol_type & MatProps::rh_elastic) f += 3 * NSTR;
+            if (rheol_type & MatProps::rh_viscous) f += 4 * NSTR + 10;
+            if (rheol_type & (MatProps::rh_plastic | MatProps::rh_plastic2d))
+                f += (NDIMS == 3) ? 350 : 60;
+            return nelem * f;
+        }
+    case PhaseTimers::force:
+        return nelem * (N * D * (2 * D + 1) + 2);
+    case PhaseTimers::velocity:
+        return nnode * 3 * D;
+    case PhaseTimers::bc:
+        return 0;
+    case PhaseTimers::mesh_update:
+        // coordinate, volume, mass and shape functions
+        return nnode * 2 * D
+            + nelem * ((NDIMS == 3) ? 24 : 9)
+            + nelem * (3 * N + 4)
+            + nelem * ((NDIMS == 3) ? 100 : 20);
+    case PhaseTimers::rotate_stress:
+        return nelem * ((NSTR - D) * 5 * N + 2 * 4 * NSTR);
+    case PhaseTimers::dt:
+        return nelem * ((NDIMS == 3) ? 100 : 30);
+    }
+    return 0;
+}
+
+
+void Roofline::add(const Variables &var, const double t[PhaseTimers::nphases])
+{
+    /* Accumulating the kernels since the previous frame, with the mesh size
+     * of current frame. */
+    const int steps = var.steps - last_steps;
+    if (steps <= 0) return;
+
+    for (int k=0; k<nkernels; ++k) {
+        const int n = ncalls(k, var, steps);
+        calls[k] += n;
+        seconds[k] += t[k];
+        bytes[k] += n * bytes_per_call(k, var);
+        flops[k] += n * flops_per_call(k, var);
+        elem_calls[k] += double(n) * var.nelem;
+    }
+    last_steps = var.steps;
+}
+
+
+void Roofline::write(const std::string &modelname) const
+{
+    std::string filename(modelname + ".roofline");
+    std::FILE* f = std::fopen(filename.c_str(), "w");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << filename << '\n';
+        std::exit(2);
+    }
+
+    const double ridge = (bandwidth > 0) ? flop_rate / bandwidth : 0;
+    std::fprintf(f, "# threads: %d\n", nthreads);
+    std::fprintf(f, "# memory bandwidth (STREAM triad): %.3f GB/s\n", bandwidth * 1e-9);
+    std::fprintf(f, "# flop rate (multiply-add): %.3f GFlop/s\n", flop_rate * 1e-9);
+    std::fprintf(f, "# ridge point: %.3f flop/byte\n", ridge);
+    // bytes and flops are per element per call, the nodal work included
+    std::fprintf(f, "# kernel\tcalls\tseconds\tbytes_per_elem\tflops_per_elem\tintensity"
+                 "\tgbytes_per_sec\tgflops_per_sec\tbandwidth_fraction\tflop_fraction\tbound\n");
+
+    for (int k=0; k<nkernels; ++k) {
+        if (calls[k] == 0) continue;
+        const double intensity = (bytes[k] > 0) ? flops[k] / bytes[k] : 0;
+        const double bw = (seconds[k] > 0) ? bytes[k] / seconds[k] : 0;
+        const double fr = (seconds[k] > 0) ? flops[k] / seconds[k] : 0;
+        std::fprintf(f, "%s\t%ld\t%.4e\t%.1f\t%.1f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%s\n",
+                     PhaseTimers::name(k), calls[k], seconds[k],
+                     bytes[k] / elem_calls[k], flops[k] / elem_calls[k], intensity,
+                     bw * 1e-9, fr * 1e-9,
+                     (bandwidth > 0) ? bw / bandwidth : 0,
+                     (flop_rate > 0) ? fr / flop_rate : 0,
+                     (intensity < ridge) ? "memory" : "compute");
+    }
+    std::fclose(f);
+}
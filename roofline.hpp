@@ -0,0 +1,58 @@
+#ifndef DYNEARTHSOL3D_ROOFLINE_HPP
+#define DYNEARTHSOL3D_ROOFLINE_HPP
+
+#include <string>
+
+#include "timers.hpp"
+
+struct Param;
+struct Variables;
+
+/* Throughput of the kernels of the time loop against the limits of the
+ * machine, enabled by profiling.has_roofline_report in the config file.
+ *
+ * The memory bandwidth (STREAM triad) and the floating-point rate of
+ * multiply-add chains are measured once at startup. The bytes moved and the flops of each
+ * kernel are modeled from the array sizes (NODES_PER_ELEM, NDIMS, NSTR)
+ * and accumulated with the phase timers at each output frame. The report
+ * is written to 'modelname.roofline' at the end of the run.
+ *
+ * The time of each kernel comes from the phase timers, the report is empty
+ * when compiled with -DNO_PHASE_TIMERS (make timers=0).
+ */
+
+class Roofline
+{
+public:
+    // the kernels are the phases of the time loop, see PhaseTimers
+    static const int nkernels = PhaseTimers::dt + 1;
+
+    explicit Roofline(const Param &param);
+
+    void measure_machine();
+    void add(const Variables &var, const double seconds[PhaseTimers::nphases]);
+    void write(const std::string &modelname) const;
+
+    // modeled cost of one call of a kernel
+    double bytes_per_call(int kernel, const Variables &var) const;
+    double flops_per_call(int kernel, const Variables &var) const;
+
+private:
+    const bool has_thermal_diffusion;
+    const int nmat;
+
+    double bandwidth;  // in bytes/sec
+    double flop_rate;  // in flops/sec
+    int nthreads;
+    int last_steps;
+
+    long calls[nkernels];
+    double seconds[nkernels];
+    double bytes[nkernels];
+    double flops[nkernels];
+    double elem_calls[nkernels];  // sum of nelem over the calls
+
+    int ncalls(int kernel, const Variables &var, int steps) const;
+};
+
+#endif
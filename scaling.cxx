@@ -0,0 +1,159 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#include "constants.hpp"
+#include "parameters.hpp"
+#include "mesh.hpp"
+#include "timers.hpp"
+#include "scaling.hpp"
+
+
+namespace {
+
+    // set in the child processes of run_scaling_policies()
+    const char *child_flag = "DYNEARTHSOL_SCALING_CHILD";
+
+
+    std::vector<std::string> split(const std::string &str)
+    {
+        std::vector<std::string> words;
+        std::istringstream is(str);
+        std::string w;
+        while (std::getline(is, w, ',')) {
+            std::size_t a = w.find_first_not_of(" \t");
+            std::size_t b = w.find_last_not_of(" \t");
+            if (a != std::string::npos)
+                words.push_back(w.substr(a, b - a + 1));
+        }
+        return words;
+    }
+
+
+    std::string getenv_or(const char *name, const char *default_value)
+    {
+        const char *v = std::getenv(name);
+        return (v && v[0]) ? v : default_value;
+    }
+
+
+    std::FILE* open_table(const std::string &modelname, bool new_file)
+    {
+        std::string filename(modelname + ".scaling");
+        std::FILE* f = std::fopen(filename.c_str(), new_file ? "w" : "a");
+        if (f == NULL) {
+            std::cerr << "Error: cannot open file: " << filename << '\n';
+            std::exit(2);
+        }
+        if (new_file)
+            std::fprintf(f, "# proc_bind\tplaces\tnthreads\tnelem\tsteps\tseconds"
+                         "\tsteps_per_sec\tspeedup\tefficiency\n");
+        return f;
+    }
+
+}
+
+
+bool run_scaling_policies(const Param& param, const char* argv[])
+{
+    if (std::getenv(child_flag)) return false;
+
+    std::vector<std::string> policies = split(param.profiling.scaling_proc_bind);
+    if (policies.empty()) return false;
+
+    std::FILE *f = open_table(param.sim.modelname, true);
+    std::fclose(f);
+
+    for (std::size_t i=0; i<policies.size(); ++i) {
+        std::cout << "Scaling study with OMP_PROC_BIND=" << policies[i] << " ...\n";
+        std::cout.flush();
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            // the OpenMP runtime reads the environment only at startup
+            setenv("OMP_PROC_BIND", policies[i].c_str(), 1);
+            if (! param.profiling.scaling_places.empty())
+                setenv("OMP_PLACES", param.profiling.scaling_places.c_str(), 1);
+            setenv(child_flag, "1", 1);
+            execv("/proc/self/exe", const_cast<char* const*>(argv));
+            execvp(argv[0], const_cast<char* const*>(argv));
+            std::cerr << "Error: cannot run " << argv[0] << '\n';
+            std::_Exit(2);
+        }
+
+        int status = 1;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || ! WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            std::cerr << "Error: scaling study with OMP_PROC_BIND=" << policies[i] << " failed.\n";
+            std::exit(2);
+        }
+    }
+    return true;
+}
+
+
+void scaling_study(const Param& param, Variables& var,
+                   void (*time_step)(const Param&, Variables&))
+{
+    /* The model is not reset between the thread counts, the mesh keeps
+     * deforming but is not remeshed. One untimed step precedes each run to
+     * warm up the caches and the thread team. */
+    int max_threads = 1;
+#ifdef USE_OMP
+    max_threads = omp_get_max_threads();
+#endif
+    std::vector<int> nthreads;
+    for (int n=1; n<max_threads; n*=2)
+        nthreads.push_back(n);
+    nthreads.push_back(max_threads);
+
+    const std::string proc_bind = getenv_or("OMP_PROC_BIND", "default");
+    const std::string places = getenv_or("OMP_PLACES", "default");
+    const int steps = param.profiling.scaling_steps;
+
+    std::FILE *f = open_table(param.sim.modelname, std::getenv(child_flag) == NULL);
+    std::cout << "Scaling study, " << steps << " steps with " << var.nelem << " elements, "
+              << "OMP_PROC_BIND=" << proc_bind << ", OMP_PLACES=" << places << '\n';
+
+    double seconds1 = 0;
+    for (std::size_t i=0; i<nthreads.size(); ++i) {
+#ifdef USE_OMP
+        omp_set_num_threads(nthreads[i]);
+#endif
+        create_elem_groups(param, var);
+        time_step(param, var);
+
+        double t0 = PhaseTimers::wtime();
+        for (int s=0; s<steps; ++s)
+            time_step(param, var);
+        double seconds = PhaseTimers::wtime() - t0;
+
+        if (i == 0) seconds1 = seconds;
+        const double speedup = (seconds > 0) ? seconds1 / seconds : 0;
+        std::fprintf(f, "%s\t%s\t%d\t%d\t%d\t%.4e\t%.3f\t%.3f\t%.3f\n",
+                     proc_bind.c_str(), places.c_str(), nthreads[i], var.nelem, steps,
+                     seconds, (seconds > 0) ? steps / seconds : 0,
+                     speedup, speedup / nthreads[i]);
+        std::fflush(f);
+        std::cout << "  " << nthreads[i] << " threads: " << seconds << " sec, speedup "
+                  << speedup << '\n';
+    }
+    std::fclose(f);
+
+#ifdef USE_OMP
+    omp_set_num_threads(max_threads);
+#endif
+    create_elem_groups(param, var);
+}
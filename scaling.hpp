@@ -0,0 +1,21 @@
+#ifndef DYNEARTHSOL3D_SCALING_HPP
+#define DYNEARTHSOL3D_SCALING_HPP
+
+/* Strong-scaling study, enabled by profiling.scaling_steps > 0 in the config
+ * file. Instead of the simulation, the model is advanced by scaling_steps
+ * time steps with 1, 2, 4, ... up to the max. number of OpenMP threads, and
+ * the timings are written to 'modelname.scaling'.
+ *
+ * The thread affinity of OpenMP cannot be changed once the program has
+ * started. For each policy in profiling.scaling_proc_bind, the executable is
+ * run again in a child process with OMP_PROC_BIND (and OMP_PLACES) set.
+ */
+
+// Returns true if the study has been run in child processes, one per
+// affinity policy, so that there is nothing left to do in this process.
+bool run_scaling_policies(const Param& param, const char* argv[]);
+
+void scaling_study(const Param& param, Variables& var,
+                   void (*time_step)(const Param&, Variables&));
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef DYNEARTHSOL3D_SHAPE_DERIV_HPP
+#define DYNEARTHSOL3D_SHAPE_DERIV_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "constants.hpp"
+#include "aligned-alloc.hpp"
+#include "array2d.hpp"
+
+/* Spatial derivatives of the shape functions, NDIMS x NODES_PER_ELEM
+ * doubles per element. The memory layout is selected at compile time by
+ * SHAPEFN_LAYOUT ("make shplayout=..."):
+ *
+ *   0: one array per direction, [dim][elem][node] (the default)
+ *   1: element blocks, [elem][dim][node], each block padded to a multiple
+ *      of the cache line, so that an element touches a single stream
+ *   2: blocks of 'block' elements, [elem/block][dim][node][elem%block],
+ *      contiguous across elements for SIMD
+ *   3: not stored, computed from the coordinates and the volume whenever
+ *      an element is visited, trading flops for memory and bandwidth
+ *
+ * The kernels read the derivatives of an element through ShapeDeriv::elem:
+ *     const ShapeDeriv::elem shp(*var.shpd, e);
+ *     ShapeDeriv::const_row shpdx = shp[0];  // shpdx[i], i < NODES_PER_ELEM
+ * A row is a plain pointer, except for layout 2, where the nodes are
+ * 'block' values apart. The stored derivatives are of type lowp_t, i.e.
+ * float with "make lowprec=1".
+ */
+
+#ifndef SHAPEFN_LAYOUT
+#define SHAPEFN_LAYOUT 0
+#endif
+
+#if SHAPEFN_LAYOUT < 0 || SHAPEFN_LAYOUT > 3
+#error "SHAPEFN_LAYOUT must be 0, 1, 2 or 3"
+#endif
+
+
+template <typename T, int S>
+class StridedRow
+{
+    T* p_;
+public:
+    StridedRow() : p_(NULL) {}
+    StridedRow(T* p) : p_(p) {}
+    template <typename U>
+    StridedRow(const StridedRow<U,S>& other) : p_(other.data()) {}
+
+    T& operator[](int i) const {return p_[i*S];}
+    T* data() const {return p_;}
+};
+
+
+class ShapeDeriv
+{
+public:
+    typedef Array2D<double,NDIMS> coord_type;
+    typedef Array2D<int,NODES_PER_ELEM> conn_type;
+    typedef std::vector<double, aligned::allocator<double> > volume_type;
+
+#if SHAPEFN_LAYOUT == 3
+    typedef double value_type;
+#else
+    typedef lowp_t value_type;
+#endif
+
+#if SHAPEFN_LAYOUT == 2
+    static const int block = aligned::alignment / sizeof(value_type);
+    typedef StridedRow<value_type,block> row;
+    typedef StridedRow<const value_type,block> const_row;
+#else
+    static const int block = 1;
+    typedef value_type* row;
+    typedef const value_type* const_row;
+#endif
+
+#if SHAPEFN_LAYOUT == 1
+    // values per element, padded to a multiple of the cache line
+    static const int elem_stride = (NDIMS * NODES_PER_ELEM * sizeof(value_type) + aligned::alignment - 1)
+        / aligned::alignment * aligned::alignment / sizeof(value_type);
+#elif SHAPEFN_LAYOUT == 3
+    static const int elem_stride = 0;
+#else
+    static const int elem_stride = NDIMS * NODES_PER_ELEM;
+#endif
+
+    static const bool is_stored = (SHAPEFN_LAYOUT != 3);
+
+    // bytes read to get the derivatives of an element, the node coordinates
+    // and the volume if not stored (the connectivity is needed anyway)
+    static const int elem_bytes = is_stored ? elem_stride * sizeof(value_type)
+        : (NODES_PER_ELEM * NDIMS + 1) * sizeof(double);
+
+
+    // derivatives of the shape functions of a linear simplex
+    template <typename R>
+    static void compute(const double *x[NODES_PER_ELEM], double volume, R d[NDIMS])
+    {
+        const double *d0 = x[0];
+        const double *d1 = x[1];
+        const double *d2 = x[2];
+
+#ifdef THREED
+        const double *d3 = x[3];
+
+        double iv = 1 / (6 * volume);
+
+        double x01 = d0[0] - d1[0];
+        double x02 = d0[0] - d2[0];
+        double x03 = d0[0] - d3[0];
+        double x12 = d1[0] - d2[0];
+        double x13 = d1[0] - d3[0];
+        double x23 = d2[0] - d3[0];
+
+        double y01 = d0[1] - d1[1];
+        double y02 = d0[1] - d2[1];
+        double y03 = d0[1] - d3[1];
+        double y12 = d1[1] - d2[1];
+        double y13 = d1[1] - d3[1];
+        double y23 = d2[1] - d3[1];
+
+        double z01 = d0[2] - d1[2];
+        double z02 = d0[2] - d2[2];
+        double z03 = d0[2] - d3[2];
+        double z12 = d1[2] - d2[2];
+        double z13 = d1[2] - d3[2];
+        double z23 = d2[2] - d3[2];
+
+        d[0][0] = iv * (y13*z12 - y12*z13);
+        d[0][1] = iv * (y02*z23 - y23*z02);
+        d[0][2] = iv * (y13*z03 - y03*z13);
+        d[0][3] = iv * (y01*z02 - y02*z01);
+
+        d[1][0] = iv * (z13*x12 - z12*x13);
+        d[1][1] = iv * (z02*x23 - z23*x02);
+        d[1][2] = iv * (z13*x03 - z03*x13);
+        d[1][3] = iv * (z01*x02 - z02*x01);
+
+        d[2][0] = iv * (x13*y12 - x12*y13);
+        d[2][1] = iv * (x02*y23 - x23*y02);
+        d[2][2] = iv * (x13*y03 - x03*y13);
+        d[2][3] = iv * (x01*y02 - x02*y01);
+#else
+        double iv = 1 / (2 * volume);
+
+        d[0][0] = iv * (d1[1] - d2[1]);
+        d[0][1] = iv * (d2[1] - d0[1]);
+        d[0][2] = iv * (d0[1] - d1[1]);
+
+        d[1][0] = iv * (d2[0] - d1[0]);
+        d[1][1] = iv * (d0[0] - d2[0]);
+        d[1][2] = iv * (d1[0] - d0[0]);
+#endif
+    }
+
+
+    // derivatives of one element, in direction d = 0 .. NDIMS-1
+    class elem
+    {
+#if SHAPEFN_LAYOUT == 3
+        value_type d_[NDIMS][NODES_PER_ELEM];
+#else
+        const ShapeDeriv &s_;
+        const std::size_t e_;
+#endif
+    public:
+        elem(const ShapeDeriv &s, std::size_t e)
+#if SHAPEFN_LAYOUT == 3
+        {
+            const int *conn = (*s.connectivity_)[e];
+            const double *x[NODES_PER_ELEM];
+            for (int i=0; i<NODES_PER_ELEM; ++i)
+                x[i] = (*s.coord_)[conn[i]];
+            value_type *d[NDIMS];
+            for (int i=0; i<NDIMS; ++i)
+                d[i] = d_[i];
+            compute(x, (*s.volume_)[e], d);
+        }
+        const_row operator[](int d) const {return d_[d];}
+#else
+            : s_(s), e_(e) {}
+        const_row operator[](int d) const {return s_.get(d, e_);}
+#endif
+    };
+
+
+    // coord, connectivity and volume are needed by layout 3 only
+    ShapeDeriv(int nelem, const coord_type &coord, const conn_type &connectivity,
+               const volume_type &volume) :
+        coord_(&coord), connectivity_(&connectivity), volume_(&volume),
+        a_(NULL), n_(0), len_(0)
+    {
+        resize(nelem);
+    }
+
+    ~ShapeDeriv() {aligned::free(a_);}
+
+    // the content is zeroed, the buffer is reused if large enough
+    void resize(int nelem)
+    {
+        n_ = nelem;
+        if (! is_stored) return;
+
+        const std::size_t len = std::size_t((nelem + block - 1) / block) * block * elem_stride;
+        if (len > len_ || len < len_ / 2) {
+            aligned::free(a_);
+            a_ = aligned::allocate<value_type>(len);
+            len_ = len;
+        }
+        aligned::fill(a_, len, value_type(0));
+    }
+
+    std::size_t size() const {return n_;}
+    std::size_t capacity_bytes() const {return len_ * sizeof(value_type);}
+
+    row get(int d, std::size_t e) {return a_ + offset(d, e);}
+    const_row get(int d, std::size_t e) const {return a_ + offset(d, e);}
+
+private:
+    const coord_type *coord_;
+    const conn_type *connectivity_;
+    const volume_type *volume_;
+
+    value_type *a_;
+    int n_;
+    std::size_t len_;
+
+    std::size_t offset(int d, std::size_t e) const
+    {
+#if SHAPEFN_LAYOUT == 0
+        return (std::size_t(d) * n_ + e) * NODES_PER_ELEM;
+#elif SHAPEFN_LAYOUT == 1
+        return e * elem_stride + d * NODES_PER_ELEM;
+#elif SHAPEFN_LAYOUT == 2
+        return (e / block) * block * elem_stride + d * NODES_PER_ELEM * block + e % block;
+#else
+        return 0;
+#endif
+    }
+
+    // disable copy
+    ShapeDeriv(const ShapeDeriv&);
+    ShapeDeriv& operator=(const ShapeDeriv&);
+};
+
+#endif
@@ -3,43 +3,43 @@
 
 #include <numeric>
 
-template< typename T >
+template< typename T, typename A >
 class idx_lt {
-    const std::vector<T>& _x;
+    const std::vector<T,A>& _x;
 public:
-    idx_lt( const std::vector<T>& x ) : _x(x) {}
+    idx_lt( const std::vector<T,A>& x ) : _x(x) {}
     bool operator()( std::size_t left, std::size_t right ) const { return _x[left] < _x[right]; }
 };
 
 
-template< typename T >
+template< typename T, typename A >
 class idx_gt {
-    const std::vector<T>& _x;
+    const std::vector<T,A>& _x;
 public:
-    idx_gt( const std::vector<T>& x ) : _x(x) {}
+    idx_gt( const std::vector<T,A>& x ) : _x(x) {}
     bool operator()( std::size_t left, std::size_t right ) const { return _x[left] > _x[right]; }
 };
 
 
 /* sort x in ascending order, x is not modified, the sorted order is stored in idx */
-template< typename T >
-void sortindex(const std::vector<T>& x, std::vector<std::size_t>& idx)
+template< typename T, typename A >
+void sortindex(const std::vector<T,A>& x, std::vector<std::size_t>& idx)
 {
     // fill idx = [0, 1, 2, ...]
     std::iota(idx.begin(), idx.end(), 0);
 
-    std::sort(idx.begin(), idx.end(), idx_lt<T>(x));
+    std::sort(idx.begin(), idx.end(), idx_lt<T,A>(x));
 }
 
 
 /* sort x in descending order, x is not modified, the sorted order is stored in idx */
-template< typename T >
-void sortindex_reversed(const std::vector<T>& x, std::vector<std::size_t>& idx)
+template< typename T, typename A >
+void sortindex_reversed(const std::vector<T,A>& x, std::vector<std::size_t>& idx)
 {
     // fill idx = [0, 1, 2, ...]
     std::iota(idx.begin(), idx.end(), 0);
 
-    std::sort(idx.begin(), idx.end(), idx_gt<T>(x));
+    std::sort(idx.begin(), idx.end(), idx_gt<T,A>(x));
 }
 
 
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+#include "constants.hpp"
+#include "parameters.hpp"
+#include "decomposition.hpp"
+#include "memory.hpp"
+#include "timers.hpp"
+#include "status.hpp"
+
+
+StatusFile::StatusFile(const Param& param, const Variables& var) :
+    filename(param.sim.modelname + ".status"),
+    interval(param.sim.status_step_interval),
+    max_steps(param.sim.max_steps),
+    max_time(param.sim.max_time_in_yr * YEAR2SEC)
+{
+    start_wtime = last_wtime = remesh_wtime = PhaseTimers::wtime();
+    start_steps = last_steps = remesh_steps = var.steps;
+    last_time = var.time;
+    nremesh = 0;
+}
+
+
+bool StatusFile::is_due(const Variables& var) const
+{
+    return interval && var.steps % interval == 0;
+}
+
+
+void StatusFile::remeshed(const Variables& var)
+{
+    ++nremesh;
+    remesh_steps = var.steps;
+    remesh_wtime = PhaseTimers::wtime();
+}
+
+
+void StatusFile::write(const Variables& var, const char *state)
+{
+    // the mesh size and memory are of the partition of the root process
+    if (! is_root_process()) return;
+
+    const double now = PhaseTimers::wtime();
+    const double dwall = now - last_wtime;
+    const double steps_per_sec = (dwall > 0) ? (var.steps - last_steps) / dwall : 0;
+    const double yr_per_hour = (dwall > 0) ? (var.time - last_time) / YEAR2SEC / dwall * 3600 : 0;
+
+    // projected from the recent throughput, whichever limit comes first
+    double remaining = std::numeric_limits<double>::max();
+    if (max_steps < std::numeric_limits<int>::max() && steps_per_sec > 0)
+        remaining = std::min(remaining, (max_steps - var.steps) / steps_per_sec);
+    if (max_time < std::numeric_limits<double>::max() && var.time > last_time && dwall > 0)
+        remaining = std::min(remaining, (max_time - var.time) / ((var.time - last_time) / dwall));
+    if (remaining == std::numeric_limits<double>::max()) remaining = -1;
+
+    double progress = 0;
+    if (max_steps < std::numeric_limits<int>::max())
+        progress = std::max(progress, double(var.steps) / max_steps);
+    if (max_time < std::numeric_limits<double>::max())
+        progress = std::max(progress, var.time / max_time);
+
+    var.memory->update(var);
+
+    std::string tmpname(filename + ".tmp");
+    std::FILE* f = std::fopen(tmpname.c_str(), "w");
+    if (f == NULL) {
+        std::cerr << "Error: cannot open file: " << tmpname << '\n';
+        std::exit(2);
+    }
+    std::fprintf(f, "{\n"
+                 "  \"state\": \"%s\",\n"
+                 "  \"steps\": %d,\n"
+                 "  \"time_in_yr\": %.6e,\n"
+                 "  \"dt_in_yr\": %.6e,\n"
+                 "  \"nnode\": %d,\n"
+                 "  \"nelem\": %d,\n"
+                 "  \"wall_time\": %.3f,\n"
+                 "  \"steps_per_sec\": %.3f,\n"
+                 "  \"average_steps_per_sec\": %.3f,\n"
+                 "  \"yr_per_hour\": %.6e,\n"
+                 "  \"remeshings\": %d,\n"
+                 "  \"steps_since_remesh\": %d,\n"
+                 "  \"sec_since_remesh\": %.3f,\n"
+                 "  \"progress\": %.6f,\n"
+                 "  \"remaining_sec\": %.1f,\n"
+                 "  \"memory_bytes\": %zu,\n"
+                 "  \"rss_bytes\": %zu\n"
+                 "}\n",
+                 state, var.steps, var.time / YEAR2SEC, var.dt / YEAR2SEC,
+                 var.nnode, var.nelem, now - start_wtime, steps_per_sec,
+                 (now > start_wtime) ? (var.steps - start_steps) / (now - start_wtime) : 0,
+                 yr_per_hour, nremesh, var.steps - remesh_steps, now - remesh_wtime,
+                 progress, remaining, var.memory->total(), resident_set_size());
+    std::fclose(f);
+
+    // atomic replacement on POSIX
+    if (std::rename(tmpname.c_str(), filename.c_str()) != 0) {
+        std::cerr << "Error: cannot rename file: " << tmpname << '\n';
+        std::exit(2);
+    }
+
+    last_wtime = now;
+    last_steps = var.steps;
+    last_time = var.time;
+}
@@ -0,0 +1,42 @@
+#ifndef DYNEARTHSOL3D_STATUS_HPP
+#define DYNEARTHSOL3D_STATUS_HPP
+
+#include <string>
+
+/* Progress of a running model in 'modelname.status', for monitoring.
+ *
+ * Every sim.status_step_interval steps, the file is rewritten with the
+ * current throughput, time step, mesh size, memory usage and projected
+ * completion, as a single JSON object. The file is written to a temporary
+ * file and renamed, so a reader always sees a complete file.
+ */
+
+class StatusFile
+{
+public:
+    StatusFile(const Param& param, const Variables& var);
+
+    bool is_due(const Variables& var) const;
+    void remeshed(const Variables& var);
+    void write(const Variables& var, const char *state="running");
+
+private:
+    const std::string filename;
+    const int interval;
+    const int max_steps;
+    const double max_time;
+
+    double start_wtime;
+    int start_steps;
+
+    // at the previous update
+    double last_wtime;
+    int last_steps;
+    double last_time;
+
+    int nremesh;
+    int remesh_steps;
+    double remesh_wtime;
+};
+
+#endif
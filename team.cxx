@@ -0,0 +1,34 @@
+#include "team.hpp"
+
+
+namespace {
+
+#ifdef USE_OMP
+    // each thread has its own flag, the threads of a nested team start
+    // outside of it
+    bool is_in_team = false;
+    #pragma omp threadprivate(is_in_team)
+#else
+    bool is_in_team = true;
+#endif
+
+} // anonymous namespace
+
+
+bool in_team()
+{
+    return is_in_team;
+}
+
+
+TeamScope::TeamScope() :
+    was_in_team(is_in_team)
+{
+    is_in_team = true;
+}
+
+
+TeamScope::~TeamScope()
+{
+    is_in_team = was_in_team;
+}
@@ -0,0 +1,51 @@
+#ifndef DYNEARTHSOL3D_TEAM_HPP
+#define DYNEARTHSOL3D_TEAM_HPP
+
+/* Kernels that share their loops among the threads of a team, so that the
+ * time loop can run in one persistent parallel region (with
+ * sim.has_persistent_team) instead of opening a region in every kernel.
+ *
+ * A team kernel is called by all threads of the team, and its loops are
+ * orphaned "omp for" directives. Called outside a team, it opens its own
+ * parallel region and calls itself again:
+ *     void update_velocity(const Variables& var, array_t& vel)
+ *     {
+ *         if (! in_team()) {
+ *             #pragma omp parallel default(none) shared(var, vel)
+ *             {
+ *                 TeamScope team;
+ *                 update_velocity(var, vel);
+ *             }
+ *             return;
+ *         }
+ *         #pragma omp for nowait
+ *         for (...) ...
+ *     }
+ * The serial parts of a team kernel are in "omp single". A team kernel does
+ * not wait for the team at its end (except loop_all_elem()), the caller puts
+ * an "omp barrier" before the results are used, as PhaseGraph does between
+ * dependent phases. Outside a parallel region, barriers and single blocks
+ * are no-ops, so the callers work the same in a team or not.
+ *
+ * Without OpenMP, the only thread is always in its team.
+ */
+
+// whether the calling thread runs team kernels with its team
+bool in_team();
+
+
+class TeamScope  // the calling thread is in its team during the lifetime
+{
+public:
+    TeamScope();
+    ~TeamScope();
+
+private:
+    const bool was_in_team;
+
+    // disable copy
+    TeamScope(const TeamScope&);
+    TeamScope& operator=(const TeamScope&);
+};
+
+#endif
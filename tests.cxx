@@ -1,10 +1,14 @@
 #include <algorithm>
+#ifdef USE_OMP
+#include <omp.h>
+#endif
 
 #include "constants.hpp"
 #include "parameters.hpp"
 
 #include "array2d.hpp"
 #include "barycentric-fn.hpp"
+#include "mesh.hpp"
 #include "sortindex.hpp"
 #include "utils.hpp"
 
@@ -220,6 +224,51 @@ void test_principal_stresses2()
     std::cout << "\n";
 }
 
+bool test_elem_groups(const Param &param, Variables &var)
+{
+    /* The element groups of create_elem_groups() must be bands: a node is
+     * shared by at most two adjacent groups, or the threads of
+     * loop_all_elem() race on its sum. Checks 1 to 16 threads on the mesh
+     * of var, as numbered by renumbering_mesh(). */
+    bool ok = true;
+#ifdef USE_OMP
+    const int nthreads0 = omp_get_max_threads();
+    for (int nthreads=1; nthreads<=16; ++nthreads) {
+        omp_set_num_threads(nthreads);
+#endif
+        create_elem_groups(param, var);
+        const int ngroups = var.egroups.size() - 1;
+
+        int_vec gmin(var.nnode, ngroups), gmax(var.nnode, -1);
+        for (int g=0; g<ngroups; ++g) {
+            for (int e=var.egroups[g]; e<var.egroups[g+1]; ++e) {
+                const int *conn = (*var.connectivity)[e];
+                for (int i=0; i<NODES_PER_ELEM; ++i) {
+                    gmin[conn[i]] = std::min(gmin[conn[i]], g);
+                    gmax[conn[i]] = std::max(gmax[conn[i]], g);
+                }
+            }
+        }
+        int nbad = 0;
+        for (int n=0; n<var.nnode; ++n)
+            if (gmax[n] - gmin[n] > 1) ++nbad;
+
+        std::cout << ngroups << " groups: ";
+        if (nbad) {
+            std::cout << "FAILED, " << nbad << " nodes shared by groups two or more apart\n";
+            ok = false;
+        }
+        else
+            std::cout << "ok\n";
+#ifdef USE_OMP
+    }
+    omp_set_num_threads(nthreads0);
+    create_elem_groups(param, var);
+#endif
+    return ok;
+}
+
+
 // Compile with:
 //    g++ --std=c++11 tests.cxx 3x3-C/lib3x3.a
 //
@@ -0,0 +1,78 @@
+#include <algorithm>
+
+#ifdef USE_OMP
+#include <omp.h>
+#else
+#include <ctime>
+#endif
+
+#include "timers.hpp"
+
+
+PhaseTimers::PhaseTimers()
+{
+#ifdef USE_OMP
+    nthreads = omp_get_max_threads();
+#else
+    nthreads = 1;
+#endif
+    // each thread has its own cache line(s)
+    const int doubles_per_line = 64 / sizeof(double);
+    stride = (nphases + doubles_per_line - 1) / doubles_per_line * doubles_per_line;
+    acc = new double[nthreads * stride];
+    reset();
+}
+
+
+PhaseTimers::~PhaseTimers()
+{
+    delete [] acc;
+}
+
+
+double PhaseTimers::wtime()
+{
+#ifdef USE_OMP
+    return omp_get_wtime();
+#else
+    return double(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+
+const char* PhaseTimers::name(int phase)
+{
+    static const char *names[nphases] = {
+        "temperature", "strain_rate", "dvoldt", "stress", "force", "velocity", "bc",
+        "mesh_update", "rotate_stress", "dt", "phase_changes", "averaging", "output",
+        "quality_check", "remesh",
+        "remesh_improve", "remesh_new_mesh", "remesh_interpolation", "remesh_markers",
+        "remesh_rebuild"
+    };
+    return names[phase];
+}
+
+
+void PhaseTimers::add(Phase phase, double seconds)
+{
+    int tid = 0;
+#ifdef USE_OMP
+    tid = std::min(omp_get_thread_num(), nthreads - 1);
+#endif
+    acc[tid * stride + phase] += seconds;
+}
+
+
+void PhaseTimers::sum(double total[nphases]) const
+{
+    std::fill_n(total, static_cast<int>(nphases), 0.0);
+    for (int t=0; t<nthreads; ++t)
+        for (int i=0; i<nphases; ++i)
+            total[i] += acc[t * stride + i];
+}
+
+
+void PhaseTimers::reset()
+{
+    std::fill_n(acc, nthreads * stride, 0.0);
+}
@@ -0,0 +1,78 @@
+#ifndef DYNEARTHSOL3D_TIMERS_HPP
+#define DYNEARTHSOL3D_TIMERS_HPP
+
+/* Wall-clock time spent in each phase of the time loop, accumulated
+ * separately by each thread and summed up when written out.
+ *
+ * Usage:
+ *     TIMED(*var.timers, stress, update_stress(var, ...));
+ * or
+ *     SCOPED_TIMER(*var.timers, remesh_rebuild);
+ *
+ * Compiling with -DNO_PHASE_TIMERS (make timers=0) removes all timers.
+ */
+
+class PhaseTimers
+{
+public:
+    // the remesh_* phases are nested inside remesh
+    enum Phase {
+        temperature, strain_rate, dvoldt, stress, force, velocity, bc,
+        mesh_update, rotate_stress, dt, phase_changes, averaging, output,
+        quality_check, remesh,
+        remesh_improve, remesh_new_mesh, remesh_interpolation, remesh_markers,
+        remesh_rebuild,
+        nphases
+    };
+
+    PhaseTimers();
+    ~PhaseTimers();
+
+    static double wtime();
+    static const char* name(int phase);
+
+    void add(Phase phase, double seconds);
+    void sum(double total[nphases]) const;
+    void reset();
+
+private:
+    int nthreads;
+    int stride;  // padded to avoid false sharing between threads
+    double *acc;
+
+    // disable copy
+    PhaseTimers(const PhaseTimers&);
+    PhaseTimers& operator=(const PhaseTimers&);
+};
+
+
+class ScopedTimer
+{
+public:
+    ScopedTimer(PhaseTimers &timers, PhaseTimers::Phase phase) :
+        timers(timers), phase(phase), t0(PhaseTimers::wtime())
+    {}
+
+    ~ScopedTimer()
+    {
+        timers.add(phase, PhaseTimers::wtime() - t0);
+    }
+
+private:
+    PhaseTimers &timers;
+    const PhaseTimers::Phase phase;
+    const double t0;
+};
+
+
+#ifdef NO_PHASE_TIMERS
+#define TIMED(timers, phase, ...) do { __VA_ARGS__; } while (0)
+#define SCOPED_TIMER(timers, phase)
+#else
+#define TIMED(timers, phase, ...) \
+    do { ScopedTimer timer_(timers, PhaseTimers::phase); __VA_ARGS__; } while (0)
+// timing till the end of current scope
+#define SCOPED_TIMER(timers, phase) ScopedTimer timer_##phase(timers, PhaseTimers::phase)
+#endif
+
+#endif
@@ -5,6 +5,8 @@
 #include <iostream>
 #include <vector>
 
+#include "team.hpp"
+
 /////////////////////////////////////////////////////////////////////
 
 class ElemFunc  // base class for functor used in loop_all_elem()
@@ -18,17 +20,28 @@ public:
 inline void loop_all_elem(const std::vector<int> &egroups, ElemFunc &functor)
 {
 #ifdef USE_OMP
+    // a team kernel, see team.hpp
+    if (! in_team()) {
+        #pragma omp parallel default(none) shared(egroups, functor)
+        {
+            TeamScope team;
+            loop_all_elem(egroups, functor);
+        }
+        return;
+    }
+
     // See mesh.cxx::create_elem_groups() for parallel strategy
 
     // loop over elements in even element groups
-    #pragma omp parallel for default(none) shared(egroups, functor)
+    #pragma omp for
     for (std::size_t i=0; i<egroups.size()-1; i+=2) {
         for (int e=egroups[i]; e<egroups[i+1]; ++e)
             functor(e);
     }
 
-    // loop over elements in odd element groups
-    #pragma omp parallel for default(none) shared(egroups, functor)
+    // loop over elements in odd element groups, the team waits at the end,
+    // as the nodal sums are used right after
+    #pragma omp for
     for (std::size_t i=1; i<egroups.size()-1; i+=2) {
         for (int e=egroups[i]; e<egroups[i+1]; ++e)
             functor(e);
@@ -36,9 +49,16 @@ inline void loop_all_elem(const std::vector<int> &egroups, ElemFunc &functor)
 
 #else
 
-    // loop over all elements sequentially
-    for (int e=egroups[0]; e<egroups[egroups.size()-1]; ++e)
-        functor(e);
+    // loop over all elements sequentially, in the same order as above, so
+    // that the result is the same as the parallel loop with the same groups
+    for (std::size_t i=0; i<egroups.size()-1; i+=2) {
+        for (int e=egroups[i]; e<egroups[i+1]; ++e)
+            functor(e);
+    }
+    for (std::size_t i=1; i<egroups.size()-1; i+=2) {
+        for (int e=egroups[i]; e<egroups[i+1]; ++e)
+            functor(e);
+    }
 
 #endif
 }